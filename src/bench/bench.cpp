@@ -0,0 +1,672 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../endgame/bitbase.h"
+#include "../search/mate.h"
+#include "../search/pool.h"
+#include "../search/search.h"
+#include "../search/stack.h"
+#include "../search/stats.h"
+#include "../search/tt.h"
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//! Openings, middlegames and endgames, tactical and quiet.
+static const char* const POSITIONS[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+  "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+  "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+  "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+  "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+  "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+  "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+  "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+  "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+  "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+  "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+  "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+  "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+  "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+  "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+  "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+  "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+  "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+};
+
+//! Moves of one game, whose positions the shared hash processes split.
+static const char* const GAME[] = {
+  "e2e4", "e7e5", "g1f3", "d7d6", "d2d4", "c8g4", "d4e5", "g4f3", "d1f3",
+  "d6e5", "f1c4", "g8f6", "f3b3", "d8e7", "b1c3", "c7c6", "c1g5", "b7b5",
+  "c3b5", "c6b5", "c4b5", "b8d7", "e1c1", "a8d8", "d1d7", "d8d7", "h1d1",
+  "e7e6", "b5d7", "f6d7", "b3b8", "d7b8", "d1d8",
+};
+
+//! Built-in mate puzzles: EPD with the mate length, easiest first.
+static const char* const MATES[] = {
+  "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - dm 1; "
+  "id \"Scholar's mate\";",
+  "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - dm 1; id \"Back rank\";",
+  "k7/8/8/8/8/8/1R6/2R4K w - - dm 1; id \"Two rooks\";",
+  "6rk/6pp/8/6N1/8/8/8/1Q4K1 w - - dm 1; id \"Queen and knight\";",
+  "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq - dm 2; "
+  "id \"Legal's mate\";",
+  "4kb1r/p2n1ppp/4q3/4p1B1/4P3/1Q6/PPP2PPP/2KR4 w k - dm 2; "
+  "id \"Opera game\";",
+  "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - dm 2; "
+  "id \"WAC.001\";",
+  "1r6/4b2k/1q1pNrpp/p2Pp3/4P3/1P1R3Q/5PPP/5RK1 w - - dm 2;",
+  "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - dm 3;",
+  "r1b3kr/ppp1Bp1p/1b6/n2P4/2p3q1/2Q2N2/P4PPP/RN2R1K1 w - - dm 3;",
+  "3q1rk1/p4pp1/2pb3p/3p4/6Pr/1PNQ4/P1PB1PP1/4RRK1 b - - dm 5;",
+  "rn3rk1/pbppq1pp/1p2pb2/4N2Q/3PN3/3B4/PPP2PPP/R3K2R w KQ - dm 8; "
+  "id \"Lasker-Thomas\";",
+  "8/8/8/3k4/8/8/8/3QK3 w - - dm 8; id \"KQK\";",
+};
+
+/*!
+ *  @struct Puzzle
+ *  @brief A mate puzzle read from EPD.
+ */
+struct Puzzle {
+  std::string fen;     //!< Position, with move counters.
+  unsigned int moves;  //!< Mate length, 0 if unknown.
+  std::string id;      //!< Name given by the "id" operation, if any.
+};
+
+//! Parses an EPD line, returns false if it holds no position.
+static bool parseEpd(const std::string& line, Puzzle& r_puzzle) {
+  std::istringstream fields(line);
+  std::string field;
+  std::string fen;
+  for (unsigned int i = 0; i < 4; ++i) {
+    if (!(fields >> field)) {
+      return false;
+    }
+    fen += (i? " " : "") + field;
+  }
+  r_puzzle.fen = fen + " 0 1";
+  r_puzzle.moves = 0;
+  r_puzzle.id.clear();
+
+  // Operations: "opcode operands;".
+  std::string operations;
+  std::getline(fields, operations);
+  std::istringstream list(operations);
+  std::string operation;
+  while (std::getline(list, operation, ';')) {
+    std::istringstream tokens(operation);
+    std::string opcode;
+    tokens >> opcode;
+    if (opcode == "dm") {
+      tokens >> r_puzzle.moves;
+    } else if (opcode == "id") {
+      std::getline(tokens >> std::ws, r_puzzle.id);
+      r_puzzle.id.erase(std::remove(r_puzzle.id.begin(), r_puzzle.id.end(),
+                                    '"'), r_puzzle.id.end());
+    }
+  }
+  return true;
+}
+
+//! Logs count, total, mean, median and maximum of solve times (ms).
+static void logTimes(const std::string& name,
+                     std::vector<std::uint64_t> times,
+                     const std::size_t puzzles) noexcept
+{
+  if (times.empty()) {
+    Logger::info(name + ": solved 0/" + std::to_string(puzzles));
+    return;
+  }
+  std::sort(times.begin(), times.end());
+  std::uint64_t total = 0;
+  for (const std::uint64_t time : times) {
+    total += time;
+  }
+  Logger::info(name + ": solved " + std::to_string(times.size()) + "/" +
+               std::to_string(puzzles) + ", total " + std::to_string(total) +
+               " ms, mean " + std::to_string(total / times.size()) +
+               " ms, median " + std::to_string(times[times.size() / 2]) +
+               " ms, max " + std::to_string(times.back()) + " ms");
+}
+
+/*!
+ *  @struct Totals
+ *  @brief Sums over all bench positions.
+ */
+struct Totals {
+  std::uint64_t nodes = 0; //!< Nodes searched.
+  std::uint64_t time = 0;  //!< Microseconds spent.
+  SearchStats stats;       //!< Merged counters.
+};
+
+//! Searches every position with a cleared hash, logging them if 'verbose'.
+static Totals searchAll(SearchPool& r_pool, const SearchLimits& limits,
+                        const bool verbose) noexcept
+{
+  Totals totals;
+  unsigned int index = 0;
+  for (const char* const fen : POSITIONS) {
+    Board board;
+    board.loadFen(fen);
+
+    r_pool.clear();
+    const auto start = std::chrono::steady_clock::now();
+    const SearchResult& result = r_pool.go(board, limits);
+    totals.time += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    totals.nodes += result.nodes;
+    totals.stats.merge(r_pool.getStats());
+
+    if (verbose) {
+      Logger::info("Position " + std::to_string(++index) + ": " +
+                   result.bestMove.toUci() + " score " +
+                   std::to_string(result.score) + ", " +
+                   std::to_string(result.nodes) + " nodes");
+    }
+  }
+  return totals;
+}
+
+void Bench::run(const unsigned int depth, const unsigned int threads,
+                const std::size_t hash, const unsigned int multiPv) noexcept
+{
+  Bitbase::init();
+
+  SearchPool pool(hash);
+  pool.setThreads(threads);
+  SearchOptions options = pool.getOptions();
+  options.multiPv = multiPv;
+  pool.setOptions(options);
+
+  SearchLimits limits;
+  limits.depth = depth;
+
+  const Totals& totals = searchAll(pool, limits, true);
+
+  Logger::info("Depth " + std::to_string(depth) + ", " +
+               std::to_string(pool.getThreads()) + " threads, " +
+               std::to_string(hash) + " MiB hash, MultiPV " +
+               std::to_string(multiPv));
+  Logger::info("Search stack: " +
+               std::to_string(SearchStack::getSize() / 1024) +
+               " KiB per thread, preallocated");
+  Logger::info("Total time (ms) : " + std::to_string(totals.time / 1000));
+  Logger::info("Nodes searched  : " + std::to_string(totals.nodes));
+  Logger::info("Nodes/second    : " +
+               std::to_string(totals.nodes * 1000000 / (totals.time + 1)));
+  if (SearchStats::ENABLED) {
+    Logger::info("Stats: " + totals.stats.toJson());
+  }
+
+  // Cost of the extra lines relative to a single line, to the same depth.
+  if (multiPv > 1) {
+    options.multiPv = 1;
+    pool.setOptions(options);
+    const Totals& single = searchAll(pool, limits, false);
+    Logger::info("MultiPV " + std::to_string(multiPv) + " vs 1: " +
+                 std::to_string(double(totals.time) / (single.time + 1)) +
+                 "x time, " +
+                 std::to_string(double(totals.nodes) / (single.nodes + 1)) +
+                 "x nodes to depth " + std::to_string(depth));
+  }
+
+  if (pool.getThreads() > 1) {
+    Logger::info("Node count is not deterministic with several threads");
+  }
+}
+
+//! Steps a SplitMix64 generator.
+static std::uint64_t nextKey(std::uint64_t& r_state) noexcept {
+  std::uint64_t z = (r_state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ z >> 27) * 0x94D049BB133111EBull;
+  return z ^ z >> 31;
+}
+
+//! Returns the nanoseconds per probe, dependent or prefetched 8 ahead.
+static void probeCost(const TranspositionTable& table, double& r_latency,
+                      double& r_prefetched) noexcept
+{
+  constexpr std::size_t PROBES = 1 << 22;
+  constexpr std::size_t AHEAD = 8;
+  TranspositionTable::Data data{};
+
+  // Each key depends on the previous probe, so misses cannot overlap.
+  std::uint64_t state = 1;
+  std::uint64_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < PROBES; ++i) {
+    state ^= found;
+    found += table.probe(nextKey(state), data) + data.depth;
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  r_latency = elapsed.count() / PROBES;
+
+  std::vector<std::uint64_t> keys(PROBES);
+  for (std::uint64_t& key : keys) {
+    key = nextKey(state);
+  }
+  start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < PROBES; ++i) {
+    if (i + AHEAD < PROBES) {
+      table.prefetch(keys[i + AHEAD]);
+    }
+    found += table.probe(keys[i], data);
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  r_prefetched = elapsed.count() / PROBES;
+
+  // Keeps the loops from being optimised away.
+  if (found == 1) {
+    Logger::debug("unlikely probe total");
+  }
+}
+
+void Bench::pages(const std::size_t mb, const unsigned int depth) noexcept {
+  Bitbase::init();
+
+  SearchLimits limits;
+  limits.depth = depth;
+
+  double nps[2] = {};
+  for (const bool large : {true, false}) {
+    double latency = 0;
+    double prefetched = 0;
+    TranspositionTable::Pages pages;
+    {
+      // Filled so that probes read real entries.
+      TranspositionTable table(mb, large);
+      std::uint64_t state = 2;
+      for (std::size_t i = 0; i < table.getSize() / 16; ++i) {
+        table.store(nextKey(state), 0, 0, i & 63,
+                    TranspositionTable::Bound::Exact);
+      }
+      probeCost(table, latency, prefetched);
+      pages = table.getPages();
+    }
+
+    SearchPool pool(mb);
+    pool.setLargePages(large);
+    const Totals& totals = searchAll(pool, limits, false);
+    nps[large] = double(totals.nodes) * 1000000 / (totals.time + 1);
+
+    Logger::info(std::to_string(mb) + " MiB on " +
+                 TranspositionTable::getPagesName(pages) +
+                 " pages: probe " + std::to_string(latency) +
+                 " ns, prefetched " + std::to_string(prefetched) +
+                 " ns, search " + std::to_string(std::uint64_t(nps[large])) +
+                 " nps, " + std::to_string(totals.nodes) + " nodes");
+  }
+  Logger::info("Large pages speedup: " + std::to_string(nps[1] / nps[0]) +
+               "x nps at depth " + std::to_string(depth));
+}
+
+//! Returns the positions before each move of GAME.
+static std::vector<Board> gamePositions() noexcept {
+  std::vector<Board> positions;
+  Board board;
+  board.loadFen();
+  for (const char* const uci : GAME) {
+    positions.push_back(board);
+    for (const Move& move : board.getLegalMoves()) {
+      if (move.toUci() == uci) {
+        board = board.makeMove(move);
+        break;
+      }
+    }
+  }
+  return positions;
+}
+
+/*!
+ *  @brief Analyses the game with 'processes' processes, returning the nodes.
+ *
+ *  Process k takes positions k, k + processes and so on, so at any time the
+ *  processes look at neighbouring positions. With a non empty 'name' they
+ *  all attach to that shared hash table.
+ */
+static std::uint64_t analyseGame(const std::vector<Board>& positions,
+                                 const unsigned int processes,
+                                 const unsigned int depth,
+                                 const std::size_t mb,
+                                 const std::string& name) noexcept
+{
+  std::uint64_t nodes = 0;
+#if defined(__linux__)
+  int channel[2];
+  if (pipe(channel) != 0) {
+    return 0;
+  }
+  std::vector<pid_t> children;
+  for (unsigned int k = 0; k < processes; ++k) {
+    const pid_t pid = fork();
+    if (pid) {
+      children.push_back(pid);
+      continue;
+    }
+
+    // Child: destructors must run before _exit() to detach.
+    close(channel[0]);
+    std::uint64_t searched = 0;
+    {
+      SearchPool pool(mb);
+      if (!name.empty() && !pool.attachShared(name)) {
+        _exit(1);
+      }
+      SearchLimits limits;
+      limits.depth = depth;
+      for (std::size_t i = k; i < positions.size(); i += processes) {
+        searched += pool.go(positions[i], limits).nodes;
+      }
+    }
+    const bool written =
+        write(channel[1], &searched, sizeof(searched)) == sizeof(searched);
+    _exit(written? 0 : 1);
+  }
+
+  close(channel[1]);
+  std::uint64_t searched;
+  while (read(channel[0], &searched, sizeof(searched)) == sizeof(searched)) {
+    nodes += searched;
+  }
+  close(channel[0]);
+  for (const pid_t pid : children) {
+    waitpid(pid, nullptr, 0);
+  }
+#else
+  (void)positions;
+  (void)processes;
+  (void)depth;
+  (void)mb;
+  (void)name;
+#endif
+  return nodes;
+}
+
+void Bench::shared(const unsigned int processes, const unsigned int depth,
+                   const std::size_t mb) noexcept
+{
+#if defined(__linux__)
+  Bitbase::init();
+  const std::vector<Board>& positions = gamePositions();
+
+  // Holding the segment keeps it alive, and cleared, between the children.
+  const std::string name = "/nelly-bench-" + std::to_string(getpid());
+  TranspositionTable holder(mb, false);
+  if (!holder.attach(name)) {
+    Logger::error("Could not create the shared segment " + name);
+    return;
+  }
+
+  std::uint64_t nodes[2] = {};
+  std::uint64_t time[2] = {};
+  for (const bool share : {false, true}) {
+    const auto start = std::chrono::steady_clock::now();
+    nodes[share] = analyseGame(positions, processes, depth, mb,
+                               share? name : std::string());
+    time[share] = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    Logger::info(std::string(share? "Shared " : "Private") + " hash: " +
+                 std::to_string(nodes[share]) + " nodes in " +
+                 std::to_string(time[share]) + " ms");
+  }
+  Logger::info(std::to_string(processes) + " processes, " +
+               std::to_string(positions.size()) + " positions, depth " +
+               std::to_string(depth) + ", " + std::to_string(mb) +
+               " MiB: sharing takes " +
+               std::to_string(double(time[1]) / (time[0] + 1)) +
+               "x the time and " +
+               std::to_string(double(nodes[1]) / (nodes[0] + 1)) +
+               "x the nodes");
+#else
+  (void)processes;
+  (void)depth;
+  (void)mb;
+  Logger::error("Shared hash tables need POSIX shared memory");
+#endif
+}
+
+void Bench::cache(const std::string& path, const unsigned int depth) noexcept {
+  Bitbase::init();
+
+  SearchPool pool(HASH);
+  SearchLimits limits;
+  auto session = [&](const char* const name, const unsigned int searched) {
+    limits.depth = searched;
+    const Totals& totals = searchAll(pool, limits, false);
+    Logger::info(std::string(name) + ", depth " + std::to_string(searched) +
+                 ": " + std::to_string(totals.nodes) + " nodes in " +
+                 std::to_string(totals.time / 1000) + " ms");
+    return totals;
+  };
+
+  if (!pool.openCache(path)) {
+    Logger::error("Could not open the cache " + path);
+    return;
+  }
+  session("First session", depth);
+  Logger::info(pool.getCache().describe());
+
+  const auto start = std::chrono::steady_clock::now();
+  pool.openCache(path);
+  Logger::info("Reopened in " + std::to_string(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start).count()) + " us");
+  session("Same depth", depth);
+  const Totals& cached = session("One deeper", depth + 1);
+  Logger::info(pool.getCache().describe());
+
+  pool.openCache("");
+  const Totals& plain = session("Without cache", depth + 1);
+  Logger::info("One deeper with the cache: " +
+               std::to_string(double(cached.time) / (plain.time + 1)) +
+               "x the time, " +
+               std::to_string(double(cached.nodes) / (plain.nodes + 1)) +
+               "x the nodes");
+}
+
+void Bench::mate(const std::string& path, const unsigned int moves,
+                 const std::uint64_t time) noexcept
+{
+  std::vector<Puzzle> puzzles;
+  Puzzle puzzle;
+  if (path.empty()) {
+    for (const char* const line : MATES) {
+      if (parseEpd(line, puzzle)) {
+        puzzles.push_back(puzzle);
+      }
+    }
+  } else {
+    std::ifstream file(path);
+    if (!file) {
+      Logger::error("Could not open " + path);
+      return;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+      if (parseEpd(line, puzzle)) {
+        puzzles.push_back(puzzle);
+      }
+    }
+  }
+  Bitbase::init();
+
+  MateSearch mate(HASH);
+  Search search;
+  TranspositionTable table(HASH);
+  search.setTable(&table);
+
+  std::vector<std::uint64_t> mateTimes;
+  std::vector<std::uint64_t> searchTimes;
+  std::vector<std::uint64_t> mateBoth;
+  std::vector<std::uint64_t> searchBoth;
+  for (std::size_t i = 0; i < puzzles.size(); ++i) {
+    Board board;
+    board.loadFen(puzzles[i].fen);
+    const unsigned int length = puzzles[i].moves? puzzles[i].moves : moves;
+
+    SearchLimits limits;
+    limits.time = time;
+    mate.clear();
+    const MateResult& proven = mate.go(board, length, limits);
+
+    // Alpha-beta stops at the first iteration announcing a short enough mate.
+    std::atomic<bool> stop(false);
+    bool solved = false;
+    std::uint64_t solveTime = 0;
+    limits.stop = &stop;
+    search.setReporter([&](const SearchResult& result) {
+      if (Search::isMateScore(result.score) && result.score > 0 &&
+          unsigned(Search::MATE - result.score + 1) / 2 <= length)
+      {
+        solved = true;
+        solveTime = result.time;
+        stop = true;
+      }
+    });
+    table.clear();
+    search.go(board, limits);
+
+    std::string line = "Puzzle " + std::to_string(i + 1) +
+                       (puzzles[i].id.empty()? "" : " (" + puzzles[i].id + ")") +
+                       ", mate in " + std::to_string(length) + ": proof ";
+    if (proven.found) {
+      mateTimes.push_back(proven.time);
+      line += std::to_string(proven.time) + " ms, " +
+              std::to_string(proven.nodes) + " nodes, mate in " +
+              std::to_string(proven.moves) + " " +
+              (proven.pvLength? proven.pv[0].toUci() : "-");
+    } else {
+      line += "unsolved";
+    }
+    line += "; alpha-beta ";
+    if (solved) {
+      searchTimes.push_back(solveTime);
+      line += std::to_string(solveTime) + " ms";
+    } else {
+      line += "unsolved";
+    }
+    if (proven.found && solved) {
+      mateBoth.push_back(proven.time);
+      searchBoth.push_back(solveTime);
+    }
+    Logger::info(line);
+  }
+
+  logTimes("Proof-number search", mateTimes, puzzles.size());
+  logTimes("Alpha-beta", searchTimes, puzzles.size());
+  std::uint64_t mateTotal = 0;
+  std::uint64_t searchTotal = 0;
+  for (std::size_t i = 0; i < mateBoth.size(); ++i) {
+    mateTotal += mateBoth[i];
+    searchTotal += searchBoth[i];
+  }
+  Logger::info("On the " + std::to_string(mateBoth.size()) +
+               " puzzles both solved, alpha-beta took " +
+               std::to_string(double(searchTotal + 1) / (mateTotal + 1)) +
+               "x the time");
+  Logger::info("Proof table: " + std::to_string(mate.getTable().getSize() >> 20) +
+               " MiB, " + std::to_string(mate.getTable().getCollections()) +
+               " garbage collections in the last puzzle");
+}
+
+//! Launches the engine in UCI mode, returning the ms until "uciok".
+static double timeStartup() noexcept {
+#if defined(__linux__)
+  int input[2];
+  int output[2];
+  if (pipe(input) != 0 || pipe(output) != 0) {
+    return -1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const pid_t pid = fork();
+  if (!pid) {
+    dup2(input[0], STDIN_FILENO);
+    dup2(output[1], STDOUT_FILENO);
+    close(input[1]);
+    close(output[0]);
+    execl("/proc/self/exe", "Nelly", static_cast<char*>(nullptr));
+    _exit(1);
+  }
+  close(input[0]);
+  close(output[1]);
+
+  double elapsed = -1;
+  const bool sent = write(input[1], "uci\n", 4) == 4;
+  std::string text;
+  char buffer[4096];
+  ssize_t length;
+  while (sent && (length = read(output[0], buffer, sizeof(buffer))) > 0) {
+    text.append(buffer, length);
+    if (text.find("uciok\n") != std::string::npos) {
+      const std::chrono::duration<double, std::milli> time =
+          std::chrono::steady_clock::now() - start;
+      elapsed = time.count();
+      break;
+    }
+  }
+
+  const bool quit = write(input[1], "quit\n", 5) == 5;
+  close(input[1]);
+  close(output[0]);
+  waitpid(pid, nullptr, 0);
+  return quit? elapsed : -1;
+#else
+  return -1;
+#endif
+}
+
+void Bench::startup(const unsigned int runs) noexcept {
+  std::vector<double> times;
+  for (unsigned int i = 0; i < runs; ++i) {
+    const double time = timeStartup();
+    if (time < 0) {
+      Logger::error("Could not start the engine");
+      return;
+    }
+    times.push_back(time);
+  }
+  std::sort(times.begin(), times.end());
+  Logger::info("Startup to uciok over " + std::to_string(runs) +
+               " runs: min " + std::to_string(times.front()) + " ms, median " +
+               std::to_string(times[times.size() / 2]) + " ms, max " +
+               std::to_string(times.back()) + " ms");
+}
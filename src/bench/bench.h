@@ -0,0 +1,113 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BENCH__
+#define __BENCH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*!
+ *  @class Bench
+ *  @brief Deterministic search benchmark.
+ *
+ *  Searches a fixed set of positions to a fixed depth with a freshly
+ *  cleared hash table. With one thread the total node count depends only on
+ *  the search itself, so it serves as a signature: any change in it means
+ *  the search behaves differently. The same run is the workload of the
+ *  profile guided build.
+ */
+class Bench {
+public:
+  static constexpr unsigned int DEPTH = 8;     //!< Default search depth.
+  static constexpr unsigned int THREADS = 1;   //!< Default thread count.
+  static constexpr std::size_t HASH = 16;      //!< Default hash size in MiB.
+  static constexpr unsigned int MULTI_PV = 1;  //!< Default number of lines.
+  static constexpr std::size_t PAGES_HASH = 256; //!< Default hashbench size.
+  static constexpr unsigned int PROCESSES = 4;   //!< Default sharebench size.
+  static constexpr const char* CACHE = "bench.cache"; //!< cachebench file.
+  static constexpr unsigned int MATE_MOVES = 5;      //!< Default mate depth.
+  static constexpr std::uint64_t MATE_TIME = 10000;  //!< Cap per puzzle (ms).
+  static constexpr unsigned int STARTUP_RUNS = 20;   //!< Default startups.
+
+public:
+  /*!
+   *  @brief Runs the benchmark, logging per position and total results.
+   *
+   *  With several MultiPV lines, the run is repeated with a single line
+   *  and the cost of the extra lines is logged as a time-to-depth ratio.
+   */
+  static void run(const unsigned int depth = DEPTH,
+                  const unsigned int threads = THREADS,
+                  const std::size_t hash = HASH,
+                  const unsigned int multiPv = MULTI_PV) noexcept;
+
+  /*!
+   *  @brief Compares the hash table on huge and on regular pages.
+   *
+   *  Logs the latency of random probes, one depending on the other, the
+   *  cost of the same probes prefetched ahead, and the NPS of the search
+   *  benchmark using a table of 'mb' MiB.
+   */
+  static void pages(const std::size_t mb = PAGES_HASH,
+                    const unsigned int depth = DEPTH) noexcept;
+
+  /*!
+   *  @brief Analyses the positions of one game with several processes.
+   *
+   *  Logs nodes and wall time with a hash table per process, then with all
+   *  processes attached to one shared table.
+   */
+  static void shared(const unsigned int processes = PROCESSES,
+                     const unsigned int depth = DEPTH,
+                     const std::size_t mb = HASH) noexcept;
+
+  /*!
+   *  @brief Measures what the analysis cache at 'path' saves.
+   *
+   *  Searches the positions into the cache, reopens it as a later session
+   *  would, then searches them again to the same depth and one deeper,
+   *  the latter also without the cache for comparison.
+   */
+  static void cache(const std::string& path = CACHE,
+                    const unsigned int depth = DEPTH) noexcept;
+
+  /*!
+   *  @brief Solves mate puzzles with the mate search and with alpha-beta.
+   *
+   *  Reads the EPD file at 'path', one puzzle per line with the mate length
+   *  in a "dm" operation, or uses a built-in set if the path is empty.
+   *  Puzzles without "dm" are searched for mates in up to 'moves' moves.
+   *  Logs the time to solve of both searches per puzzle and their totals,
+   *  means, medians and maxima; each search gets at most 'time' ms.
+   */
+  static void mate(const std::string& path = "",
+                   const unsigned int moves = MATE_MOVES,
+                   const std::uint64_t time = MATE_TIME) noexcept;
+
+  /*!
+   *  @brief Measures how long the engine takes to answer "uci".
+   *
+   *  Starts the engine's own executable 'runs' times as a GUI would and
+   *  logs the minimum, median and maximum time from launch to "uciok".
+   */
+  static void startup(const unsigned int runs = STARTUP_RUNS) noexcept;
+};
+
+#endif
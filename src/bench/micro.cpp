@@ -0,0 +1,296 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "micro.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/pieces.h"
+
+//! Openings, middlegames and endgames, with promotions and castling.
+static const char* const CORPUS[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+  "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+};
+
+static constexpr unsigned int CORPUS_SIZE = sizeof(CORPUS) / sizeof(CORPUS[0]);
+
+//! Keeps the compiler from discarding benchmarked work.
+static volatile std::uint64_t s_sink = 0;
+
+/*!
+ *  @struct Case
+ *  @brief A benchmark: one pass over the corpus, returning the call count.
+ */
+struct Case {
+  std::string name;
+  std::function<std::uint64_t()> pass;
+};
+
+/*!
+ *  @struct Timing
+ *  @brief Nanoseconds per call of a case.
+ */
+struct Timing {
+  std::string name;
+  double median;
+  double p10;
+  double p90;
+  double min;
+};
+
+//! Warms the case up, then samples it.
+static Timing measure(const Case& benchCase) noexcept {
+  using Clock = std::chrono::steady_clock;
+
+  // Warm-up also calibrates how many passes fill a sample.
+  std::uint64_t passes = 0;
+  const Clock::time_point start = Clock::now();
+  std::chrono::duration<double, std::milli> warmup(0);
+  while (warmup.count() < MicroBench::WARMUP_MS) {
+    benchCase.pass();
+    ++passes;
+    warmup = Clock::now() - start;
+  }
+  const std::uint64_t perSample = std::max<std::uint64_t>(1,
+      passes * MicroBench::SAMPLE_MS / warmup.count());
+
+  std::vector<double> samples;
+  for (unsigned int i = 0; i < MicroBench::SAMPLES; ++i) {
+    std::uint64_t calls = 0;
+    const Clock::time_point sampleStart = Clock::now();
+    for (std::uint64_t pass = 0; pass < perSample; ++pass) {
+      calls += benchCase.pass();
+    }
+    const std::chrono::duration<double, std::nano> elapsed =
+        Clock::now() - sampleStart;
+    samples.push_back(elapsed.count() / calls);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  const unsigned int last = samples.size() - 1;
+  return {benchCase.name, samples[last / 2], samples[last / 10],
+          samples[last - last / 10], samples.front()};
+}
+
+//! Builds the cases over the loaded corpus.
+static std::vector<Case> makeCases(const std::vector<Board>& boards) {
+  // Moves and occupied squares of the side to move, per board.
+  std::vector<std::vector<Move>> moves;
+  std::vector<std::vector<BoardSquare>> squares;
+  for (const Board& board : boards) {
+    const std::list<Move>& valid = board.getValidMoves();
+    moves.emplace_back(valid.begin(), valid.end());
+    squares.emplace_back();
+    for (unsigned int i = 0; i < board.getPieceCount(); ++i) {
+      const BoardSquare sqr = board.getPieceSquare(i);
+      if (board.isWhite(sqr) == board.isWhitesMove()) {
+        squares.back().push_back(sqr);
+      }
+    }
+  }
+
+  std::vector<Case> cases;
+  cases.push_back({"Board::loadFen", []() {
+    for (const char* const fen : CORPUS) {
+      Board board;
+      board.loadFen(fen);
+      s_sink = s_sink + board.getKey();
+    }
+    return std::uint64_t(CORPUS_SIZE);
+  }});
+
+  cases.push_back({"Board::makeMove", [&boards, moves]() {
+    std::uint64_t calls = 0;
+    for (unsigned int i = 0; i < boards.size(); ++i) {
+      for (const Move& move : moves[i]) {
+        s_sink = s_sink + boards[i].makeMove(move).getKey();
+      }
+      calls += moves[i].size();
+    }
+    return calls;
+  }});
+
+  cases.push_back({"Board::getValidMoves", [&boards]() {
+    for (const Board& board : boards) {
+      s_sink = s_sink + board.getValidMoves().size();
+    }
+    return std::uint64_t(boards.size());
+  }});
+
+  cases.push_back({"Board::getValidMoves(sqr)", [&boards, squares]() {
+    std::uint64_t calls = 0;
+    for (unsigned int i = 0; i < boards.size(); ++i) {
+      for (const BoardSquare sqr : squares[i]) {
+        s_sink = s_sink + boards[i].getValidMoves(sqr).size();
+      }
+      calls += squares[i].size();
+    }
+    return calls;
+  }});
+
+  // Each piece generator on the squares holding that piece.
+  using Generator = std::list<Move> (*)(const Board&, const BoardSquare&);
+  const std::pair<const char*, Generator> generators[] = {
+    {"Pawn", Pawn::getValidMoves}, {"Knight", Knight::getValidMoves},
+    {"Bishop", Bishop::getValidMoves}, {"Rook", Rook::getValidMoves},
+    {"Queen", Queen::getValidMoves}, {"King", King::getValidMoves},
+  };
+  for (const auto& [name, generator] : generators) {
+    const char piece = name[0] == 'K' && name[1] == 'n'? 'N' : name[0];
+    std::vector<std::vector<BoardSquare>> own(boards.size());
+    for (unsigned int i = 0; i < boards.size(); ++i) {
+      for (const BoardSquare sqr : squares[i]) {
+        if (std::toupper(boards[i].getVal(sqr)) == piece) {
+          own[i].push_back(sqr);
+        }
+      }
+    }
+    cases.push_back({std::string(name) + "::getValidMoves",
+                     [&boards, own, generator = generator]() {
+      std::uint64_t calls = 0;
+      for (unsigned int i = 0; i < boards.size(); ++i) {
+        for (const BoardSquare sqr : own[i]) {
+          s_sink = s_sink + generator(boards[i], sqr).size();
+        }
+        calls += own[i].size();
+      }
+      return calls;
+    }});
+  }
+
+  cases.push_back({"Move::toString", [moves]() {
+    std::uint64_t calls = 0;
+    for (const std::vector<Move>& list : moves) {
+      for (const Move& move : list) {
+        s_sink = s_sink + move.toString().size();
+      }
+      calls += list.size();
+    }
+    return calls;
+  }});
+
+  return cases;
+}
+
+//! Formats a timing as a JSON object.
+static std::string toJson(const Timing& timing) {
+  std::ostringstream out;
+  out << "{\"name\":\"" << timing.name << "\",\"median_ns\":" << timing.median
+      << ",\"p10_ns\":" << timing.p10 << ",\"p90_ns\":" << timing.p90
+      << ",\"min_ns\":" << timing.min << '}';
+  return out.str();
+}
+
+//! Reads the medians of a results file, by case name.
+static std::map<std::string, double> readMedians(const std::string& path) {
+  std::map<std::string, double> medians;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    static const std::string NAME = "\"name\":\"";
+    static const std::string MEDIAN = "\"median_ns\":";
+    const std::size_t name = line.find(NAME);
+    const std::size_t median = line.find(MEDIAN);
+    if (name == std::string::npos || median == std::string::npos) {
+      continue;
+    }
+    const std::size_t begin = name + NAME.size();
+    medians[line.substr(begin, line.find('"', begin) - begin)] =
+        std::strtod(line.c_str() + median + MEDIAN.size(), nullptr);
+  }
+  return medians;
+}
+
+bool MicroBench::run(const std::string& output, const std::string& baseline,
+                     const double threshold) noexcept
+{
+  std::vector<Board> boards(CORPUS_SIZE);
+  for (unsigned int i = 0; i < CORPUS_SIZE; ++i) {
+    boards[i].loadFen(CORPUS[i]);
+  }
+
+  std::vector<Timing> timings;
+  for (const Case& benchCase : makeCases(boards)) {
+    timings.push_back(measure(benchCase));
+    const Timing& timing = timings.back();
+    char line[160];
+    std::snprintf(line, sizeof(line),
+                  "%-28s median %9.1f ns  p10 %9.1f  p90 %9.1f  min %9.1f",
+                  timing.name.c_str(), timing.median, timing.p10, timing.p90,
+                  timing.min);
+    Logger::info(line);
+  }
+
+  if (!output.empty()) {
+    std::ofstream file(output);
+    file << "{\"benchmarks\":[\n";
+    for (unsigned int i = 0; i < timings.size(); ++i) {
+      file << toJson(timings[i]) << (i + 1 < timings.size()? ",\n" : "\n");
+    }
+    file << "]}\n";
+    Logger::info("Results written to " + output);
+  }
+
+  if (baseline.empty()) {
+    return true;
+  }
+  const std::map<std::string, double>& medians = readMedians(baseline);
+  if (medians.empty()) {
+    Logger::info("No baseline in " + baseline + ", nothing to compare");
+    return true;
+  }
+
+  bool passed = true;
+  for (const Timing& timing : timings) {
+    const auto it = medians.find(timing.name);
+    if (it == medians.end() || it->second <= 0) {
+      continue;
+    }
+    const double change = (timing.median / it->second - 1.0) * 100.0;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-28s %+7.1f%% vs baseline%s",
+                  timing.name.c_str(), change,
+                  change > threshold? "  REGRESSION" : "");
+    Logger::info(line);
+    passed &= change <= threshold;
+  }
+  return passed;
+}
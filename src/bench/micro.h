@@ -0,0 +1,55 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MICRO__
+#define __MICRO__
+
+#include <string>
+
+/*!
+ *  @class MicroBench
+ *  @brief Microbenchmarks of the Board primitives.
+ *
+ *  Times loadFen, makeMove, the whole board and per square generators,
+ *  each piece generator and Move::toString over a fixed corpus. Every case
+ *  is warmed up, then sampled repeatedly; the median and percentiles of
+ *  the time per call are reported. Results are written as JSON, one case
+ *  per line, and can be checked against a baseline written the same way.
+ */
+class MicroBench {
+public:
+  static constexpr unsigned int SAMPLES = 31;         //!< Samples per case.
+  static constexpr unsigned int WARMUP_MS = 50;       //!< Warm-up per case.
+  static constexpr unsigned int SAMPLE_MS = 5;        //!< Length of a sample.
+  static constexpr double THRESHOLD = 10.0;           //!< Default, in percent.
+
+public:
+  /*!
+   *  @brief Runs all cases.
+   *
+   *  @param output JSON file for the results, none if empty.
+   *  @param baseline Previous results to compare with, none if empty or
+   *                  missing.
+   *  @param threshold Allowed slowdown of a median in percent.
+   *  @return False if a case regressed beyond the threshold.
+   */
+  static bool run(const std::string& output, const std::string& baseline,
+                  const double threshold = THRESHOLD) noexcept;
+};
+
+#endif
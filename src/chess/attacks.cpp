@@ -0,0 +1,393 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "attacks.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "move.h"
+#include "movelist.h"
+#include "tables.h"
+
+// update() walks the queens, rooks and bishops as one run of the piece list.
+static_assert(unsigned(Board::PieceType::Rook) ==
+                  unsigned(Board::PieceType::Queen) + 1 &&
+              unsigned(Board::PieceType::Bishop) ==
+                  unsigned(Board::PieceType::Rook) + 1,
+              "Sliders must be adjacent in the piece list");
+
+//! Mailbox offsets of the bishop rays.
+static constexpr int DIAGONALS[4] = {-11, -9, 9, 11};
+
+//! Mailbox offsets of the rook rays.
+static constexpr int ORTHOGONALS[4] = {-10, -1, 1, 10};
+
+//! Returns the squares a slider reaches along one ray, blocker included.
+static std::uint64_t walk(const Board& board, const BoardSquare sqr,
+                          const int step) noexcept
+{
+  std::uint64_t targets = 0;
+  BoardSquare target = sqr + step;
+  while (board.isEmpty(target)) {
+    targets |= AttackTables::bit(fromMailbox(target));
+    target += step;
+  }
+  if (board.isValid(target)) {
+    targets |= AttackTables::bit(fromMailbox(target));
+  }
+  return targets;
+}
+
+//! Returns the squares a slider reaches along the given rays.
+static std::uint64_t slide(const Board& board, const BoardSquare sqr,
+                           const int (&steps)[4]) noexcept
+{
+  std::uint64_t targets = 0;
+  for (const int step : steps) {
+    targets |= walk(board, sqr, step);
+  }
+  return targets;
+}
+
+//! Returns the targets of the piece on an occupied square.
+static std::uint64_t targetsOf(const Board& board,
+                               const BoardSquare sqr) noexcept
+{
+  const unsigned int square = fromMailbox(sqr);
+  switch (Board::typeOf(board.getVal(sqr))) {
+    case Board::PieceType::King:
+      return ATTACKS.kingMask[square];
+    case Board::PieceType::Queen:
+      return slide(board, sqr, DIAGONALS) | slide(board, sqr, ORTHOGONALS);
+    case Board::PieceType::Rook:
+      return slide(board, sqr, ORTHOGONALS);
+    case Board::PieceType::Bishop:
+      return slide(board, sqr, DIAGONALS);
+    case Board::PieceType::Knight:
+      return ATTACKS.knightMask[square];
+    default:
+      return ATTACKS.pawnMask[board.isWhite(sqr)][square];
+  }
+}
+
+AttackMap::AttackMap()
+  : m_targets()
+  , m_byType()
+  , m_count()
+{}
+
+AttackMap::AttackMap(const Board& board)
+  : AttackMap()
+{
+  compute(board);
+}
+
+void AttackMap::compute(const Board& board) noexcept {
+  std::memset(m_targets, 0, sizeof(m_targets));
+  std::memset(m_count, 0, sizeof(m_count));
+  for (unsigned int i = 0; i < board.getPieceCount(); ++i) {
+    const BoardSquare sqr = board.getPieceSquare(i);
+    const std::uint64_t targets = targetsOf(board, sqr);
+    m_targets[fromMailbox(sqr)] = targets;
+    addTargets(board.isWhite(sqr), targets);
+  }
+  for (unsigned int white = 0; white < 2; ++white) {
+    for (unsigned int t = 0; t < TYPES; ++t) {
+      refreshType(board, white, Board::PieceType(t));
+    }
+  }
+}
+
+void AttackMap::update(const Board& before, const Move& move,
+                       const Board& after) noexcept
+{
+  // The move changes its own squares and, when castling or capturing
+  // en-passant, the rook's or the captured pawn's.
+  BoardSquare squares[4] = {move.from, move.to};
+  unsigned int count = 2;
+  const Board::PieceType type = Board::typeOf(before.getVal(move.from));
+  const int diff = move.to - move.from;
+  if (type == Board::PieceType::King && (diff == 2 || diff == -2)) {
+    squares[count++] = move.from + (diff > 0? 3 : -4);
+    squares[count++] = move.to - 1 + (diff < 0) * 2;
+  } else if (type == Board::PieceType::Pawn && diff % int(Board::WIDTH) &&
+             before.isEmpty(move.to))
+  {
+    squares[count++] = move.to + (before.isWhitesMove()? 10 : -10);
+  }
+
+  // Bit per piece type whose set needs rebuilding, black first.
+  unsigned int types[2] = {0, 0};
+  std::uint64_t changed = 0;
+  std::uint64_t occupancy = 0;
+  for (unsigned int i = 0; i < count; ++i) {
+    const BoardSquare sqr = squares[i];
+    const unsigned int square = fromMailbox(sqr);
+    if (!before.isEmpty(sqr)) {
+      removeTargets(before.isWhite(sqr), m_targets[square]);
+      types[before.isWhite(sqr)] |=
+          1u << unsigned(Board::typeOf(before.getVal(sqr)));
+    }
+    m_targets[square] = after.isEmpty(sqr)? 0 : targetsOf(after, sqr);
+    if (!after.isEmpty(sqr)) {
+      addTargets(after.isWhite(sqr), m_targets[square]);
+      types[after.isWhite(sqr)] |=
+          1u << unsigned(Board::typeOf(after.getVal(sqr)));
+    }
+    changed |= AttackTables::bit(square);
+    if (before.isEmpty(sqr) != after.isEmpty(sqr)) {
+      occupancy |= AttackTables::bit(square);
+    }
+  }
+
+  // A slider elsewhere only changes if it reached a square that was
+  // emptied (its blocker) or filled (one it went through), and then only
+  // along the rays through those squares.
+  for (unsigned int white = 0; white < 2; ++white) {
+    const BoardSquare* const pieces =
+        after.getPieces(white, Board::PieceType::Queen);
+    const unsigned int sliders =
+        after.getPieceCount(white, Board::PieceType::Queen) +
+        after.getPieceCount(white, Board::PieceType::Rook) +
+        after.getPieceCount(white, Board::PieceType::Bishop);
+    for (unsigned int i = 0; i < sliders; ++i) {
+      const unsigned int square = fromMailbox(pieces[i]);
+      const std::uint64_t old = m_targets[square];
+      std::uint64_t hit = old & occupancy;
+      if (!hit || (changed & AttackTables::bit(square))) {
+        continue;
+      }
+      std::uint64_t targets = old;
+      for (; hit; hit &= hit - 1) {
+        const unsigned int through = __builtin_ctzll(hit);
+        targets = (targets & ~ATTACKS.ray[square][through]) |
+                  walk(after, pieces[i], ATTACKS.direction[square][through]);
+      }
+      removeTargets(white, old & ~targets);
+      addTargets(white, targets & ~old);
+      m_targets[square] = targets;
+      types[white] |= 1u << unsigned(Board::typeOf(after.getVal(pieces[i])));
+    }
+  }
+  for (unsigned int white = 0; white < 2; ++white) {
+    for (unsigned int t = 0; t < TYPES; ++t) {
+      if (types[white] >> t & 1) {
+        refreshType(after, white, Board::PieceType(t));
+      }
+    }
+  }
+}
+
+bool AttackMap::operator==(const AttackMap& other) const noexcept {
+  return !std::memcmp(m_targets, other.m_targets, sizeof(m_targets)) &&
+         !std::memcmp(m_byType, other.m_byType, sizeof(m_byType)) &&
+         !std::memcmp(m_count, other.m_count, sizeof(m_count));
+}
+
+void AttackMap::addTargets(const bool white, std::uint64_t targets) noexcept {
+  for (; targets; targets &= targets - 1) {
+    ++m_count[white][__builtin_ctzll(targets)];
+  }
+}
+
+void AttackMap::removeTargets(const bool white,
+                              std::uint64_t targets) noexcept
+{
+  for (; targets; targets &= targets - 1) {
+    --m_count[white][__builtin_ctzll(targets)];
+  }
+}
+
+void AttackMap::refreshType(const Board& board, const bool white,
+                            const Board::PieceType type) noexcept
+{
+  const BoardSquare* const pieces = board.getPieces(white, type);
+  std::uint64_t attacks = 0;
+  for (unsigned int i = 0; i < board.getPieceCount(white, type); ++i) {
+    attacks |= m_targets[fromMailbox(pieces[i])];
+  }
+  m_byType[white][unsigned(type)] = attacks;
+}
+
+void AttackMap::benchmark() noexcept {
+  static const char* const STARTS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  };
+
+  // Random games, kept as the moves and the positions around them.
+  std::mt19937 rng(42);
+  std::vector<Board> boards;
+  std::vector<Move> moves;
+  for (unsigned int game = 0; game < 400; ++game) {
+    Board board;
+    board.loadFen(STARTS[game % std::size(STARTS)]);
+    for (unsigned int ply = 0; ply < 120; ++ply) {
+      const std::list<Move>& legal = board.getLegalMoves();
+      if (legal.empty()) {
+        break;
+      }
+      auto it = legal.begin();
+      std::advance(it, rng() % legal.size());
+      boards.push_back(board);
+      moves.push_back(*it);
+      board = board.makeMove(*it);
+    }
+    boards.push_back(board);
+    moves.emplace_back();
+  }
+
+  // Every update along the games must match the map built from scratch.
+  // Updates then run along the games too, so the previous map stays in
+  // cache as it would in a search.
+  unsigned int failures = 0;
+  std::vector<AttackMap> starts;
+  AttackMap map;
+  for (std::size_t i = 0; i < boards.size(); ++i) {
+    if (!i || moves[i - 1].from == moves[i - 1].to) {
+      starts.emplace_back(boards[i]);
+      map = starts.back();
+      continue;
+    }
+    boards[i - 1].makeMove(moves[i - 1], map);
+    failures += !(map == AttackMap(boards[i]));
+    for (unsigned int sqr = 0; sqr < 64; ++sqr) {
+      for (const bool white : {false, true}) {
+        failures += map.isAttacked(toMailbox(sqr), white) !=
+                    boards[i].isAttacked(toMailbox(sqr), white);
+      }
+    }
+  }
+
+  // Board::getLegalMoves() settles most moves with the map, so it must
+  // agree with making every pseudo-legal move.
+  for (const Board& board : boards) {
+    MoveList valid;
+    MoveList legal;
+    board.getValidMoves(valid);
+    board.getLegalMoves(legal);
+    unsigned int kept = 0;
+    for (const Move& move : valid) {
+      if (board.makeMove(move).isLegal()) {
+        failures += kept >= legal.size() || !(legal[kept] == move);
+        ++kept;
+      }
+    }
+    failures += kept != legal.size();
+  }
+
+  constexpr unsigned int ROUNDS = 20;
+  std::uint64_t checksum = 0;
+  std::size_t updates = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    std::size_t game = 0;
+    for (std::size_t i = 0; i + 1 < boards.size(); ++i) {
+      if (!i || moves[i - 1].from == moves[i - 1].to) {
+        map = starts[game++];
+      }
+      if (moves[i].from != moves[i].to) {
+        map.update(boards[i], moves[i], boards[i + 1]);
+        checksum += map.getAttacks(true);
+        ++updates;
+      }
+    }
+  }
+  const std::chrono::duration<double, std::nano> incremental =
+      std::chrono::steady_clock::now() - begin;
+
+  begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    for (std::size_t i = 0; i + 1 < boards.size(); ++i) {
+      if (moves[i].from != moves[i].to) {
+        map.compute(boards[i + 1]);
+        checksum += map.getAttacks(true);
+      }
+    }
+  }
+  const std::chrono::duration<double, std::nano> full =
+      std::chrono::steady_clock::now() - begin;
+
+  begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    for (std::size_t i = 0; i + 1 < boards.size(); ++i) {
+      if (moves[i].from != moves[i].to) {
+        checksum += boards[i].makeMove(moves[i]).getKey();
+      }
+    }
+  }
+  const std::chrono::duration<double, std::nano> makeMove =
+      std::chrono::steady_clock::now() - begin;
+
+  std::size_t generated = 0;
+  begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    for (const Board& board : boards) {
+      MoveList legal;
+      board.getValidMoves(legal);
+      unsigned int kept = 0;
+      for (const Move& move : legal) {
+        if (board.makeMove(move).isLegal()) {
+          legal[kept++] = move;
+        }
+      }
+      legal.resize(kept);
+      generated += legal.size();
+    }
+  }
+  const std::chrono::duration<double, std::nano> madeLegal =
+      std::chrono::steady_clock::now() - begin;
+
+  begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    for (const Board& board : boards) {
+      MoveList legal;
+      board.getLegalMoves(legal);
+      generated += legal.size();
+    }
+  }
+  const std::chrono::duration<double, std::nano> mappedLegal =
+      std::chrono::steady_clock::now() - begin;
+
+  Logger::info("Moves: " + std::to_string(updates / ROUNDS) +
+               ", map bytes: " + std::to_string(sizeof(AttackMap)) +
+               ", failures: " + std::to_string(failures));
+  Logger::info("Incremental update: " +
+               std::to_string(incremental.count() / updates) + " ns");
+  Logger::info("Full recomputation: " +
+               std::to_string(full.count() / updates) + " ns");
+  Logger::info("Board::makeMove alone: " +
+               std::to_string(makeMove.count() / updates) + " ns (checksum " +
+               std::to_string(checksum % 1000) + ")");
+  const double positions = double(boards.size()) * ROUNDS;
+  Logger::info("Legal moves by making each: " +
+               std::to_string(madeLegal.count() / positions) + " ns");
+  Logger::info("Legal moves with the map: " +
+               std::to_string(mappedLegal.count() / positions) +
+               " ns (" + std::to_string(generated % 1000) + ")");
+}
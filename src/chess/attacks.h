@@ -0,0 +1,131 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ATTACKS__
+#define __ATTACKS__
+
+#include <cstdint>
+
+#include "board.h"
+#include "chess.h"
+
+class Move;
+
+/*!
+ *  @class AttackMap
+ *  @brief Squares attacked by each side, kept up to date move by move.
+ *
+ *  Holds the targets of the piece on every square, the number of pieces of
+ *  each side attacking every square and, per side and piece type, the set
+ *  of attacked squares. Sets use 0..63 squares (a8 = 0) as bits, while the
+ *  square arguments are mailbox squares, like everywhere in Board.
+ *
+ *  update() only recomputes the pieces on the squares the move changes
+ *  and, for sliders elsewhere, the rays that went through a square that
+ *  was emptied or filled; everything else keeps its targets. The map lives
+ *  beside the board rather than inside it, so the copy-make of Board stays
+ *  four cache lines for callers that do not need it.
+ */
+class AttackMap {
+  static constexpr unsigned int TYPES = unsigned(Board::PieceType::Count);
+
+  std::uint64_t m_targets[64];      //!< Targets of the piece on each square.
+  std::uint64_t m_byType[2][TYPES]; //!< Attacked squares, black first.
+  unsigned char m_count[2][64];     //!< Attackers of each square.
+
+public:
+  //! Creates the map of an empty board.
+  AttackMap();
+
+  //! Creates the map of the given board.
+  explicit AttackMap(const Board& board);
+
+public:
+  //! Recomputes the whole map for the given board.
+  void compute(const Board& board) noexcept;
+
+  /*!
+   *  @brief Brings the map of 'before' up to date with 'after'.
+   *
+   *  @param before Board the map currently describes.
+   *  @param move Move made on 'before'.
+   *  @param after Result of before.makeMove(move).
+   */
+  void update(const Board& before, const Move& move,
+              const Board& after) noexcept;
+
+  //! Returns the number of pieces of the given side attacking the square.
+  unsigned int getCount(const BoardSquare& sqr,
+                        const bool byWhite) const noexcept
+  {
+    return m_count[byWhite][fromMailbox(sqr)];
+  }
+
+  //! Returns true if a piece of the given side attacks the square.
+  bool isAttacked(const BoardSquare& sqr, const bool byWhite) const noexcept {
+    return getCount(sqr, byWhite);
+  }
+
+  //! Returns the targets of the piece on the square, none if it is empty.
+  std::uint64_t getTargets(const BoardSquare& sqr) const noexcept {
+    return m_targets[fromMailbox(sqr)];
+  }
+
+  //! Returns the squares attacked by the given side's pieces of one type.
+  std::uint64_t getAttacks(const bool white,
+                           const Board::PieceType type) const noexcept
+  {
+    return m_byType[white][unsigned(type)];
+  }
+
+  //! Returns the squares attacked by the given side.
+  std::uint64_t getAttacks(const bool white) const noexcept {
+    std::uint64_t attacks = 0;
+    for (const std::uint64_t set : m_byType[white]) {
+      attacks |= set;
+    }
+    return attacks;
+  }
+
+  //! Returns true if both maps hold exactly the same state.
+  bool operator==(const AttackMap& other) const noexcept;
+
+  /*!
+   *  @brief Checks and times incremental updates against recomputation.
+   *
+   *  Plays random games, checks every incrementally updated map against
+   *  one computed from scratch and against Board::isAttacked, and the
+   *  moves of Board::getLegalMoves against making every pseudo-legal one.
+   *  Then logs the cost of both ways of getting the map of the next
+   *  position and of both ways of getting the legal moves.
+   */
+  static void benchmark() noexcept;
+
+private:
+  //! Adds a piece's targets to the counts of its side.
+  void addTargets(const bool white, std::uint64_t targets) noexcept;
+
+  //! Removes a piece's targets from the counts of its side.
+  void removeTargets(const bool white, std::uint64_t targets) noexcept;
+
+  //! Rebuilds the set of one side and type from its pieces' targets.
+  void refreshType(const Board& board, const bool white,
+                   const Board::PieceType type) noexcept;
+};
+
+#endif
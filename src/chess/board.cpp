@@ -21,19 +21,33 @@
 #include "../cpp-logger/logger.h"
 
 #include <cassert>
+#include <cstring>
 #include <list>
 #include <iostream>
 #include <string>
 
+#include "attacks.h"
 #include "chess.h"
 #include "pieces.h"
 #include "move.h"
+#include "movelist.h"
+#include "tables.h"
+#include "zobrist.h"
 
 //! Offset to skip outline squares.
 static constexpr unsigned int OFFSET = 2 * Board::WIDTH + 1;
 
+static_assert(sizeof(Board) == 4 * 64, "A board copy should fill 4 lines");
+
 Board::Board()
-  : m_board{'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', //
+  : m_key(0)
+  , m_materialKey(0)
+  , m_flags{0, 1, 0, 0}
+  , m_enPass(0)
+  , m_ends{}
+  , m_list{}
+  , m_index{}
+  , m_board{'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', //
             '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', //
             '?', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '?', // 8
             '?', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '?', // 7
@@ -46,9 +60,6 @@ Board::Board()
             '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', //
             '?', '?', '?', '?', '?', '?', '?', '?', '?', '?'} //
           //      A    B    C    D    E    F    G    H        //
-  , m_pieces{ 0 }
-  , m_enPass(0)
-  , m_flags{0, 0, 1, 0, 0}
 {}
 
 void Board::loadFen(const std::string& fen) noexcept {
@@ -62,6 +73,7 @@ void Board::loadFen(const std::string& fen) noexcept {
       m_flags.m_castleInfo = 0b1111;
       m_flags.m_halfMoves = 0;
       m_flags.m_fullMoves = 1;
+      m_key = computeKey();
       return;
     }
 
@@ -69,77 +81,428 @@ void Board::loadFen(const std::string& fen) noexcept {
     loadCastles(++i, fen);
     loadEnPass(++i, fen);
     loadMoves(++i, fen);
+    m_key = computeKey();
   } catch (const FenException& e) {
     Logger::error(e.what());
     exit(1);
   }
 }
 
-std::list<Move> Board::getValidMoves(const BoardSquare& sqr) const noexcept {
-  const char val = m_board[sqr];
-  std::list<Move> moves;
-  switch(val) {
+bool Board::isFenValid(const std::string& fen) noexcept {
+  std::size_t i = 0;
+  unsigned int rank = 0;
+  unsigned int file = 0;
+  unsigned int kings[2] = {0, 0};
+  unsigned int pieces[2] = {0, 0};
+  for (; i < fen.size() && fen[i] != ' '; ++i) {
+    const char c = fen[i];
+    if (c == '/') {
+      if (file != 8 || ++rank > 7) {
+        return false;
+      }
+      file = 0;
+    } else if (c >= '1' && c <= '8') {
+      file += c - '0';
+    } else if (std::strchr("pnbrqkPNBRQK", c)) {
+      const bool white = c < 'a';
+      if ((c == 'p' || c == 'P') && (rank == 0 || rank == 7)) {
+        return false;
+      }
+      kings[white] += c == 'k' || c == 'K';
+      ++pieces[white];
+      ++file;
+    } else {
+      return false;
+    }
+    if (file > 8) {
+      return false;
+    }
+  }
+  if (rank != 7 || file != 8 || kings[0] != 1 || kings[1] != 1 ||
+      pieces[0] > 16 || pieces[1] > 16)
+  {
+    return false;
+  }
+
+  // Side to move.
+  if (i + 2 >= fen.size() || (fen[i + 1] != 'w' && fen[i + 1] != 'b') ||
+      fen[i + 2] != ' ')
+  {
+    return false;
+  }
+  i += 3;
+
+  // Castling rights.
+  const std::size_t castles = i;
+  while (i < fen.size() && fen[i] != ' ') {
+    if (!std::strchr("KQkq-", fen[i])) {
+      return false;
+    }
+    ++i;
+  }
+  if (i == castles || i == fen.size()) {
+    return false;
+  }
+  ++i;
+
+  // En-passant square.
+  if (i < fen.size() && fen[i] == '-') {
+    ++i;
+  } else if (i + 1 < fen.size() && fen[i] >= 'a' && fen[i] <= 'h' &&
+             (fen[i + 1] == '3' || fen[i + 1] == '6'))
+  {
+    i += 2;
+  } else {
+    return false;
+  }
+
+  // Half and full move counters.
+  for (unsigned int field = 0; field < 2; ++field) {
+    if (i == fen.size() || fen[i] != ' ') {
+      return false;
+    }
+    const std::size_t digits = ++i;
+    while (i < fen.size() && fen[i] >= '0' && fen[i] <= '9') {
+      ++i;
+    }
+    if (i == digits || i - digits > 4) {
+      return false;
+    }
+  }
+  return i == fen.size();
+}
+
+std::string Board::getFen() const noexcept {
+  std::string fen;
+  for (unsigned int i = 0; i < 8; ++i) {
+    unsigned int empty = 0;
+    for (unsigned int j = 0; j < 8; ++j) {
+      const char val = m_board[OFFSET + i * WIDTH + j];
+      if (val == ' ') {
+        ++empty;
+        continue;
+      }
+      if (empty) {
+        fen.push_back('0' + empty);
+        empty = 0;
+      }
+      fen.push_back(val);
+    }
+    if (empty) {
+      fen.push_back('0' + empty);
+    }
+    if (i != 7) {
+      fen.push_back('/');
+    }
+  }
+
+  fen += m_flags.m_isWhitesMove? " w " : " b ";
+  if (!m_flags.m_castleInfo) {
+    fen.push_back('-');
+  }
+  if (canWhiteShortCastle()) {
+    fen.push_back('K');
+  }
+  if (canWhiteLongCastle()) {
+    fen.push_back('Q');
+  }
+  if (canBlackShortCastle()) {
+    fen.push_back('k');
+  }
+  if (canBlackLongCastle()) {
+    fen.push_back('q');
+  }
+
+  if (m_enPass) {
+    fen.push_back(' ');
+    fen.push_back('a' + m_enPass % WIDTH - 1);
+    fen.push_back('8' - (m_enPass / WIDTH - 2));
+  } else {
+    fen += " -";
+  }
+
+  fen += " " + std::to_string(m_flags.m_halfMoves) +
+         " " + std::to_string(m_flags.m_fullMoves);
+  return fen;
+}
+
+std::uint64_t Board::computeKey() const noexcept {
+  std::uint64_t key = ZOBRIST.castle[m_flags.m_castleInfo];
+  for (unsigned int i = 0; i < getPieceCount(); ++i) {
+    const BoardSquare sqr = getPieceSquare(i);
+    key ^= ZOBRIST.piece(m_board[sqr], fromMailbox(sqr));
+  }
+  if (m_enPass) {
+    key ^= ZOBRIST.enPass[m_enPass % WIDTH - 1];
+  }
+  if (!m_flags.m_isWhitesMove) {
+    key ^= ZOBRIST.side;
+  }
+  return key;
+}
+
+//! White notation of every PieceType.
+static constexpr char PIECE_NOTATIONS[] = "KQRBNP";
+
+std::uint64_t Board::computeMaterialKey() const noexcept {
+  std::uint64_t key = 0;
+  for (unsigned int side = 0; side < 2; ++side) {
+    for (unsigned int t = 0; t < TYPES; ++t) {
+      const char piece = PIECE_NOTATIONS[t] | (side? 0 : 0x20);
+      for (unsigned int i = 0; i < getPieceCount(side, PieceType(t)); ++i) {
+        key ^= ZOBRIST.material[ZobristKeys::pieceIndex(piece)][i];
+      }
+    }
+  }
+  return key;
+}
+
+bool Board::operator==(const Board& other) const noexcept {
+  if (m_key != other.m_key ||
+      m_flags.m_castleInfo != other.m_flags.m_castleInfo ||
+      m_flags.m_isWhitesMove != other.m_flags.m_isWhitesMove ||
+      m_flags.m_halfMoves != other.m_flags.m_halfMoves ||
+      m_flags.m_fullMoves != other.m_flags.m_fullMoves ||
+      m_enPass != other.m_enPass)
+  {
+    return false;
+  }
+  for (unsigned int side = 0; side < 2; ++side) {
+    for (unsigned int t = 0; t < TYPES; ++t) {
+      if (m_ends[side][t] != other.m_ends[side][t]) {
+        return false;
+      }
+    }
+    for (unsigned int i = 0; i < m_ends[side][TYPES - 1]; ++i) {
+      if (m_list[side][i] != other.m_list[side][i]) {
+        return false;
+      }
+    }
+  }
+  for (unsigned int i = 0; i < WIDTH * HEIGHT; ++i) {
+    if (m_board[i] != other.m_board[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Board::getValidMoves(const BoardSquare& sqr,
+                          MoveList& r_moves) const noexcept
+{
+  switch(m_board[sqr]) {
     case 'P':
     case 'p':
-      moves.splice(moves.end(), Pawn::getValidMoves(*this, sqr));
+      Pawn::addValidMoves(*this, sqr, r_moves);
       break;
     case 'N':
     case 'n':
-      moves.splice(moves.end(), Knight::getValidMoves(*this, sqr));
+      Knight::addValidMoves(*this, sqr, r_moves);
       break;
     case 'B':
     case 'b':
-      moves.splice(moves.end(), Bishop::getValidMoves(*this, sqr));
+      Bishop::addValidMoves(*this, sqr, r_moves);
       break;
     case 'R':
     case 'r':
-      moves.splice(moves.end(), Rook::getValidMoves(*this, sqr));
+      Rook::addValidMoves(*this, sqr, r_moves);
       break;
     case 'Q':
     case 'q':
-      moves.splice(moves.end(), Queen::getValidMoves(*this, sqr));
+      Queen::addValidMoves(*this, sqr, r_moves);
       break;
     case 'K':
     case 'k':
-      moves.splice(moves.end(), King::getValidMoves(*this, sqr));
+      King::addValidMoves(*this, sqr, r_moves);
       break;
   }
+}
+
+void Board::getValidMoves(MoveList& r_moves) const noexcept {
+  const bool white = m_flags.m_isWhitesMove;
+  for (unsigned int i = 0; i < m_ends[white][TYPES - 1]; ++i) {
+    getValidMoves(m_list[white][i], r_moves);
+  }
+}
+
+void Board::getLegalMoves(MoveList& r_moves) const noexcept {
+  const unsigned int first = r_moves.size();
+  getValidMoves(r_moves);
+
+  // Out of check, a king move is legal if its target is not attacked, and
+  // another move can only expose the king if its piece stands on a line
+  // through the king and is attacked by an enemy slider. Only those moves,
+  // en-passant captures and every move when in check are made to be sure.
+  const bool white = m_flags.m_isWhitesMove;
+  const BoardSquare king = getKingSquare(white);
+  const AttackMap attacks(*this);
+  const bool inCheck = !king || attacks.isAttacked(king, !white);
+  const std::uint64_t sliders =
+      attacks.getAttacks(!white, PieceType::Queen) |
+      attacks.getAttacks(!white, PieceType::Rook) |
+      attacks.getAttacks(!white, PieceType::Bishop);
+  const unsigned int kingSquare = fromMailbox(king);
+  unsigned int kept = first;
+  for (unsigned int i = first; i < r_moves.size(); ++i) {
+    const Move& move = r_moves[i];
+    bool legal;
+    if (inCheck) {
+      legal = makeMove(move).isLegal();
+    } else if (move.from == king) {
+      legal = !attacks.isAttacked(move.to, !white);
+    } else {
+      const unsigned int from = fromMailbox(move.from);
+      const bool enPassant = typeOf(m_board[move.from]) == PieceType::Pawn &&
+                             (move.to - move.from) % int(WIDTH) &&
+                             isEmpty(move.to);
+      const bool pinnable = (sliders & AttackTables::bit(from)) &&
+                            ATTACKS.line[kingSquare][from];
+      legal = (!enPassant && !pinnable) || makeMove(move).isLegal();
+    }
+    if (legal) {
+      r_moves[kept++] = move;
+    }
+  }
+  r_moves.resize(kept);
+}
 
-  return moves;
+std::list<Move> Board::getValidMoves(const BoardSquare& sqr) const noexcept {
+  MoveList moves;
+  getValidMoves(sqr, moves);
+  return std::list<Move>(moves.begin(), moves.end());
 }
 
 std::list<Move> Board::getValidMoves() const noexcept {
-  std::string msg;
-  for (int i = 0; i < m_flags.m_pieceCount; ++i) {
-    msg += std::to_string(int(m_pieces[i])) + ", ";
-  }
-  msg.pop_back();
-  msg.pop_back();
-  Logger::debug("Pieces: " + msg);
-  std::list<Move> moves;
-  for (int i = 0; i < m_flags.m_pieceCount; ++i) {
-    const BoardSquare& sqr = m_pieces[i];
-    if (!isValid(sqr)) {
-      break;
+  MoveList moves;
+  getValidMoves(moves);
+  return std::list<Move>(moves.begin(), moves.end());
+}
+
+std::list<Move> Board::getLegalMoves() const noexcept {
+  MoveList moves;
+  getLegalMoves(moves);
+  return std::list<Move>(moves.begin(), moves.end());
+}
+
+bool Board::isAttacked(const BoardSquare& sqr,
+                       const bool byWhite) const noexcept
+{
+  // Attacker notation is uppercase for white and lowercase for black.
+  const char caseBit = byWhite? 0 : 0b00100000;
+
+  // White pawns attack towards the 8th rank, so look one row below.
+  const int pawnRow = byWhite? WIDTH : -int(WIDTH);
+  if (m_board[sqr + pawnRow - 1] == ('P' | caseBit) ||
+      m_board[sqr + pawnRow + 1] == ('P' | caseBit))
+  {
+    return true;
+  }
+
+  const unsigned int square = fromMailbox(sqr);
+  for (unsigned int i = 0; i < ATTACKS.knightCount[square]; ++i) {
+    if (m_board[ATTACKS.knight[square][i]] == ('N' | caseBit)) {
+      return true;
+    }
+  }
+  for (unsigned int i = 0; i < ATTACKS.kingCount[square]; ++i) {
+    if (m_board[ATTACKS.king[square][i]] == ('K' | caseBit)) {
+      return true;
     }
+  }
 
-    if (isWhite(sqr) == m_flags.m_isWhitesMove) {
-      moves.splice(moves.end(), getValidMoves(sqr));
+  // Sliders: the first piece along each ray decides.
+  for (int i = 0; i < 8; ++i) {
+    const int step = AttackTables::KING_STEPS[i];
+    const bool diagonal = (i == 0 || i == 2 || i == 5 || i == 7);
+    const char slider = (diagonal? 'B' : 'R') | caseBit;
+    int target = sqr + step;
+    while (m_board[target] == ' ') {
+      target += step;
+    }
+    if (m_board[target] == slider || m_board[target] == ('Q' | caseBit)) {
+      return true;
     }
   }
 
-  return moves;
+  return false;
 }
 
-void Board::removePiece(const BoardSquare& sqr) noexcept {
-  for (int i = 0; i < m_flags.m_pieceCount; ++i) {
-    if (m_pieces[i] == sqr) {
-      m_pieces[i] = 0;
-      m_board[sqr] = ' ';
-      --m_flags.m_pieceCount;
-      std::swap(m_pieces[i], m_pieces[m_flags.m_pieceCount]);
-      return;
+void Board::addPiece(const BoardSquare sqr, const char piece) noexcept {
+  const bool white = !(piece & 0b00100000);
+  const unsigned int type = unsigned(typeOf(piece));
+  unsigned char* const ends = m_ends[white];
+  BoardSquare* const list = m_list[white];
+  assert(ends[TYPES - 1] < MAX_SIDE_PIECES && "Too many pieces");
+
+  // Each later group hands its first slot over to the group before it.
+  for (unsigned int t = TYPES - 1; t > type; --t) {
+    if (ends[t] != ends[t - 1]) {
+      const BoardSquare moved = list[ends[t - 1]];
+      list[ends[t]] = moved;
+      m_index[fromMailbox(moved)] = ends[t];
     }
+    ++ends[t];
+  }
+  const unsigned int count = ends[type] - (type? ends[type - 1] : 0);
+  const unsigned int square = fromMailbox(sqr);
+  list[ends[type]] = sqr;
+  m_index[square] = ends[type];
+  ++ends[type];
+
+  m_board[sqr] = piece;
+  m_key ^= ZOBRIST.piece(piece, square);
+  m_materialKey ^= ZOBRIST.material[ZobristKeys::pieceIndex(piece)][count];
+}
+
+void Board::removePiece(const BoardSquare sqr) noexcept {
+  const char piece = m_board[sqr];
+  const bool white = !(piece & 0b00100000);
+  const unsigned int type = unsigned(typeOf(piece));
+  unsigned char* const ends = m_ends[white];
+  BoardSquare* const list = m_list[white];
+  const unsigned int square = fromMailbox(sqr);
+  const unsigned int count = ends[type] - (type? ends[type - 1] : 0) - 1;
+
+  // The group's last piece fills the hole, which then moves group by group
+  // to the end of the list.
+  unsigned int hole = m_index[square];
+  for (unsigned int t = type; t < TYPES; ++t) {
+    const unsigned int last = --ends[t];
+    if (last != hole) {
+      const BoardSquare moved = list[last];
+      list[hole] = moved;
+      m_index[fromMailbox(moved)] = hole;
+    }
+    hole = last;
+  }
+
+  m_key ^= ZOBRIST.piece(piece, square);
+  m_materialKey ^= ZOBRIST.material[ZobristKeys::pieceIndex(piece)][count];
+  m_board[sqr] = ' ';
+}
+
+void Board::movePiece(const BoardSquare from, const BoardSquare to) noexcept {
+  const char piece = m_board[from];
+  const unsigned int source = fromMailbox(from);
+  const unsigned int target = fromMailbox(to);
+  const unsigned char slot = m_index[source];
+  m_list[!(piece & 0b00100000)][slot] = to;
+  m_index[target] = slot;
+  m_key ^= ZOBRIST.piece(piece, source) ^ ZOBRIST.piece(piece, target);
+  m_board[to] = piece;
+  m_board[from] = ' ';
+}
+
+//! Castling rights kept when a piece leaves or lands on the square.
+static constexpr unsigned int castleMask(const BoardSquare sqr) {
+  switch (sqr) {
+    case 21: return 0b1101; // a8
+    case 25: return 0b1100; // e8
+    case 28: return 0b1110; // h8
+    case 91: return 0b0111; // a1
+    case 95: return 0b0011; // e1
+    case 98: return 0b1011; // h1
+    default: return 0b1111;
   }
 }
 
@@ -147,33 +510,73 @@ Board Board::makeMove(const Move& move) const noexcept {
   Board board(*this);
   assert(isValid(move.to) && "Making an invalid move");
 
+  const int diff = move.to - move.from;
+  const char piece = m_board[move.from];
+  const char placed = move.isPromotion()? move.promotion : piece;
+  bool isReversible = !isPawn(move.from);
+
+  if (m_enPass) {
+    board.m_key ^= ZOBRIST.enPass[m_enPass % WIDTH - 1];
+  }
+  board.m_enPass = 0;
   if (!board.isEmpty(move.to))
   {
     board.removePiece(move.to);
-  } else if (move.to == m_enPass) {
+    isReversible = false;
+  } else if (isPawn(move.from) && move.to == m_enPass) {
     const BoardSquare& enemyPawnSqr = move.to + (m_flags.m_isWhitesMove? WIDTH : -WIDTH);
     board.removePiece(enemyPawnSqr);
-    board.m_enPass = 0;
   } else if (isKing(move.from)) {
-    const int diff = move.to - move.from;
-    if (std::abs(diff) >= 2) {
+    if (std::abs(diff) == 2) {
       const BoardSquare& rookPos = move.from + ((diff > 0)? 3 : -4);
       const BoardSquare& newRookPos = move.to - 1 + (diff < 0) * 2;
-      for (int i = 0; i < m_flags.m_pieceCount; ++i) {
-        if (m_pieces[i] == rookPos) {
-          board.m_pieces[i] = newRookPos;
-          break;
-        }
-      }
-      std::swap(board.m_board[newRookPos], board.m_board[rookPos]);
+      board.movePiece(rookPos, newRookPos);
     }
-  } else if (isPawn(move.from) && (move.from / 10 == (m_flags.m_isWhitesMove? 8 : 3))) {
-    board.m_enPass = move.to + (m_flags.m_isWhitesMove? WIDTH : -WIDTH);
+  } else if (isPawn(move.from) && std::abs(diff) == int(2 * WIDTH)) {
+    board.m_enPass = move.from + diff / 2;
+    board.m_key ^= ZOBRIST.enPass[board.m_enPass % WIDTH - 1];
   }
 
-  board.m_board[move.to] = m_board[move.from];
-  board.m_board[move.from] = ' ';
+  board.m_flags.m_castleInfo &= castleMask(move.from) & castleMask(move.to);
+  board.m_key ^= ZOBRIST.castle[m_flags.m_castleInfo] ^
+                 ZOBRIST.castle[board.m_flags.m_castleInfo];
+  if (placed == piece) {
+    board.movePiece(move.from, move.to);
+  } else {
+    board.removePiece(move.from);
+    board.addPiece(move.to, placed);
+  }
+
+  // The 7-bit halfmove clock saturates, which is past any fifty-move claim.
+  if (!isReversible) {
+    board.m_flags.m_halfMoves = 0;
+  } else if (board.m_flags.m_halfMoves < 127) {
+    ++board.m_flags.m_halfMoves;
+  }
+  if (!m_flags.m_isWhitesMove) {
+    ++board.m_flags.m_fullMoves;
+  }
+  board.m_flags.m_isWhitesMove ^= 1;
+  board.m_key ^= ZOBRIST.side;
+  return board;
+}
+
+Board Board::makeMove(const Move& move, AttackMap& r_attacks) const noexcept
+{
+  const Board board = makeMove(move);
+  r_attacks.update(*this, move, board);
+  return board;
+}
+
+Board Board::makeNullMove() const noexcept {
+  Board board(*this);
+  if (m_enPass) {
+    board.m_key ^= ZOBRIST.enPass[m_enPass % WIDTH - 1];
+    board.m_enPass = 0;
+  }
+  board.m_flags.m_halfMoves = 0;
   board.m_flags.m_isWhitesMove ^= 1;
+  board.m_key ^= ZOBRIST.side;
   return board;
 }
 
@@ -251,9 +654,7 @@ unsigned int Board::place(const std::string& fen) {
       case 'k':
       case 'K': {
         const BoardSquare& sqr = OFFSET + i * WIDTH + j;
-        m_board[sqr] = val;
-        m_pieces[m_flags.m_pieceCount] = sqr;
-        ++m_flags.m_pieceCount;
+        addPiece(sqr, val);
         const char chessField[3] = {char('a' + j), char('8' - i), '\0'};
         const std::string& msg = "Placing " + std::string(1, val) +
                                  " on: " + chessField;
@@ -268,7 +669,7 @@ unsigned int Board::place(const std::string& fen) {
     }
   }
 
-  Logger::debug("Loaded pieces total count: " + std::to_string(m_flags.m_pieceCount));
+  Logger::debug("Loaded pieces total count: " + std::to_string(getPieceCount()));
   assert(i * 8 + j == 64);
   return idx;
 }
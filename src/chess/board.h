@@ -20,13 +20,17 @@
 #define __BOARD__
 
 #include <cassert>
+#include <cstdint>
 #include <exception>
 #include <string>
 #include <list>
 
 #include "chess.h"
 
+class AttackMap;
 class Move;
+class MoveList;
+struct PackedBoard;
 
 /*!
  *  @class FenException
@@ -52,11 +56,21 @@ public:
  *  Stores piece positions and count, castling rights, en-passant square,
  *  moving side and move counters.
  *  Designed to be memory efficient for deep search trees.
+ *
+ *  Besides the mailbox, each side keeps a list of its piece squares grouped
+ *  by piece type, king first, and every occupied square knows its slot in
+ *  that list, so adding, removing and moving a piece take constant time.
+ *  A second key hashes only the piece counts, so that evaluation can look
+ *  up what it knows about the material. The whole state fits in four cache
+ *  lines, which is what a copy-make touches. The mailbox-only board was
+ *  176 bytes but only 8-byte aligned, so its copies already straddled three
+ *  or four lines; the lists cost no extra line and save the scans.
  */
-class Board {
+class alignas(64) Board {
 public:
   static constexpr unsigned int HEIGHT = 12;  //!< Extended board's height.
   static constexpr unsigned int WIDTH = 10;   //!< Extended board's width.
+  static constexpr unsigned int MAX_SIDE_PIECES = 16; //!< Pieces per side.
 
   /*!
    *  @enum Notation
@@ -81,19 +95,50 @@ public:
     Invalid = '?'
   };
 
+  /*!
+   *  @enum PieceType
+   *  @brief Piece types in the order of the piece lists.
+   */
+  enum class PieceType : unsigned char
+  {
+    King,
+    Queen,
+    Rook,
+    Bishop,
+    Knight,
+    Pawn,
+
+    Count
+  };
+
 private:
-  char m_board[HEIGHT * WIDTH]; //!< Flat array holding board contents.
-  BoardSquare m_pieces[32];     //!< Array of piece positions.
-  BoardSquare m_enPass;         //!< En-passant target square.
+  static constexpr unsigned int TYPES = unsigned(PieceType::Count);
+
+  std::uint64_t m_key;          //!< Zobrist key of the position.
+  std::uint64_t m_materialKey;  //!< Zobrist key of the piece counts.
 
   struct {
-    unsigned m_pieceCount : 6;    //!< Number of active pieces.
     unsigned m_castleInfo : 4;    //!< Castling rights encoded as [QKqk].
     unsigned m_isWhitesMove : 1;  //!< Moving side.
     unsigned m_halfMoves : 7;     //!< Halfmove clock.
     unsigned m_fullMoves : 16;    //!< Fullmove number.
   } m_flags;
 
+  BoardSquare m_enPass;         //!< En-passant target square.
+
+  //! End of each type's group in m_list, black first.
+  unsigned char m_ends[2][TYPES];
+
+  //! Squares of each side's pieces grouped by type, black first.
+  BoardSquare m_list[2][MAX_SIDE_PIECES];
+
+  //! Slot in m_list of the piece on each 0..63 square.
+  unsigned char m_index[64];
+
+  char m_board[HEIGHT * WIDTH]; //!< Flat array holding board contents.
+
+  friend struct PackedBoard;
+
 public:
   //! Default constructor. Creates an empty board.
   Board();
@@ -109,9 +154,38 @@ public:
   void loadFen(const std::string& fen =
                    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR") noexcept;
 
+  /*!
+   *  @brief Checks a FEN before it reaches loadFen(), which exits on errors.
+   *
+   *  Requires all six fields, eight full ranks, one king per side and no
+   *  more pieces than the piece lists hold.
+   */
+  static bool isFenValid(const std::string& fen) noexcept;
+
+  //! Returns the board state as a FEN string.
+  std::string getFen() const noexcept;
+
   //! Returns a new board resulting from applying the given move.
   Board makeMove(const Move& move) const noexcept;
 
+  /*!
+   * Returns a new board resulting from applying the given move and brings
+   * 'r_attacks', the attack map of this board, up to date with it.
+   */
+  Board makeMove(const Move& move, AttackMap& r_attacks) const noexcept;
+
+  /*!
+   * Returns a new board where the side to move passes.
+   * The halfmove clock is reset, so no repetition spans a null move.
+   */
+  Board makeNullMove() const noexcept;
+
+  /*!
+   * Returns true if both boards hold exactly the same state,
+   * including the order of the piece list.
+   */
+  bool operator==(const Board& other) const noexcept;
+
   //! Returns true if white can castle long.
   bool canWhiteLongCastle() const noexcept {
     return m_flags.m_castleInfo & 0b1000;
@@ -220,18 +294,159 @@ public:
     return m_enPass;
   }
 
-  //! Returns all valid moves for the current board.
+  //! Returns castling rights encoded as [QKqk].
+  unsigned int getCastleInfo() const noexcept {
+    return m_flags.m_castleInfo;
+  }
+
+  //! Returns the halfmove clock.
+  unsigned int getHalfMoves() const noexcept {
+    return m_flags.m_halfMoves;
+  }
+
+  //! Returns the fullmove number.
+  unsigned int getFullMoves() const noexcept {
+    return m_flags.m_fullMoves;
+  }
+
+  //! Returns the Zobrist key, maintained incrementally by makeMove.
+  std::uint64_t getKey() const noexcept {
+    return m_key;
+  }
+
+  //! Computes the Zobrist key from scratch.
+  std::uint64_t computeKey() const noexcept;
+
+  /*!
+   * Returns the key of the piece counts per side and type, maintained
+   * incrementally by makeMove. Equal counts give equal keys.
+   */
+  std::uint64_t getMaterialKey() const noexcept {
+    return m_materialKey;
+  }
+
+  //! Computes the material key from scratch.
+  std::uint64_t computeMaterialKey() const noexcept;
+
+  //! Returns true if the halfmove clock allows a fifty-move rule claim.
+  bool isFiftyMoveDraw() const noexcept {
+    return m_flags.m_halfMoves >= 100;
+  }
+
+  //! Returns the number of pieces on the board.
+  unsigned int getPieceCount() const noexcept {
+    return m_ends[0][TYPES - 1] + m_ends[1][TYPES - 1];
+  }
+
+  //! Returns the number of pieces of the given side.
+  unsigned int getPieceCount(const bool white) const noexcept {
+    return m_ends[white][TYPES - 1];
+  }
+
+  //! Returns the number of pieces of the given side and type.
+  unsigned int getPieceCount(const bool white,
+                             const PieceType type) const noexcept
+  {
+    const unsigned int t = unsigned(type);
+    return m_ends[white][t] - (t? m_ends[white][t - 1] : 0);
+  }
+
+  //! Returns the square of the i-th piece, white ones first.
+  BoardSquare getPieceSquare(const unsigned int i) const noexcept {
+    assert(i < getPieceCount() && "Piece index out of range");
+    const unsigned int white = getPieceCount(true);
+    return i < white? m_list[1][i] : m_list[0][i - white];
+  }
+
+  //! Returns the squares of the given side's pieces, grouped by type.
+  const BoardSquare* getPieces(const bool white) const noexcept {
+    return m_list[white];
+  }
+
+  //! Returns the squares of the given side's pieces of one type.
+  const BoardSquare* getPieces(const bool white,
+                               const PieceType type) const noexcept
+  {
+    const unsigned int t = unsigned(type);
+    return m_list[white] + (t? m_ends[white][t - 1] : 0);
+  }
+
+  //! Returns the king square of the given side, 0 if there is none.
+  BoardSquare getKingSquare(const bool white) const noexcept {
+    return m_ends[white][0]? m_list[white][0] : 0;
+  }
+
+  //! Returns true if a piece of the given side attacks the square.
+  bool isAttacked(const BoardSquare& sqr, const bool byWhite) const noexcept;
+
+  //! Returns true if the king of the given side is attacked.
+  bool isKingAttacked(const bool white) const noexcept {
+    const BoardSquare king = getKingSquare(white);
+    return king && isAttacked(king, !white);
+  }
+
+  //! Returns true if the side to move is in check.
+  bool isInCheck() const noexcept {
+    return isKingAttacked(m_flags.m_isWhitesMove);
+  }
+
+  /*!
+   * Returns true if the side that made the last move did not leave its king
+   * in check, i.e. the board results from a legal move.
+   */
+  bool isLegal() const noexcept {
+    return !isKingAttacked(!m_flags.m_isWhitesMove);
+  }
+
+  /*!
+   * Returns all valid moves for the current board.
+   * Moves are pseudo-legal: they may leave the own king in check.
+   */
   std::list<Move> getValidMoves() const noexcept;
 
+  //! Returns all legal moves for the current board.
+  std::list<Move> getLegalMoves() const noexcept;
+
   //! Returns all valid moves for the piece at the given square.
   std::list<Move> getValidMoves(const BoardSquare& sqr) const noexcept;
 
+  //! Appends all valid (pseudo-legal) moves to 'r_moves', allocating nothing.
+  void getValidMoves(MoveList& r_moves) const noexcept;
+
+  //! Appends all legal moves to 'r_moves', allocating nothing.
+  void getLegalMoves(MoveList& r_moves) const noexcept;
+
+  //! Appends the valid moves of the piece at 'sqr' to 'r_moves'.
+  void getValidMoves(const BoardSquare& sqr, MoveList& r_moves) const noexcept;
+
   //! Prints the board to stdout.
   void print() const noexcept;
 
+  //! Returns the type of a piece notation of either colour.
+  static PieceType typeOf(const char piece) noexcept {
+    // Indexed by the five low bits, which both cases share.
+    static constexpr PieceType TYPE_OF[32] = {
+      PieceType::King, PieceType::King, PieceType::Bishop, PieceType::King,
+      PieceType::King, PieceType::King, PieceType::King, PieceType::King,
+      PieceType::King, PieceType::King, PieceType::King, PieceType::King,
+      PieceType::King, PieceType::King, PieceType::Knight, PieceType::King,
+      PieceType::Pawn, PieceType::Queen, PieceType::Rook, PieceType::King,
+      PieceType::King, PieceType::King, PieceType::King, PieceType::King,
+      PieceType::King, PieceType::King, PieceType::King, PieceType::King,
+      PieceType::King, PieceType::King, PieceType::King, PieceType::King
+    };
+    return TYPE_OF[piece & 0b00011111];
+  }
+
 private:
+  //! Puts a piece on an empty square.
+  void addPiece(const BoardSquare sqr, const char piece) noexcept;
+
   //! Removes the piece at the given square from the board.
-  void removePiece(const BoardSquare& sqr) noexcept;
+  void removePiece(const BoardSquare sqr) noexcept;
+
+  //! Moves a piece to an empty square.
+  void movePiece(const BoardSquare from, const BoardSquare to) noexcept;
 
   /*!
    * Parses and places pieces from FEN string.
@@ -21,5 +21,43 @@
 
 using BoardSquare = unsigned char;
 
+/*!
+ *  @struct MailboxTables
+ *  @brief Conversions between the 10x12 mailbox and 0..63 squares.
+ *
+ *  Generated at compile time, so they cost nothing at startup and work in
+ *  constant expressions.
+ */
+struct MailboxTables {
+  BoardSquare toMailbox[64];      //!< Mailbox square of every 0..63 square.
+  unsigned char fromMailbox[120]; //!< 0..63 square, 64 off the board.
+
+  constexpr MailboxTables()
+    : toMailbox()
+    , fromMailbox()
+  {
+    for (unsigned char& sqr : fromMailbox) {
+      sqr = 64;
+    }
+    for (unsigned int sqr = 0; sqr < 64; ++sqr) {
+      toMailbox[sqr] = 21 + (sqr / 8) * 10 + sqr % 8;
+      fromMailbox[toMailbox[sqr]] = sqr;
+    }
+  }
+};
+
+//! The conversions used everywhere.
+inline constexpr MailboxTables MAILBOX;
+
+//! Converts a 0..63 square (a8 = 0, h1 = 63) into the 10x12 mailbox.
+constexpr BoardSquare toMailbox(const unsigned int sqr) {
+  return MAILBOX.toMailbox[sqr];
+}
+
+//! Converts a mailbox square of the inner 8x8 area into a 0..63 square.
+constexpr unsigned int fromMailbox(const unsigned int sqr) {
+  return MAILBOX.fromMailbox[sqr];
+}
+
 #endif
 
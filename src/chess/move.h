@@ -31,6 +31,7 @@ struct Move {
   BoardSquare from; //!< Move from this tile.
   BoardSquare to;   //!< Move to this tile.
   bool isCheck;     //!< Is this move a check?
+  char promotion;   //!< Promoted piece notation, ' ' if none.
 
   /*!
    *  @brief Default contructor.
@@ -42,6 +43,7 @@ struct Move {
     : from(0)
     , to(0)
     , isCheck(0)
+    , promotion(' ')
   {}
 
   /*!
@@ -50,13 +52,27 @@ struct Move {
    *  @param from Source square.
    *  @param to Destination square.
    *  @param isCheck Indicates whether the move results in a check (default: false).
+   *  @param promotion Piece the pawn promotes to (default: ' ', none).
    */
-  Move(const BoardSquare from, const BoardSquare to, const bool isCheck = 0)
+  Move(const BoardSquare from, const BoardSquare to, const bool isCheck = 0,
+       const char promotion = ' ')
     : from(from)
     , to(to)
     , isCheck(isCheck)
+    , promotion(promotion)
   {}
 
+  //! Returns true if both moves have the same squares and promotion.
+  bool operator==(const Move& other) const noexcept {
+    return from == other.from && to == other.to &&
+           promotion == other.promotion;
+  }
+
+  //! Returns true if the move is a promotion.
+  bool isPromotion() const noexcept {
+    return promotion != ' ';
+  }
+
   /*!
    *  @brief Set isCheck field.
    *
@@ -81,6 +97,29 @@ struct Move {
     str[1] += 8 - from_i;
     str[4] += to_j;
     str[5] += 8 - to_i;
+    if (isPromotion()) {
+      str.push_back(promotion);
+    }
+    return str;
+  }
+
+  /*!
+   *  @brief Convert the move to UCI long algebraic notation.
+   *
+   *  @return A string like e2e4 or e7e8q, 0000 for an empty move.
+   */
+  std::string toUci() const noexcept {
+    if (from == to) {
+      return "0000";
+    }
+    std::string str = "a0a0";
+    str[0] += from % 10 - 1;
+    str[1] += 10 - from / 10;
+    str[2] += to % 10 - 1;
+    str[3] += 10 - to / 10;
+    if (isPromotion()) {
+      str.push_back(promotion | 0b00100000);
+    }
     return str;
   }
 };
@@ -0,0 +1,101 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHESS_MOVELIST__
+#define __CHESS_MOVELIST__
+
+#include <cassert>
+
+#include "move.h"
+
+/*!
+ *  @class MoveList
+ *  @brief Fixed capacity move container that never allocates.
+ *
+ *  Used by the move generators and the search, where a std::list per node
+ *  would put the allocator on the hot path.
+ */
+class MoveList {
+public:
+  //! Above the most pseudo-legal moves any position has.
+  static constexpr unsigned int CAPACITY = 256;
+
+private:
+  Move m_moves[CAPACITY]; //!< Moves, the first m_size are valid.
+  unsigned int m_size;    //!< Number of moves.
+
+public:
+  //! Creates an empty list.
+  MoveList()
+    : m_size(0)
+  {}
+
+public:
+  //! Appends a move.
+  void push_back(const Move& move) noexcept {
+    assert(m_size < CAPACITY);
+    m_moves[m_size++] = move;
+  }
+
+  //! Removes all moves.
+  void clear() noexcept {
+    m_size = 0;
+  }
+
+  //! Keeps the first 'size' moves.
+  void resize(const unsigned int size) noexcept {
+    assert(size <= m_size);
+    m_size = size;
+  }
+
+  //! Returns the number of moves.
+  unsigned int size() const noexcept {
+    return m_size;
+  }
+
+  //! Returns true if there are no moves.
+  bool empty() const noexcept {
+    return !m_size;
+  }
+
+  Move& operator[](const unsigned int i) noexcept {
+    return m_moves[i];
+  }
+
+  const Move& operator[](const unsigned int i) const noexcept {
+    return m_moves[i];
+  }
+
+  Move* begin() noexcept {
+    return m_moves;
+  }
+
+  Move* end() noexcept {
+    return m_moves + m_size;
+  }
+
+  const Move* begin() const noexcept {
+    return m_moves;
+  }
+
+  const Move* end() const noexcept {
+    return m_moves + m_size;
+  }
+};
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "packed.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "chess.h"
+#include "move.h"
+
+//! Piece notation in 4-bit code order.
+static constexpr char PIECE_CODES[] = "PNBRQKpnbrqk";
+
+//! 4-bit code of every piece notation, indexed by the notation character.
+struct PieceCodeTable {
+  std::uint8_t codes[128] = {};
+
+  constexpr PieceCodeTable() {
+    for (std::uint8_t code = 0; code < 12; ++code) {
+      codes[int(PIECE_CODES[code])] = code;
+    }
+  }
+};
+
+static constexpr PieceCodeTable CODE_OF;
+
+PackedBoard PackedBoard::fromBoard(const Board& board) noexcept {
+  PackedBoard packed{};
+  for (unsigned int i = 0; i < board.getPieceCount(); ++i) {
+    packed.occupancy |= std::uint64_t(1) << fromMailbox(board.getPieceSquare(i));
+  }
+
+  unsigned int count = 0;
+  for (std::uint64_t occ = packed.occupancy; occ; occ &= occ - 1) {
+    const char piece = board.getVal(toMailbox(__builtin_ctzll(occ)));
+    packed.pieces[count / 2] |= CODE_OF.codes[int(piece)] << (count % 2 * 4);
+    ++count;
+  }
+
+  packed.fullMoves = board.getFullMoves();
+  packed.flags = board.getCastleInfo() | (board.isWhitesMove()? WHITE_TO_MOVE : 0);
+  packed.enPass = board.getEnPass()? fromMailbox(board.getEnPass()) : NO_EN_PASS;
+  packed.halfMoves = board.getHalfMoves();
+  return packed;
+}
+
+//! Castling rights in flag bit order.
+static constexpr char CASTLES[] = "kqKQ";
+
+bool PackedBoard::fromFen(const std::string& fen, PackedBoard& r_packed)
+    noexcept
+{
+  PackedBoard packed{};
+  unsigned int sqr = 0;
+  unsigned int count = 0;
+  unsigned int sides[2] = {};
+  unsigned int kings[2] = {};
+  const char* c = fen.c_str();
+  for (; *c && *c != ' '; ++c) {
+    if (*c == '/') {
+      continue;
+    }
+    if (*c >= '1' && *c <= '8') {
+      sqr += *c - '0';
+      continue;
+    }
+    const char* piece = std::strchr(PIECE_CODES, *c);
+    if (!piece || sqr >= 64) {
+      return false;
+    }
+    const unsigned int code = piece - PIECE_CODES;
+    const bool white = code < 6;
+    if (++sides[white] > Board::MAX_SIDE_PIECES) {
+      return false;
+    }
+    kings[white] += code % 6 == 5;
+    packed.occupancy |= std::uint64_t(1) << sqr++;
+    packed.pieces[count / 2] |= code << (count % 2 * 4);
+    ++count;
+  }
+  if (sqr != 64 || kings[0] != 1 || kings[1] != 1 ||
+      c[0] != ' ' || (c[1] != 'w' && c[1] != 'b') || (c[2] && c[2] != ' '))
+  {
+    return false;
+  }
+  packed.flags = c[1] == 'w'? WHITE_TO_MOVE : 0;
+  c += 2 + bool(c[2]);
+
+  for (; *c && *c != ' '; ++c) {
+    const char* right = std::strchr(CASTLES, *c);
+    if (*c != '-' && !right) {
+      return false;
+    }
+    packed.flags |= right? 1 << (right - CASTLES) : 0;
+  }
+
+  packed.enPass = NO_EN_PASS;
+  if (c[0] == ' ' && c[1] >= 'a' && c[1] <= 'h' &&
+      (c[2] == '3' || c[2] == '6'))
+  {
+    packed.enPass = ('8' - c[2]) * 8 + c[1] - 'a';
+    c += 3;
+  } else if (c[0] == ' ' && c[1] == '-') {
+    c += 2;
+  }
+
+  // Clocks are optional; strtoul leaves 'end' where it started without one.
+  char* end = nullptr;
+  const unsigned long halfMoves = std::strtoul(c, &end, 10);
+  packed.halfMoves = std::min(halfMoves, 255ul);
+  const char* start = end;
+  const unsigned long fullMoves = std::strtoul(start, &end, 10);
+  packed.fullMoves = end == start || !fullMoves? 1 :
+                     std::min(fullMoves, 65535ul);
+  r_packed = packed;
+  return true;
+}
+
+Board PackedBoard::toBoard() const noexcept {
+  Board board;
+  unsigned int count = 0;
+  for (std::uint64_t occ = occupancy; occ; occ &= occ - 1) {
+    const BoardSquare mailbox = toMailbox(__builtin_ctzll(occ));
+    board.addPiece(mailbox, PIECE_CODES[pieces[count / 2] >> (count % 2 * 4) & 0xF]);
+    ++count;
+  }
+
+  board.m_flags.m_castleInfo = flags & 0b1111;
+  board.m_flags.m_isWhitesMove = isWhitesMove();
+  board.m_flags.m_halfMoves = halfMoves;
+  board.m_flags.m_fullMoves = fullMoves;
+  board.m_enPass = enPass == NO_EN_PASS? 0 : toMailbox(enPass);
+  board.m_key = board.computeKey();
+  return board;
+}
+
+//! Promotion pieces in 3-bit code order, 0 is no promotion.
+static constexpr char PROMOTION_CODES[] = " NBRQ";
+
+std::uint16_t PackedGame::packMove(const Move& move) noexcept {
+  std::uint16_t promotion = 0;
+  if (move.isPromotion()) {
+    while (PROMOTION_CODES[promotion] != (move.promotion & 0b11011111)) {
+      ++promotion;
+    }
+  }
+  return fromMailbox(move.from) | fromMailbox(move.to) << 6 | promotion << 12;
+}
+
+Move PackedGame::unpackMove(const std::uint16_t move,
+                            const bool white) noexcept
+{
+  char promotion = PROMOTION_CODES[move >> 12 & 0b111];
+  if (promotion != ' ' && !white) {
+    promotion |= 0b00100000;
+  }
+  return Move(toMailbox(move & 63), toMailbox(move >> 6 & 63), false,
+              promotion);
+}
+
+void PackedGame::serialize(std::vector<std::uint8_t>& out) const noexcept {
+  const std::size_t offset = out.size();
+  const std::uint16_t count = m_moves.size();
+  out.resize(offset + sizeof(PackedBoard) + sizeof(count) +
+             count * sizeof(std::uint16_t));
+
+  std::uint8_t* data = out.data() + offset;
+  std::memcpy(data, &m_start, sizeof(PackedBoard));
+  data += sizeof(PackedBoard);
+  std::memcpy(data, &count, sizeof(count));
+  data += sizeof(count);
+  std::memcpy(data, m_moves.data(), count * sizeof(std::uint16_t));
+}
+
+PackedGame PackedGame::deserialize(const std::uint8_t*& r_data) noexcept {
+  PackedBoard start;
+  std::memcpy(&start, r_data, sizeof(PackedBoard));
+  r_data += sizeof(PackedBoard);
+  std::uint16_t count;
+  std::memcpy(&count, r_data, sizeof(count));
+  r_data += sizeof(count);
+
+  PackedGame game(start);
+  game.m_moves.resize(count);
+  std::memcpy(game.m_moves.data(), r_data, count * sizeof(std::uint16_t));
+  r_data += count * sizeof(std::uint16_t);
+  return game;
+}
+
+void PackedBoard::benchmark() noexcept {
+  static const char* const CORPUS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+    "8/8/8/4k3/8/8/4P3/4K3 b - - 17 93",
+  };
+
+  // Exact round trip against the state loadFen produces.
+  unsigned int failures = 0;
+  for (const char* fen : CORPUS) {
+    Board board;
+    board.loadFen(fen);
+    if (!(fromBoard(board).toBoard() == board)) {
+      Logger::error("Round trip failed for " + std::string(fen));
+      ++failures;
+    }
+    PackedBoard packed;
+    if (!fromFen(fen, packed) || !(packed.toBoard() == board)) {
+      Logger::error("FEN packing failed for " + std::string(fen));
+      ++failures;
+    }
+  }
+
+  // Random games as a bulk data set, kept both as boards and as sequences.
+  std::mt19937 rng(42);
+  Board start;
+  start.loadFen();
+  std::vector<Board> boards;
+  std::vector<std::uint8_t> sequences;
+  unsigned int games = 0;
+  for (; games < 200; ++games) {
+    PackedGame game(start);
+    Board board(start);
+    boards.push_back(board);
+    for (unsigned int ply = 0; ply < 120; ++ply) {
+      const std::list<Move>& moves = board.getLegalMoves();
+      if (moves.empty()) {
+        break;
+      }
+      auto it = moves.begin();
+      std::advance(it, rng() % moves.size());
+      board = board.makeMove(*it);
+      game.push(*it);
+      boards.push_back(board);
+    }
+    game.serialize(sequences);
+  }
+
+  // Sequences must replay into the very same boards.
+  std::size_t replayed = 0;
+  const std::uint8_t* data = sequences.data();
+  for (unsigned int i = 0; i < games; ++i) {
+    PackedGame::deserialize(data).forEachPosition([&](const Board& board) {
+      failures += !(board == boards[replayed]);
+      ++replayed;
+    });
+  }
+  for (const Board& board : boards) {
+    failures += fromBoard(board).toBoard().getFen() != board.getFen();
+  }
+
+  constexpr unsigned int ROUNDS = 50;
+  std::vector<PackedBoard> packed(boards.size());
+  auto begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    for (std::size_t i = 0; i < boards.size(); ++i) {
+      packed[i] = fromBoard(boards[i]);
+    }
+  }
+  const std::chrono::duration<double> encodeTime =
+      std::chrono::steady_clock::now() - begin;
+
+  unsigned int checksum = 0;
+  begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    for (const PackedBoard& position : packed) {
+      checksum += position.toBoard().getPieceCount();
+    }
+  }
+  const std::chrono::duration<double> decodeTime =
+      std::chrono::steady_clock::now() - begin;
+
+  begin = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < ROUNDS; ++round) {
+    data = sequences.data();
+    for (unsigned int i = 0; i < games; ++i) {
+      PackedGame::deserialize(data).forEachPosition([&](const Board& board) {
+        checksum += board.getPieceCount();
+      });
+    }
+  }
+  const std::chrono::duration<double> replayTime =
+      std::chrono::steady_clock::now() - begin;
+
+  const double positions = double(boards.size()) * ROUNDS;
+  Logger::info("Positions: " + std::to_string(boards.size()) + " in " +
+               std::to_string(games) + " games, round trip failures: " +
+               std::to_string(failures));
+  Logger::info("Bytes per position: board " + std::to_string(sizeof(Board)) +
+               ", packed " + std::to_string(sizeof(PackedBoard)) +
+               ", sequence " +
+               std::to_string(double(sequences.size()) / boards.size()));
+  Logger::info("Encode: " + std::to_string(positions / encodeTime.count()) +
+               " positions/s");
+  Logger::info("Decode: " + std::to_string(positions / decodeTime.count()) +
+               " positions/s");
+  Logger::info("Sequence replay: " +
+               std::to_string(positions / replayTime.count()) +
+               " positions/s (checksum " + std::to_string(checksum) + ")");
+}
@@ -0,0 +1,149 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PACKED__
+#define __PACKED__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "move.h"
+
+/*!
+ *  @struct PackedBoard
+ *  @brief A position packed into 32 bytes for bulk storage.
+ *
+ *  Squares are 0..63 with a8 = 0. Every occupied square has a bit in the
+ *  occupancy mask and a 4-bit code in 'pieces', in square order, two codes
+ *  per byte with the lower square in the low nibble.
+ */
+struct PackedBoard {
+  static constexpr std::uint8_t WHITE_TO_MOVE = 0b10000; //!< Side flag.
+  static constexpr std::uint8_t NO_EN_PASS = 0xFF;        //!< No target.
+
+  std::uint64_t occupancy;  //!< Bit per occupied square.
+  std::uint8_t pieces[16];  //!< 4-bit piece codes, index into "PNBRQKpnbrqk".
+  std::uint16_t fullMoves;  //!< Fullmove number.
+  std::uint8_t flags;       //!< Castling rights [QKqk] and side to move.
+  std::uint8_t enPass;      //!< En-passant square (0..63) or NO_EN_PASS.
+  std::uint8_t halfMoves;   //!< Halfmove clock.
+  std::uint8_t reserved[3]; //!< Always zero.
+
+  //! Packs the given board.
+  static PackedBoard fromBoard(const Board& board) noexcept;
+
+  /*!
+   *  @brief Packs a FEN without going through a Board.
+   *
+   *  Needs the placement and the side to move; missing castling rights,
+   *  en passant and clocks read as none, none, 0 and 1. Anything after the
+   *  clocks is ignored, so labelled lines parse as they are.
+   *  @return False if the FEN is malformed or could not be a Board: not
+   *  exactly one king per side or more than Board::MAX_SIDE_PIECES pieces.
+   */
+  static bool fromFen(const std::string& fen, PackedBoard& r_packed)
+      noexcept;
+
+  /*!
+   *  @brief Unpacks into a board.
+   *
+   *  The piece list is rebuilt in square order, which is the order
+   *  Board::loadFen produces, so packing a loaded board and unpacking it
+   *  gives a board equal to the loaded one in every field.
+   */
+  Board toBoard() const noexcept;
+
+  //! Measures encode/decode throughput and checks round trips.
+  static void benchmark() noexcept;
+
+  //! Returns true if it's white's move.
+  bool isWhitesMove() const noexcept {
+    return flags & WHITE_TO_MOVE;
+  }
+};
+
+static_assert(sizeof(PackedBoard) == 32, "PackedBoard must stay 32 bytes");
+
+/*!
+ *  @class PackedGame
+ *  @brief Consecutive positions of a game as a start position plus moves.
+ *
+ *  Moves take 16 bits each: from and to as 0..63 squares (6 bits each) and
+ *  the promoted piece (3 bits). Positions are rebuilt by replaying the moves
+ *  with Board::makeMove.
+ */
+class PackedGame {
+  PackedBoard m_start;                //!< Position before the first move.
+  std::vector<std::uint16_t> m_moves; //!< Packed moves.
+
+public:
+  //! Starts a game at the given position.
+  explicit PackedGame(const Board& start)
+    : m_start(PackedBoard::fromBoard(start))
+    , m_moves()
+  {}
+
+public:
+  //! Appends a move made in the last position.
+  void push(const Move& move) noexcept {
+    m_moves.push_back(packMove(move));
+  }
+
+  //! Returns the number of moves.
+  std::size_t size() const noexcept {
+    return m_moves.size();
+  }
+
+  //! Calls 'visit' with every position of the game, start included.
+  template <typename Visitor>
+  void forEachPosition(Visitor&& visit) const {
+    Board board = m_start.toBoard();
+    visit(board);
+    for (const std::uint16_t move : m_moves) {
+      board = board.makeMove(unpackMove(move, board.isWhitesMove()));
+      visit(board);
+    }
+  }
+
+  //! Appends the binary form: start, move count (16 bits), moves.
+  void serialize(std::vector<std::uint8_t>& out) const noexcept;
+
+  /*!
+   *  @brief Reads a game written by serialize().
+   *
+   *  @param r_data Read position, advanced past the game.
+   */
+  static PackedGame deserialize(const std::uint8_t*& r_data) noexcept;
+
+  //! Packs a move into 16 bits.
+  static std::uint16_t packMove(const Move& move) noexcept;
+
+  //! Unpacks a move, 'white' selecting the case of the promoted piece.
+  static Move unpackMove(const std::uint16_t move, const bool white) noexcept;
+
+private:
+  //! Creates a game from an already packed start.
+  explicit PackedGame(const PackedBoard& start)
+    : m_start(start)
+    , m_moves()
+  {}
+};
+
+#endif
@@ -20,81 +20,75 @@
 
 #include <list>
 
-#include "../cpp-logger/logger.h"
 #include "board.h"
 #include "chess.h"
 #include "move.h"
+#include "movelist.h"
+#include "tables.h"
 
-std::list<Move> Pawn::getValidMoves(const Board& board,
-                                    const BoardSquare& sqr) noexcept
+//! Adds a pawn move, expanded into all promotions on the last rank.
+static void addPawnMove(MoveList& r_moves, const Board& board,
+                        const BoardSquare& from, const BoardSquare& to)
+{
+  const unsigned int lastRow = board.isWhitesMove()? 2 : 9;
+  if (to / Board::WIDTH != lastRow) {
+    r_moves.push_back(Move(from, to));
+    return;
+  }
+
+  const char* promotions = board.isWhitesMove()? "QRBN" : "qrbn";
+  for (int i = 0; i < 4; ++i) {
+    r_moves.push_back(Move(from, to, false, promotions[i]));
+  }
+}
+
+void Pawn::addValidMoves(const Board& board, const BoardSquare& sqr,
+                         MoveList& r_moves) noexcept
 {
-  Logger::debug("Getting moves for Pawn...");
   const int forward = board.isWhitesMove()? -Board::WIDTH : Board::WIDTH;
 
-  std::list<Move> moves;
   if (!board.isWhite(sqr) ^ board.isWhitesMove()) {
     if (board.isEmpty(sqr + forward)) {
-      moves.push_back(Move(sqr, sqr + forward));
+      addPawnMove(r_moves, board, sqr, sqr + forward);
 
       if ((sqr / 10 == (3 + board.isWhitesMove() * 5)) &&
            board.isEmpty(sqr + 2 * forward))
       {
-        moves.push_back(Move(sqr, sqr + 2 * forward));
+        r_moves.push_back(Move(sqr, sqr + 2 * forward));
       }
     }
     if (board.isValid(sqr + forward - 1) &&
         (board.isEnemyPiece(sqr + forward - 1) ||
          board.isEnPass(sqr + forward - 1)))
     {
-      moves.push_back(Move(sqr, sqr + forward - 1));
+      addPawnMove(r_moves, board, sqr, sqr + forward - 1);
     }
     if (board.isValid(sqr + forward + 1) &&
         (board.isEnemyPiece(sqr + forward + 1) ||
          board.isEnPass(sqr + forward + 1)))
     {
-      moves.push_back(Move(sqr, sqr + forward + 1));
+      addPawnMove(r_moves, board, sqr, sqr + forward + 1);
     }
   }
-
-  return moves;
 }
 
-std::list<Move> Knight::getValidMoves(const Board& board,
-                                      const BoardSquare& sqr) noexcept
+void Knight::addValidMoves(const Board& board, const BoardSquare& sqr,
+                           MoveList& r_moves) noexcept
 {
-  Logger::debug("Getting moves for Knight...");
-  std::list<Move> moves;
-
   if (!board.isWhite(sqr) ^ board.isWhitesMove()) {
-    const BoardSquare squares[8] = {
-      static_cast<BoardSquare>(sqr - (Board::WIDTH * 2 + 1)),
-      static_cast<BoardSquare>(sqr - (Board::WIDTH * 2 - 1)),
-      static_cast<BoardSquare>(sqr - (Board::WIDTH - 2)),
-      static_cast<BoardSquare>(sqr - (Board::WIDTH + 2)),
-      static_cast<BoardSquare>(sqr + (Board::WIDTH - 2)),
-      static_cast<BoardSquare>(sqr + (Board::WIDTH + 2)),
-      static_cast<BoardSquare>(sqr + (Board::WIDTH * 2 + 1)),
-      static_cast<BoardSquare>(sqr + (Board::WIDTH * 2 - 1))
-    };
-
-    for (const BoardSquare& target : squares) {
-      if (board.isValid(target) &&
-          (board.isEmpty(target) || board.isEnemyPiece(target)))
-      {
-        moves.push_back(Move(sqr, target));
+    const unsigned int from = fromMailbox(sqr);
+    for (unsigned int i = 0; i < ATTACKS.knightCount[from]; ++i) {
+      const BoardSquare target = ATTACKS.knight[from][i];
+      if (board.isEmpty(target) || board.isEnemyPiece(target)) {
+        r_moves.push_back(Move(sqr, target));
       }
     }
   }
-
-  return moves;
 }
 
-std::list<Move> Bishop::getValidMoves(const Board& board,
-                                      const BoardSquare& sqr) noexcept
+void Bishop::addValidMoves(const Board& board, const BoardSquare& sqr,
+                           MoveList& r_moves) noexcept
 {
-  Logger::debug("Getting moves for Bishop...");
-  std::list<Move> moves;
-
   if (!board.isWhite(sqr) ^ board.isWhitesMove()) {
     // Main diagonal
     constexpr int offsetMainDiag = Board::WIDTH + 1;
@@ -104,10 +98,10 @@ std::list<Move> Bishop::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
@@ -118,10 +112,10 @@ std::list<Move> Bishop::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
@@ -135,10 +129,10 @@ std::list<Move> Bishop::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
@@ -149,25 +143,20 @@ std::list<Move> Bishop::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
     }
   }
-
-  return moves;
 }
 
-std::list<Move> Rook::getValidMoves(const Board& board,
-                                    const BoardSquare& sqr) noexcept
+void Rook::addValidMoves(const Board& board, const BoardSquare& sqr,
+                         MoveList& r_moves) noexcept
 {
-  Logger::debug("Getting moves for Rook...");
-  std::list<Move> moves;
-
   if (!board.isWhite(sqr) ^ board.isWhitesMove()) {
     // Vertical
     for (int i = 1; ; ++i) {
@@ -176,10 +165,10 @@ std::list<Move> Rook::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
@@ -190,10 +179,10 @@ std::list<Move> Rook::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
@@ -206,10 +195,10 @@ std::list<Move> Rook::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
@@ -220,71 +209,105 @@ std::list<Move> Rook::getValidMoves(const Board& board,
         break;
       }
       if (board.isEmpty(target)) {
-        moves.push_back(Move(sqr, target));
+        r_moves.push_back(Move(sqr, target));
       } else {
         if (board.isEnemyPiece(target)) {
-          moves.push_back(Move(sqr, target));
+          r_moves.push_back(Move(sqr, target));
         }
         break;
       }
     }
   }
-
-  return moves;
 }
 
-std::list<Move> Queen::getValidMoves(const Board& board,
-                                     const BoardSquare& sqr) noexcept
+void Queen::addValidMoves(const Board& board, const BoardSquare& sqr,
+                          MoveList& r_moves) noexcept
 {
-  Logger::debug("Getting moves for Queen...");
-  std::list<Move> moves = Rook::getValidMoves(board, sqr);
-  moves.splice(moves.begin(), Bishop::getValidMoves(board, sqr));
-
-  return moves;
+  Bishop::addValidMoves(board, sqr, r_moves);
+  Rook::addValidMoves(board, sqr, r_moves);
 }
 
-std::list<Move> King::getValidMoves(const Board& board,
-                                    const BoardSquare& sqr) noexcept
+void King::addValidMoves(const Board& board, const BoardSquare& sqr,
+                         MoveList& r_moves) noexcept
 {
-  Logger::debug("Getting moves for King...");
-  std::list<Move> moves;
-
   if (!board.isWhite(sqr) ^ board.isWhitesMove()) {
-    const BoardSquare squares[8] = {
-      static_cast<BoardSquare>(sqr - Board::WIDTH - 1),
-      static_cast<BoardSquare>(sqr - Board::WIDTH),
-      static_cast<BoardSquare>(sqr - Board::WIDTH + 1),
-      static_cast<BoardSquare>(sqr - 1),
-      static_cast<BoardSquare>(sqr + 1),
-      static_cast<BoardSquare>(sqr + Board::WIDTH - 1),
-      static_cast<BoardSquare>(sqr + Board::WIDTH),
-      static_cast<BoardSquare>(sqr + Board::WIDTH + 1),
-    };
-
-    for (const BoardSquare& target : squares) {
-      if (board.isValid(target) &&
-          (board.isEmpty(target) || board.isEnemyPiece(target)))
-      {
-        moves.push_back(Move(sqr, target));
+    const unsigned int from = fromMailbox(sqr);
+    for (unsigned int i = 0; i < ATTACKS.kingCount[from]; ++i) {
+      const BoardSquare target = ATTACKS.king[from][i];
+      if (board.isEmpty(target) || board.isEnemyPiece(target)) {
+        r_moves.push_back(Move(sqr, target));
       }
     }
 
-    if (board.isShortCastleAvailable() &&
-        board.isEmpty(sqr + 1) && // Is also not under attack.
-        board.isEmpty(sqr + 2))
-    {
-      moves.push_back(Move(sqr, sqr + 2));
-    }
+    // Castling: the king can't leave, cross or land on an attacked square.
+    const bool white = board.isWhitesMove();
+    const bool enemy = !white;
+    const BoardSquare home = white? 95 : 25;
+    if (sqr == home && !board.isAttacked(sqr, enemy)) {
+      const char rook = white? 'R' : 'r';
+      if ((white? board.canWhiteShortCastle() : board.canBlackShortCastle()) &&
+          board.getVal(sqr + 3) == rook &&
+          board.isEmpty(sqr + 1) && board.isEmpty(sqr + 2) &&
+          !board.isAttacked(sqr + 1, enemy) &&
+          !board.isAttacked(sqr + 2, enemy))
+      {
+        r_moves.push_back(Move(sqr, sqr + 2));
+      }
 
-    if (board.isLongCastleAvailable() &&
-        board.isEmpty(sqr - 1) && // Is also not under attack.
-        board.isEmpty(sqr - 2) &&
-        board.isEmpty(sqr - 3))
-    {
-      moves.push_back(Move(sqr, sqr - 2));
+      if ((white? board.canWhiteLongCastle() : board.canBlackLongCastle()) &&
+          board.getVal(sqr - 4) == rook &&
+          board.isEmpty(sqr - 1) && board.isEmpty(sqr - 2) &&
+          board.isEmpty(sqr - 3) &&
+          !board.isAttacked(sqr - 1, enemy) &&
+          !board.isAttacked(sqr - 2, enemy))
+      {
+        r_moves.push_back(Move(sqr, sqr - 2));
+      }
     }
   }
+}
+
+
+//! Collects the moves of one generator into a list.
+template <void (*Generate)(const Board&, const BoardSquare&, MoveList&) noexcept>
+static std::list<Move> toList(const Board& board, const BoardSquare& sqr) {
+  MoveList moves;
+  Generate(board, sqr, moves);
+  return std::list<Move>(moves.begin(), moves.end());
+}
+
+std::list<Move> Pawn::getValidMoves(const Board& board,
+                                    const BoardSquare& sqr) noexcept
+{
+  return toList<addValidMoves>(board, sqr);
+}
+
+std::list<Move> Knight::getValidMoves(const Board& board,
+                                      const BoardSquare& sqr) noexcept
+{
+  return toList<addValidMoves>(board, sqr);
+}
 
-  return moves;
+std::list<Move> Bishop::getValidMoves(const Board& board,
+                                      const BoardSquare& sqr) noexcept
+{
+  return toList<addValidMoves>(board, sqr);
 }
 
+std::list<Move> Rook::getValidMoves(const Board& board,
+                                    const BoardSquare& sqr) noexcept
+{
+  return toList<addValidMoves>(board, sqr);
+}
+
+std::list<Move> Queen::getValidMoves(const Board& board,
+                                     const BoardSquare& sqr) noexcept
+{
+  return toList<addValidMoves>(board, sqr);
+}
+
+std::list<Move> King::getValidMoves(const Board& board,
+                                    const BoardSquare& sqr) noexcept
+{
+  return toList<addValidMoves>(board, sqr);
+}
@@ -25,6 +25,7 @@
 
 class Move;
 class Board;
+class MoveList;
 
 /*!
  *  @struct Pawn
@@ -39,6 +40,10 @@ struct Pawn {
    */
   static std::list<Move>
     getValidMoves(const Board& board, const BoardSquare& sqr) noexcept;
+
+  //! Appends the moves of a Pawn to 'r_moves', allocating nothing.
+  static void addValidMoves(const Board& board, const BoardSquare& sqr,
+                            MoveList& r_moves) noexcept;
 };
 
 /*!
@@ -54,6 +59,10 @@ struct Knight {
    */
   static std::list<Move>
     getValidMoves(const Board& board, const BoardSquare& sqr) noexcept;
+
+  //! Appends the moves of a Knight to 'r_moves', allocating nothing.
+  static void addValidMoves(const Board& board, const BoardSquare& sqr,
+                            MoveList& r_moves) noexcept;
 };
 
 /*!
@@ -70,6 +79,10 @@ struct Bishop {
    */
   static std::list<Move>
     getValidMoves(const Board& board, const BoardSquare& sqr) noexcept;
+
+  //! Appends the moves of a Bishop to 'r_moves', allocating nothing.
+  static void addValidMoves(const Board& board, const BoardSquare& sqr,
+                            MoveList& r_moves) noexcept;
 };
 
 /*!
@@ -85,6 +98,10 @@ struct Rook {
    */
   static std::list<Move>
     getValidMoves(const Board& board, const BoardSquare& sqr) noexcept;
+
+  //! Appends the moves of a Rook to 'r_moves', allocating nothing.
+  static void addValidMoves(const Board& board, const BoardSquare& sqr,
+                            MoveList& r_moves) noexcept;
 };
 
 /*!
@@ -100,6 +117,10 @@ struct Queen {
    */
   static std::list<Move>
     getValidMoves(const Board& board, const BoardSquare& sqr) noexcept;
+
+  //! Appends the moves of a Queen to 'r_moves', allocating nothing.
+  static void addValidMoves(const Board& board, const BoardSquare& sqr,
+                            MoveList& r_moves) noexcept;
 };
 
 /*!
@@ -115,6 +136,10 @@ struct King {
    */
   static std::list<Move>
     getValidMoves(const Board& board, const BoardSquare& sqr) noexcept;
+
+  //! Appends the moves of a King to 'r_moves', allocating nothing.
+  static void addValidMoves(const Board& board, const BoardSquare& sqr,
+                            MoveList& r_moves) noexcept;
 };
 
 #endif
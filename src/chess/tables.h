@@ -0,0 +1,163 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TABLES__
+#define __TABLES__
+
+#include <cstdint>
+#include <initializer_list>
+
+#include "chess.h"
+
+/*!
+ *  @struct AttackTables
+ *  @brief Step attacks and square geometry, indexed by 0..63 squares.
+ *
+ *  Generated at compile time like the Zobrist keys, so they cost nothing
+ *  at startup and can be used in constant expressions. Step targets come
+ *  both as lists of mailbox squares, for the move generators, and as 64-bit
+ *  sets, for set operations. Colour indices are black first, as in Board.
+ */
+struct AttackTables {
+  //! Mailbox offsets of the knight steps, in move generation order.
+  static constexpr int KNIGHT_STEPS[8] = {-21, -19, -8, -12, 8, 12, 21, 19};
+
+  //! Mailbox offsets of the king steps, which are also the ray directions.
+  static constexpr int KING_STEPS[8] = {-11, -10, -9, -1, 1, 9, 10, 11};
+
+  BoardSquare knight[64][8];        //!< Knight targets, mailbox squares.
+  unsigned char knightCount[64];    //!< Number of knight targets.
+  BoardSquare king[64][8];          //!< King targets, mailbox squares.
+  unsigned char kingCount[64];      //!< Number of king targets.
+  BoardSquare pawn[2][64][2];       //!< Pawn capture targets.
+  unsigned char pawnCount[2][64];   //!< Number of pawn capture targets.
+  std::uint64_t knightMask[64];     //!< Knight targets as a set.
+  std::uint64_t kingMask[64];       //!< King targets as a set.
+  std::uint64_t pawnMask[2][64];    //!< Pawn capture targets as a set.
+  std::uint64_t between[64][64];    //!< Squares strictly between aligned ones.
+  std::uint64_t line[64][64];       //!< Whole line through aligned squares.
+  std::uint64_t ray[64][64];        //!< From the first towards the second on.
+  signed char direction[64][64];    //!< Mailbox step from the first on.
+  unsigned char distance[64][64];   //!< King moves from one to the other.
+
+  constexpr AttackTables()
+    : knight()
+    , knightCount()
+    , king()
+    , kingCount()
+    , pawn()
+    , pawnCount()
+    , knightMask()
+    , kingMask()
+    , pawnMask()
+    , between()
+    , line()
+    , ray()
+    , direction()
+    , distance()
+  {
+    for (unsigned int sqr = 0; sqr < 64; ++sqr) {
+      const int from = toMailbox(sqr);
+      for (const int step : KNIGHT_STEPS) {
+        if (fromMailbox(from + step) < 64) {
+          knight[sqr][knightCount[sqr]++] = from + step;
+          knightMask[sqr] |= bit(fromMailbox(from + step));
+        }
+      }
+      for (const int step : KING_STEPS) {
+        if (fromMailbox(from + step) < 64) {
+          king[sqr][kingCount[sqr]++] = from + step;
+          kingMask[sqr] |= bit(fromMailbox(from + step));
+        }
+      }
+      // White pawns capture towards the 8th rank.
+      for (unsigned int white = 0; white < 2; ++white) {
+        for (const int step : {-1, 1}) {
+          const int to = from + (white? -10 : 10) + step;
+          if (fromMailbox(to) < 64) {
+            pawn[white][sqr][pawnCount[white][sqr]++] = to;
+            pawnMask[white][sqr] |= bit(fromMailbox(to));
+          }
+        }
+      }
+    }
+
+    for (unsigned int a = 0; a < 64; ++a) {
+      for (unsigned int b = 0; b < 64; ++b) {
+        const int files = int(b % 8) - int(a % 8);
+        const int rows = int(b / 8) - int(a / 8);
+        distance[a][b] = max(abs(files), abs(rows));
+        if (a == b || (files && rows && abs(files) != abs(rows))) {
+          continue;
+        }
+
+        // One step along the line in mailbox terms, then walk it.
+        const int forward = sign(rows) * 10 + sign(files);
+        direction[a][b] = forward;
+        for (int sqr = toMailbox(a) + forward; sqr != toMailbox(b);
+             sqr += forward)
+        {
+          between[a][b] |= bit(fromMailbox(sqr));
+        }
+        for (int sqr = toMailbox(a) + forward; fromMailbox(sqr) < 64;
+             sqr += forward)
+        {
+          ray[a][b] |= bit(fromMailbox(sqr));
+        }
+        line[a][b] = bit(a) | ray[a][b];
+        for (int sqr = toMailbox(a) - forward; fromMailbox(sqr) < 64;
+             sqr -= forward)
+        {
+          line[a][b] |= bit(fromMailbox(sqr));
+        }
+      }
+    }
+  }
+
+  //! Returns the set holding one 0..63 square.
+  static constexpr std::uint64_t bit(const unsigned int sqr) {
+    return std::uint64_t(1) << sqr;
+  }
+
+private:
+  static constexpr int abs(const int x) {
+    return x < 0? -x : x;
+  }
+
+  static constexpr int max(const int a, const int b) {
+    return a < b? b : a;
+  }
+
+  static constexpr int sign(const int x) {
+    return (x > 0) - (x < 0);
+  }
+};
+
+//! The tables used by every generator.
+inline constexpr AttackTables ATTACKS;
+
+static_assert(ATTACKS.knightCount[0] == 2 && ATTACKS.kingCount[27] == 8,
+              "Step tables are off");
+static_assert(ATTACKS.between[0][63] == 0x0040201008040200ULL,
+              "Between masks are off");
+static_assert(ATTACKS.ray[0][9] == 0x8040201008040200ULL &&
+              ATTACKS.direction[63][0] == -11, "Rays are off");
+static_assert(ATTACKS.distance[0][63] == 7 && ATTACKS.distance[9][18] == 1,
+              "Distances are off");
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ZOBRIST__
+#define __ZOBRIST__
+
+#include <cstdint>
+
+/*!
+ *  @struct ZobristKeys
+ *  @brief Random keys hashed into a position's Zobrist key.
+ *
+ *  Generated at compile time with splitmix64, so keys are the same on
+ *  every build and cost nothing at startup.
+ */
+struct ZobristKeys {
+  std::uint64_t pieces[12][64]; //!< Per piece code ("PNBRQKpnbrqk") and square.
+  std::uint64_t castle[16];     //!< Per castling rights mask.
+  std::uint64_t enPass[8];      //!< Per en-passant file.
+  std::uint64_t side;           //!< Hashed in when black is to move.
+  std::uint64_t material[12][16]; //!< Per piece code and count below it.
+
+  constexpr ZobristKeys()
+    : pieces()
+    , castle()
+    , enPass()
+    , side()
+    , material()
+  {
+    std::uint64_t state = 0x4E656C6C79ULL; // "Nelly"
+    auto next = [&state]() {
+      std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      return z ^ (z >> 31);
+    };
+    for (auto& piece : pieces) {
+      for (std::uint64_t& key : piece) {
+        key = next();
+      }
+    }
+    for (std::uint64_t& key : castle) {
+      key = next();
+    }
+    for (std::uint64_t& key : enPass) {
+      key = next();
+    }
+    side = next();
+    // Drawn last, so that the keys above stay what they always were.
+    for (auto& piece : material) {
+      for (std::uint64_t& key : piece) {
+        key = next();
+      }
+    }
+  }
+
+  //! Returns the key of a piece notation on a 0..63 square.
+  constexpr std::uint64_t piece(const char piece,
+                                const unsigned int sqr) const {
+    return pieces[pieceIndex(piece)][sqr];
+  }
+
+  //! Returns the index of a piece notation in "PNBRQKpnbrqk".
+  static constexpr unsigned int pieceIndex(const char piece) {
+    switch (piece) {
+      case 'P': return 0;
+      case 'N': return 1;
+      case 'B': return 2;
+      case 'R': return 3;
+      case 'Q': return 4;
+      case 'K': return 5;
+      case 'p': return 6;
+      case 'n': return 7;
+      case 'b': return 8;
+      case 'r': return 9;
+      case 'q': return 10;
+      default: return 11;
+    }
+  }
+};
+
+//! The keys used by every Board.
+inline constexpr ZobristKeys ZOBRIST;
+
+#endif
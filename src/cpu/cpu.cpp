@@ -0,0 +1,156 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpu.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if NELLY_HAS_TIERS
+#include <cpuid.h>
+#endif
+
+/*!
+ *  @struct Features
+ *  @brief Processor features relevant to the tiers.
+ */
+struct Features {
+  bool popcnt = false;
+  bool sse42 = false;
+  bool avx2 = false;
+  bool bmi1 = false;
+  bool bmi2 = false;
+  bool avx512 = false;
+  std::string vendor;
+  unsigned int family = 0;
+};
+
+//! Queries cpuid, and xgetbv for the register state the OS saves.
+static Features query() noexcept {
+  Features features;
+#if NELLY_HAS_TIERS
+  unsigned int a, b, c, d;
+  if (!__get_cpuid(0, &a, &b, &c, &d)) {
+    return features;
+  }
+  const unsigned int maxLeaf = a;
+  char vendor[13] = {};
+  reinterpret_cast<unsigned int*>(vendor)[0] = b;
+  reinterpret_cast<unsigned int*>(vendor)[1] = d;
+  reinterpret_cast<unsigned int*>(vendor)[2] = c;
+  features.vendor = vendor;
+
+  __get_cpuid(1, &a, &b, &c, &d);
+  features.family = (a >> 8 & 0xF) == 0xF? (a >> 8 & 0xF) + (a >> 20 & 0xFF)
+                                         : (a >> 8 & 0xF);
+  features.popcnt = c & bit_POPCNT;
+  features.sse42 = c & bit_SSE4_2;
+
+  std::uint64_t xcr0 = 0;
+  if (c & bit_OSXSAVE) {
+    unsigned int low, high;
+    __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    xcr0 = std::uint64_t(high) << 32 | low;
+  }
+  const bool osAvx = (c & bit_AVX) && (xcr0 & 0x6) == 0x6;
+  const bool osAvx512 = osAvx && (xcr0 & 0xE0) == 0xE0;
+
+  if (maxLeaf >= 7) {
+    __cpuid_count(7, 0, a, b, c, d);
+    features.avx2 = osAvx && (b & bit_AVX2);
+    features.bmi1 = b & bit_BMI;
+    features.bmi2 = b & bit_BMI2;
+    features.avx512 = osAvx512 && (b & bit_AVX512F) && (b & bit_AVX512BW);
+  }
+#endif
+  return features;
+}
+
+//! Picks the best tier the features allow.
+static Cpu::Tier bestTier(const Features& features) noexcept {
+  if (!features.popcnt || !features.sse42 || !features.avx2 ||
+      !features.bmi1)
+  {
+    return Cpu::Tier::Generic;
+  }
+  return features.avx512 && features.bmi2? Cpu::Tier::Avx512
+                                          : Cpu::Tier::Avx2;
+}
+
+static const Features FEATURES = query();
+static const Cpu::Tier DETECTED = bestTier(FEATURES);
+static std::atomic<Cpu::Tier> s_tier(DETECTED);
+
+static constexpr const char* NAMES[] = {
+  "generic", "avx2", "avx512"
+};
+
+Cpu::Tier Cpu::getDetected() noexcept {
+  return DETECTED;
+}
+
+Cpu::Tier Cpu::getTier() noexcept {
+  return s_tier.load(std::memory_order_relaxed);
+}
+
+bool Cpu::setTier(const Tier tier) noexcept {
+  if (tier > DETECTED) {
+    return false;
+  }
+  s_tier.store(tier, std::memory_order_relaxed);
+  return true;
+}
+
+const char* Cpu::getName(const Tier tier) noexcept {
+  return tier < Tier::Count? NAMES[int(tier)] : "unknown";
+}
+
+bool Cpu::parseTier(const std::string& name, Tier& r_tier) noexcept {
+  for (unsigned int i = 0; i < unsigned(Tier::Count); ++i) {
+    if (name == NAMES[i]) {
+      r_tier = Tier(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string Cpu::describe() noexcept {
+  std::string text = FEATURES.vendor.empty()? "unknown" : FEATURES.vendor;
+  text += " family " + std::to_string(FEATURES.family) + ":";
+  if (FEATURES.popcnt) {
+    text += " popcnt";
+  }
+  if (FEATURES.sse42) {
+    text += " sse4.2";
+  }
+  if (FEATURES.avx2) {
+    text += " avx2";
+  }
+  if (FEATURES.bmi1) {
+    text += " bmi1";
+  }
+  if (FEATURES.bmi2) {
+    text += " bmi2";
+  }
+  if (FEATURES.avx512) {
+    text += " avx512";
+  }
+  return text;
+}
@@ -0,0 +1,94 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CPU__
+#define __CPU__
+
+#include <string>
+
+/*!
+ *  @brief Target attribute of a kernel variant, empty off x86.
+ *
+ *  Kernels are written once as always_inline bodies and wrapped by one
+ *  function per tier carrying the matching attribute, so that all variants
+ *  live in the same binary and only the wrappers use the wider ISA.
+ */
+#if defined(__x86_64__)
+#define NELLY_TARGET(isa) __attribute__((target(isa)))
+#define NELLY_HAS_TIERS 1
+#else
+#define NELLY_TARGET(isa)
+#define NELLY_HAS_TIERS 0
+#endif
+
+//! Target strings of the tiers above Generic.
+#define NELLY_ISA_AVX2 "popcnt,sse4.2,avx2,bmi"
+#define NELLY_ISA_AVX512 "popcnt,sse4.2,avx2,bmi,bmi2,avx512f,avx512bw"
+
+/*!
+ *  @class Cpu
+ *  @brief Instruction set detection and kernel tier selection.
+ *
+ *  The processor is queried with cpuid once at startup and the best tier
+ *  it supports becomes active. Kernels with several variants look the
+ *  active tier up on every call, so it can be lowered at any time between
+ *  searches to test the slower paths.
+ */
+class Cpu {
+public:
+  /*!
+   *  @enum Tier
+   *  @brief Kernel variants, each one including the ones below.
+   *
+   *  There is one tier per kernel width; POPCNT and BMI2 alone make no
+   *  kernel faster, so they come with the tiers rather than as their own.
+   */
+  enum class Tier : unsigned char
+  {
+    Generic, //!< Baseline x86-64 or any other architecture.
+    Avx2,    //!< AVX2, BMI1, SSE4.2 and POPCNT.
+    Avx512,  //!< AVX-512 F and BW, with BMI2.
+
+    Count
+  };
+
+public:
+  //! Returns the best tier the processor and OS support.
+  static Tier getDetected() noexcept;
+
+  //! Returns the tier kernels currently use.
+  static Tier getTier() noexcept;
+
+  /*!
+   *  @brief Selects the tier kernels use.
+   *
+   *  @return False, leaving the tier unchanged, if it isn't supported.
+   */
+  static bool setTier(const Tier tier) noexcept;
+
+  //! Returns the lowercase name of a tier.
+  static const char* getName(const Tier tier) noexcept;
+
+  //! Parses a tier name, returning false if it is unknown.
+  static bool parseTier(const std::string& name, Tier& r_tier) noexcept;
+
+  //! Describes the processor features found, for logging.
+  static std::string describe() noexcept;
+};
+
+#endif
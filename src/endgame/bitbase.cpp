@@ -0,0 +1,412 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bitbase.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/chess.h"
+#include "../chess/tables.h"
+
+//! Number of positions in one bitbase: side to move, two kings, one piece.
+static constexpr unsigned int TABLE_SIZE = 2 * 64 * 64 * 64;
+
+//! Number of endings.
+static constexpr unsigned int ENDINGS =
+    static_cast<unsigned int>(Bitbase::Ending::Count);
+
+//! One bit per position, set if white wins.
+static std::uint64_t s_bits[ENDINGS][TABLE_SIZE / 64];
+
+//! Generation time of every ending in milliseconds.
+static double s_genTime[ENDINGS];
+
+static bool s_ready = false;
+
+//! Position state during generation.
+enum : unsigned char { UNKNOWN, WIN, DRAW, INVALID };
+
+//! Mailbox offsets of the rook rays.
+static constexpr int ROOK_RAYS[4] = {
+  -int(Board::WIDTH), -1, 1, int(Board::WIDTH)
+};
+
+//! Mailbox offsets of the bishop rays.
+static constexpr int BISHOP_RAYS[4] = {
+  -int(Board::WIDTH) - 1, -int(Board::WIDTH) + 1,
+  int(Board::WIDTH) - 1, int(Board::WIDTH) + 1
+};
+
+//! Checks if the mailbox square lies on the inner 8x8 area.
+static constexpr bool onBoard(const int sqr) {
+  return sqr > int(2 * Board::WIDTH) && sqr < int(10 * Board::WIDTH) &&
+         sqr % Board::WIDTH != 0 && sqr % Board::WIDTH != 9;
+}
+
+static constexpr std::uint64_t bit(const unsigned int sqr) {
+  return std::uint64_t(1) << sqr;
+}
+
+//! Returns the table index of a position.
+static constexpr unsigned int index(const bool whiteToMove,
+                                    const unsigned int wk,
+                                    const unsigned int bk,
+                                    const unsigned int piece) {
+  return ((unsigned(whiteToMove) * 64 + wk) * 64 + bk) * 64 + piece;
+}
+
+/*!
+ *  @class Generator
+ *  @brief Iterative retrograde solver for one K+X vs K ending.
+ *
+ *  Every pass re-examines the unresolved positions until nothing changes.
+ *  White positions are wins as soon as one move wins, black positions are
+ *  draws as soon as one move draws. Whatever is left unresolved is a draw.
+ */
+class Generator {
+  Bitbase::Ending m_ending;
+  std::vector<unsigned char> m_res;
+
+public:
+  explicit Generator(const Bitbase::Ending ending)
+    : m_ending(ending)
+    , m_res(TABLE_SIZE, UNKNOWN)
+  {}
+
+  //! Solves the ending and stores the result in s_bits.
+  void run() noexcept {
+    for (unsigned int idx = 0; idx < TABLE_SIZE; ++idx) {
+      if (!isLegal(idx)) {
+        m_res[idx] = INVALID;
+      }
+    }
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (unsigned int idx = 0; idx < TABLE_SIZE; ++idx) {
+        if (m_res[idx] != UNKNOWN) {
+          continue;
+        }
+        const unsigned char res = classify(idx);
+        if (res != UNKNOWN) {
+          m_res[idx] = res;
+          changed = true;
+        }
+      }
+    }
+
+    std::uint64_t* bits = s_bits[static_cast<unsigned int>(m_ending)];
+    for (unsigned int idx = 0; idx < TABLE_SIZE; ++idx) {
+      if (m_res[idx] == WIN) {
+        bits[idx / 64] |= bit(idx % 64);
+      }
+    }
+  }
+
+private:
+  //! Squares attacked by the white piece, with 'occ' blocking sliders.
+  std::uint64_t pieceAttacks(const unsigned int piece,
+                             const std::uint64_t occ) const noexcept {
+    if (m_ending == Bitbase::Ending::KPK) {
+      return ATTACKS.pawnMask[true][piece];
+    }
+    const int from = toMailbox(piece);
+
+    std::uint64_t att = slide(from, ROOK_RAYS, occ);
+    if (m_ending == Bitbase::Ending::KQK) {
+      att |= slide(from, BISHOP_RAYS, occ);
+    }
+    return att;
+  }
+
+  static std::uint64_t slide(const int from, const int (&rays)[4],
+                             const std::uint64_t occ) noexcept {
+    std::uint64_t att = 0;
+    for (const int ray : rays) {
+      for (int sqr = from + ray; onBoard(sqr); sqr += ray) {
+        att |= bit(fromMailbox(sqr));
+        if (occ & bit(fromMailbox(sqr))) {
+          break;
+        }
+      }
+    }
+    return att;
+  }
+
+  bool isLegal(const unsigned int idx) const noexcept {
+    const bool wtm = idx / (64 * 64 * 64);
+    const unsigned int wk = idx / (64 * 64) % 64;
+    const unsigned int bk = idx / 64 % 64;
+    const unsigned int piece = idx % 64;
+
+    if (wk == bk || wk == piece || bk == piece) {
+      return false;
+    }
+    if (ATTACKS.kingMask[wk] & bit(bk)) {
+      return false;
+    }
+    if (m_ending == Bitbase::Ending::KPK && (piece < 8 || piece >= 56)) {
+      return false;
+    }
+    // The side not to move can't be in check.
+    return !wtm || !(pieceAttacks(piece, bit(wk) | bit(bk)) & bit(bk));
+  }
+
+  unsigned char classify(const unsigned int idx) const noexcept {
+    const bool wtm = idx / (64 * 64 * 64);
+    const unsigned int wk = idx / (64 * 64) % 64;
+    const unsigned int bk = idx / 64 % 64;
+    const unsigned int piece = idx % 64;
+    return wtm ? classifyWhite(wk, bk, piece) : classifyBlack(wk, bk, piece);
+  }
+
+  //! Looks up a successor. Promotions are resolved in the finished tables.
+  unsigned char lookup(const bool wtm, const unsigned int wk,
+                       const unsigned int bk,
+                       const unsigned int piece) const noexcept {
+    return m_res[index(wtm, wk, bk, piece)];
+  }
+
+  unsigned char classifyWhite(const unsigned int wk, const unsigned int bk,
+                              const unsigned int piece) const noexcept {
+    bool allDraw = true;
+    bool anyMove = false;
+    auto visit = [&](const unsigned char res) {
+      anyMove = true;
+      allDraw &= res == DRAW;
+      return res == WIN;
+    };
+
+    std::uint64_t kingTargets = ATTACKS.kingMask[wk] & ~ATTACKS.kingMask[bk];
+    kingTargets &= ~bit(piece);
+    for (; kingTargets; kingTargets &= kingTargets - 1) {
+      const unsigned int to = __builtin_ctzll(kingTargets);
+      if (visit(lookup(false, to, bk, piece))) {
+        return WIN;
+      }
+    }
+
+    if (m_ending == Bitbase::Ending::KPK) {
+      const unsigned int push = piece - 8;
+      if (push != wk && push != bk) {
+        if (push < 8) {
+          // Promotion: under-promotions never win more than these two.
+          const bool win =
+              Bitbase::isWin(Bitbase::Ending::KQK, false, wk, bk, push) ||
+              Bitbase::isWin(Bitbase::Ending::KRK, false, wk, bk, push);
+          if (visit(win ? WIN : DRAW)) {
+            return WIN;
+          }
+        } else {
+          if (visit(lookup(false, wk, bk, push))) {
+            return WIN;
+          }
+          const unsigned int dbl = piece - 16;
+          if (piece >= 48 && dbl != wk && dbl != bk &&
+              visit(lookup(false, wk, bk, dbl)))
+          {
+            return WIN;
+          }
+        }
+      }
+    } else {
+      std::uint64_t targets = pieceAttacks(piece, bit(wk) | bit(bk));
+      targets &= ~(bit(wk) | bit(bk));
+      for (; targets; targets &= targets - 1) {
+        const unsigned int to = __builtin_ctzll(targets);
+        if (visit(lookup(false, wk, bk, to))) {
+          return WIN;
+        }
+      }
+    }
+
+    // No moves at all is a stalemate.
+    return (allDraw || !anyMove) ? DRAW : UNKNOWN;
+  }
+
+  unsigned char classifyBlack(const unsigned int wk, const unsigned int bk,
+                              const unsigned int piece) const noexcept {
+    // Attacks through the black king, so it can't hide on its own ray.
+    const std::uint64_t attacked =
+        ATTACKS.kingMask[wk] | pieceAttacks(piece, bit(wk) | bit(piece));
+    const bool inCheck = pieceAttacks(piece, bit(wk) | bit(bk)) & bit(bk);
+
+    bool allWin = true;
+    bool anyMove = false;
+    for (std::uint64_t targets = ATTACKS.kingMask[bk]; targets;
+         targets &= targets - 1)
+    {
+      const unsigned int to = __builtin_ctzll(targets);
+      if (to == piece) {
+        if (!(ATTACKS.kingMask[wk] & bit(piece))) {
+          return DRAW; // Bare kings.
+        }
+        continue;
+      }
+      if (attacked & bit(to)) {
+        continue;
+      }
+
+      anyMove = true;
+      const unsigned char res = lookup(true, wk, to, piece);
+      if (res == DRAW) {
+        return DRAW;
+      }
+      allWin &= res == WIN;
+    }
+
+    if (!anyMove) {
+      return inCheck ? WIN : DRAW;
+    }
+    return allWin ? WIN : UNKNOWN;
+  }
+};
+
+void Bitbase::init() noexcept {
+  if (s_ready) {
+    return;
+  }
+
+  // KPK resolves promotions through the other two, so it goes last.
+  for (const Ending ending : {Ending::KQK, Ending::KRK, Ending::KPK}) {
+    const auto start = std::chrono::steady_clock::now();
+    Generator(ending).run();
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    s_genTime[static_cast<unsigned int>(ending)] = elapsed.count();
+  }
+
+  s_ready = true;
+}
+
+bool Bitbase::isReady() noexcept {
+  return s_ready;
+}
+
+bool Bitbase::isWin(const Ending ending, const bool whiteToMove,
+                    const unsigned int wk, const unsigned int bk,
+                    const unsigned int piece) noexcept
+{
+  const unsigned int idx = index(whiteToMove, wk, bk, piece);
+  return s_bits[static_cast<unsigned int>(ending)][idx / 64] >> (idx % 64) & 1;
+}
+
+Bitbase::Result Bitbase::probe(const Board& board) noexcept {
+  if (!s_ready || board.getPieceCount() != 3) {
+    return Result::Unknown;
+  }
+
+  BoardSquare kings[2] = {0, 0}; // Black, white.
+  BoardSquare pieceSqr = 0;
+  char piece = ' ';
+  for (unsigned int i = 0; i < 3; ++i) {
+    const BoardSquare sqr = board.getPieceSquare(i);
+    if (board.isKing(sqr)) {
+      kings[board.isWhite(sqr)] = sqr;
+    } else {
+      pieceSqr = sqr;
+      piece = board.getVal(sqr);
+    }
+  }
+
+  Ending ending;
+  switch (piece) {
+    case 'P':
+    case 'p':
+      ending = Ending::KPK;
+      break;
+    case 'R':
+    case 'r':
+      ending = Ending::KRK;
+      break;
+    case 'Q':
+    case 'q':
+      ending = Ending::KQK;
+      break;
+    default:
+      return Result::Unknown;
+  }
+
+  // Mirror ranks so that the strong side becomes white.
+  const bool strongIsWhite = board.isWhite(pieceSqr);
+  const unsigned int flip = strongIsWhite ? 0 : 56;
+  const unsigned int wk = fromMailbox(kings[strongIsWhite]) ^ flip;
+  const unsigned int bk = fromMailbox(kings[!strongIsWhite]) ^ flip;
+  const unsigned int sqr = fromMailbox(pieceSqr) ^ flip;
+  if (ending == Ending::KPK && (sqr < 8 || sqr >= 56)) {
+    return Result::Unknown;
+  }
+
+  const bool strongToMove = board.isWhitesMove() == strongIsWhite;
+  if (!isWin(ending, strongToMove, wk, bk, sqr)) {
+    return Result::Draw;
+  }
+  return strongToMove ? Result::Win : Result::Loss;
+}
+
+void Bitbase::benchmark() noexcept {
+  init();
+
+  static const char* const NAMES[ENDINGS] = {"KPK", "KRK", "KQK"};
+  for (unsigned int e = 0; e < ENDINGS; ++e) {
+    unsigned int wins[2] = {0, 0};
+    for (unsigned int idx = 0; idx < TABLE_SIZE; ++idx) {
+      wins[idx / (TABLE_SIZE / 2)] += s_bits[e][idx / 64] >> (idx % 64) & 1;
+    }
+    Logger::info(std::string(NAMES[e]) + ": generated in " +
+                 std::to_string(s_genTime[e]) + " ms, wins (btm/wtm): " +
+                 std::to_string(wins[0]) + "/" + std::to_string(wins[1]));
+  }
+
+  // Raw probes over pseudo-random indices.
+  constexpr unsigned int PROBES = 50'000'000;
+  std::uint32_t seed = 0x9E3779B9;
+  unsigned int hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < PROBES; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    const unsigned int idx = seed >> 13;
+    hits += isWin(static_cast<Ending>(i % ENDINGS), idx >> 18,
+                  idx >> 12 & 63, idx >> 6 & 63, idx & 63);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  Logger::info("Raw probe: " + std::to_string(elapsed.count() / PROBES) +
+               " ns (" + std::to_string(hits) + " wins)");
+
+  // Board probes, which include finding the pieces.
+  Board boards[3];
+  boards[0].loadFen("8/8/8/4k3/8/8/4P3/4K3 w - - 0 1");
+  boards[1].loadFen("8/8/3k4/8/8/8/8/R3K3 b - - 0 1");
+  boards[2].loadFen("8/8/8/8/2q5/8/4k3/7K w - - 0 1");
+  int sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < PROBES; ++i) {
+    sum += static_cast<int>(probe(boards[i % 3]));
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  Logger::info("Board probe: " + std::to_string(elapsed.count() / PROBES) +
+               " ns (checksum " + std::to_string(sum) + ")");
+}
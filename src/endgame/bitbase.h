@@ -0,0 +1,102 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BITBASE__
+#define __BITBASE__
+
+#include "../chess/chess.h"
+
+class Board;
+
+/*!
+ *  @class Bitbase
+ *  @brief Win/draw bitbases for small endgames built by retrograde analysis.
+ *
+ *  Covers KPK, KRK and KQK. The side owning the extra piece is always
+ *  normalised to white, and since a lone king can never win, one bit per
+ *  position (win or not) is enough. Each table is 2 * 64^3 bits (64 KiB).
+ *
+ *  Squares passed to the raw probe are 0..63 indices, a8 = 0 and h1 = 63,
+ *  which is the same row-major order Board uses for its inner 8x8 area.
+ */
+class Bitbase {
+public:
+  /*!
+   *  @enum Ending
+   *  @brief Endings covered by the bitbases.
+   */
+  enum class Ending : unsigned char
+  {
+    KPK,
+    KRK,
+    KQK,
+
+    Count
+  };
+
+  /*!
+   *  @enum Result
+   *  @brief Probe result from the side to move's point of view.
+   */
+  enum class Result : signed char
+  {
+    Loss = -1,
+    Draw = 0,
+    Win = 1,
+
+    Unknown = 2 //!< Position is not covered by any bitbase.
+  };
+
+public:
+  /*!
+   *  @brief Generates all bitbases.
+   *
+   *  Runs once, further calls are no-ops. Must be called before probing.
+   */
+  static void init() noexcept;
+
+  //! Returns true once init() has finished.
+  static bool isReady() noexcept;
+
+  /*!
+   *  @brief Raw probe with white as the strong side.
+   *
+   *  @param ending Which bitbase to look into.
+   *  @param whiteToMove Side to move.
+   *  @param wk White king square (0..63).
+   *  @param bk Black king square (0..63).
+   *  @param piece White piece square (0..63).
+   *  @return True if white wins, false if it is a draw.
+   */
+  static bool isWin(const Ending ending, const bool whiteToMove,
+                    const unsigned int wk, const unsigned int bk,
+                    const unsigned int piece) noexcept;
+
+  /*!
+   *  @brief Probes the bitbases for the given board.
+   *
+   *  Walks the piece list, so the cost does not depend on the board size.
+   *  @return Unknown if the material is not covered.
+   */
+  static Result probe(const Board& board) noexcept;
+
+  //! Measures generation time and probe cost, logging the results.
+  static void benchmark() noexcept;
+};
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/packed.h"
+#include "../endgame/bitbase.h"
+#include "eval.h"
+
+/*!
+ *  @brief Runs 'work(first, last)' over [0, count) split across threads.
+ *
+ *  Slices start on multiples of 'grain', so batches stay whole.
+ */
+template <typename Work>
+static void parallel(const unsigned int threads, const std::size_t count,
+                     const std::size_t grain, Work&& work) noexcept
+{
+  const std::size_t grains = (count + grain - 1) / grain;
+  auto slice = [&](const unsigned int id) {
+    work(std::min(grains * id / threads * grain, count),
+         std::min(grains * (id + 1) / threads * grain, count));
+  };
+
+  std::vector<std::thread> helpers;
+  for (unsigned int id = 1; id < threads; ++id) {
+    helpers.emplace_back(slice, id);
+  }
+  slice(0);
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+}
+
+//! Returns the seconds elapsed since 'start'.
+static double since(const std::chrono::steady_clock::time_point& start)
+    noexcept
+{
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+//! Returns positions per second, 0 if nothing was timed.
+static double rate(const std::uint64_t positions, const double seconds)
+    noexcept
+{
+  return seconds > 0? positions / seconds : 0;
+}
+
+BatchEval::BatchEval(const BatchConfig& config)
+  : m_config(config)
+{
+  if (!m_config.threads) {
+    m_config.threads = 1;
+  }
+  if (!m_config.chunk) {
+    m_config.chunk = 1;
+  }
+}
+
+bool BatchEval::run(const std::string& input, const std::string& output,
+                    BatchStats& r_stats) const noexcept
+{
+  std::ifstream file(input);
+  if (!file) {
+    Logger::error("Cannot open " + input);
+    return false;
+  }
+  std::ofstream out;
+  if (!output.empty()) {
+    out.open(output);
+    if (!out) {
+      Logger::error("Cannot open " + output);
+      return false;
+    }
+  }
+
+  Bitbase::init();
+  r_stats = BatchStats();
+  const unsigned int threads = m_config.threads;
+  std::vector<std::string> lines;
+  std::vector<PackedBoard> packed;
+  std::vector<char> isPosition;
+  std::vector<PackedBoard> positions;
+  std::vector<std::size_t> rows;
+  std::vector<int> scores;
+  std::vector<int> singles;
+  std::vector<Board> boards;
+  std::string line;
+  while (true) {
+    lines.clear();
+    while (lines.size() < m_config.chunk && std::getline(file, line)) {
+      lines.push_back(std::move(line));
+    }
+    if (lines.empty()) {
+      break;
+    }
+
+    // Packed in place, then gathered so that the batches hold no gaps.
+    auto start = std::chrono::steady_clock::now();
+    packed.resize(lines.size());
+    isPosition.assign(lines.size(), false);
+    parallel(threads, lines.size(), 1,
+        [&](const std::size_t first, const std::size_t last) {
+          for (std::size_t i = first; i < last; ++i) {
+            isPosition[i] = PackedBoard::fromFen(lines[i], packed[i]);
+          }
+        });
+    positions.clear();
+    rows.clear();
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+      if (isPosition[i]) {
+        positions.push_back(packed[i]);
+        rows.push_back(i);
+      } else {
+        r_stats.skipped += !lines[i].empty();
+      }
+    }
+    r_stats.parseSeconds += since(start);
+
+    start = std::chrono::steady_clock::now();
+    scores.resize(positions.size());
+    parallel(threads, positions.size(), Eval::BATCH,
+        [&](const std::size_t first, const std::size_t last) {
+          Eval::evaluate(positions.data() + first, last - first,
+                         scores.data() + first);
+        });
+    r_stats.batchSeconds += since(start);
+
+    if (m_config.compare) {
+      start = std::chrono::steady_clock::now();
+      singles.resize(positions.size());
+      parallel(threads, positions.size(), 1,
+          [&](const std::size_t first, const std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+              singles[i] = Eval::evaluate(positions[i].toBoard());
+            }
+          });
+      r_stats.scalarSeconds += since(start);
+      for (std::size_t i = 0; i < positions.size(); ++i) {
+        r_stats.mismatches += singles[i] != scores[i];
+      }
+
+      // The scalar evaluation alone, on boards unpacked beforehand.
+      boards.resize(positions.size());
+      parallel(threads, positions.size(), 1,
+          [&](const std::size_t first, const std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+              boards[i] = positions[i].toBoard();
+            }
+          });
+      start = std::chrono::steady_clock::now();
+      parallel(threads, boards.size(), 1,
+          [&](const std::size_t first, const std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+              singles[i] = Eval::evaluate(boards[i]);
+            }
+          });
+      r_stats.boardSeconds += since(start);
+    }
+
+    if (out.is_open()) {
+      for (std::size_t i = 0; i < positions.size(); ++i) {
+        out << lines[rows[i]] << ' ' << scores[i] << '\n';
+      }
+    }
+    r_stats.positions += positions.size();
+  }
+
+  if (out.is_open() && !out.flush()) {
+    Logger::error("Cannot write " + output);
+    return false;
+  }
+
+  Logger::info("Scored " + std::to_string(r_stats.positions) +
+               " positions (" + std::to_string(r_stats.skipped) +
+               " lines skipped) with " + std::to_string(threads) +
+               " threads");
+  char report[160];
+  std::snprintf(report, sizeof(report),
+                "Parsing %.0f, batch %.0f positions/s",
+                rate(r_stats.positions, r_stats.parseSeconds),
+                rate(r_stats.positions, r_stats.batchSeconds));
+  Logger::info(report);
+  if (m_config.compare) {
+    std::snprintf(report, sizeof(report),
+                  "One at a time %.0f positions/s, batch speedup %.2fx",
+                  rate(r_stats.positions, r_stats.scalarSeconds),
+                  r_stats.batchSeconds > 0?
+                      r_stats.scalarSeconds / r_stats.batchSeconds : 0);
+    Logger::info(report + (", " + std::to_string(r_stats.mismatches)) +
+                 " mismatches");
+    std::snprintf(report, sizeof(report),
+                  "Unpacked boards %.0f positions/s, batch speedup %.2fx",
+                  rate(r_stats.positions, r_stats.boardSeconds),
+                  r_stats.batchSeconds > 0?
+                      r_stats.boardSeconds / r_stats.batchSeconds : 0);
+    Logger::info(report);
+  }
+  return true;
+}
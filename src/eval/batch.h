@@ -0,0 +1,83 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BATCH__
+#define __BATCH__
+
+#include <cstdint>
+#include <string>
+
+/*!
+ *  @struct BatchConfig
+ *  @brief Parameters of a batch evaluation run.
+ */
+struct BatchConfig {
+  unsigned int threads = 1;     //!< Threads parsing and evaluating.
+  unsigned int chunk = 1 << 16; //!< Lines read and scored at a time.
+  bool compare = true;          //!< Also scores one position at a time.
+};
+
+/*!
+ *  @struct BatchStats
+ *  @brief Totals of a batch evaluation run.
+ */
+struct BatchStats {
+  std::uint64_t positions = 0;  //!< Positions scored.
+  std::uint64_t skipped = 0;    //!< Non-empty lines without a position.
+  std::uint64_t mismatches = 0; //!< Batch and single scores that differ.
+  double parseSeconds = 0;      //!< Wall time packing the FENs.
+  double batchSeconds = 0;      //!< Wall time of the batch evaluation.
+  double scalarSeconds = 0;     //!< Wall time unpacking and scoring singly.
+  double boardSeconds = 0;      //!< Wall time scoring unpacked boards.
+};
+
+/*!
+ *  @class BatchEval
+ *  @brief Multi-threaded static evaluation of a file of positions.
+ *
+ *  The file holds a FEN per line, possibly followed by more text such as
+ *  a result. Lines are read a chunk at a time; the threads pack their
+ *  share of the chunk with PackedBoard::fromFen and then score their
+ *  share of the positions with the packed Eval::evaluate() overload, in
+ *  slices of whole Eval::BATCH blocks. When comparing, the same positions
+ *  are also unpacked and scored one at a time, as a caller without the
+ *  batch API would, and the scalar evaluation is timed alone on the
+ *  unpacked boards, so that all three throughputs can be reported.
+ */
+class BatchEval {
+  BatchConfig m_config; //!< Run parameters.
+
+public:
+  //! Prepares a run with the given parameters.
+  explicit BatchEval(const BatchConfig& config);
+
+public:
+  /*!
+   *  @brief Scores every position of a file.
+   *
+   *  @param input File of FEN lines.
+   *  @param output If not empty, receives every line that held a position
+   *  followed by its score from the side to move's point of view.
+   *  @param r_stats Receives the totals.
+   *  @return False if a file cannot be opened or written.
+   */
+  bool run(const std::string& input, const std::string& output,
+           BatchStats& r_stats) const noexcept;
+};
+
+#endif
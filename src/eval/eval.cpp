@@ -0,0 +1,515 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "eval.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/chess.h"
+#include "../chess/move.h"
+#include "../chess/packed.h"
+#include "../chess/zobrist.h"
+#include "../cpu/cpu.h"
+#include "../endgame/bitbase.h"
+#include "material.h"
+
+// Piece-square tables from white's point of view, a8 first.
+static constexpr int PAWN_TABLE[64] = {
+   0,  0,  0,  0,  0,  0,  0,  0,
+  50, 50, 50, 50, 50, 50, 50, 50,
+  10, 10, 20, 30, 30, 20, 10, 10,
+   5,  5, 10, 25, 25, 10,  5,  5,
+   0,  0,  0, 20, 20,  0,  0,  0,
+   5, -5,-10,  0,  0,-10, -5,  5,
+   5, 10, 10,-20,-20, 10, 10,  5,
+   0,  0,  0,  0,  0,  0,  0,  0
+};
+
+static constexpr int KNIGHT_TABLE[64] = {
+  -50,-40,-30,-30,-30,-30,-40,-50,
+  -40,-20,  0,  0,  0,  0,-20,-40,
+  -30,  0, 10, 15, 15, 10,  0,-30,
+  -30,  5, 15, 20, 20, 15,  5,-30,
+  -30,  0, 15, 20, 20, 15,  0,-30,
+  -30,  5, 10, 15, 15, 10,  5,-30,
+  -40,-20,  0,  5,  5,  0,-20,-40,
+  -50,-40,-30,-30,-30,-30,-40,-50
+};
+
+static constexpr int BISHOP_TABLE[64] = {
+  -20,-10,-10,-10,-10,-10,-10,-20,
+  -10,  0,  0,  0,  0,  0,  0,-10,
+  -10,  0,  5, 10, 10,  5,  0,-10,
+  -10,  5,  5, 10, 10,  5,  5,-10,
+  -10,  0, 10, 10, 10, 10,  0,-10,
+  -10, 10, 10, 10, 10, 10, 10,-10,
+  -10,  5,  0,  0,  0,  0,  5,-10,
+  -20,-10,-10,-10,-10,-10,-10,-20
+};
+
+static constexpr int ROOK_TABLE[64] = {
+   0,  0,  0,  0,  0,  0,  0,  0,
+   5, 10, 10, 10, 10, 10, 10,  5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+   0,  0,  0,  5,  5,  0,  0,  0
+};
+
+static constexpr int QUEEN_TABLE[64] = {
+  -20,-10,-10, -5, -5,-10,-10,-20,
+  -10,  0,  0,  0,  0,  0,  0,-10,
+  -10,  0,  5,  5,  5,  5,  0,-10,
+   -5,  0,  5,  5,  5,  5,  0, -5,
+    0,  0,  5,  5,  5,  5,  0, -5,
+  -10,  5,  5,  5,  5,  5,  0,-10,
+  -10,  0,  5,  0,  0,  0,  0,-10,
+  -20,-10,-10, -5, -5,-10,-10,-20
+};
+
+static constexpr int KING_TABLE[64] = {
+  -30,-40,-40,-50,-50,-40,-40,-30,
+  -30,-40,-40,-50,-50,-40,-40,-30,
+  -30,-40,-40,-50,-50,-40,-40,-30,
+  -30,-40,-40,-50,-50,-40,-40,-30,
+  -20,-30,-30,-40,-40,-30,-30,-20,
+  -10,-20,-20,-20,-20,-20,-20,-10,
+   20, 20,  0,  0,  0,  0, 20, 20,
+   20, 30, 10,  0,  0, 10, 30, 20
+};
+
+int Eval::pieceValue(const char piece) noexcept {
+  switch (piece) {
+    case 'P':
+    case 'p':
+      return PAWN;
+    case 'N':
+    case 'n':
+      return KNIGHT;
+    case 'B':
+    case 'b':
+      return BISHOP;
+    case 'R':
+    case 'r':
+      return ROOK;
+    case 'Q':
+    case 'q':
+      return QUEEN;
+    default:
+      return 0;
+  }
+}
+
+/*!
+ *  @struct PieceSquareTable
+ *  @brief Material plus piece-square bonus of every piece on every square.
+ *
+ *  Signed from white's point of view, black mirrored onto white's tables,
+ *  indexed by the piece notation's code and the 0..63 square.
+ */
+struct PieceSquareTable {
+  int codes[128] = {};    //!< Piece notation to row, 0 for none.
+  int values[13][64] = {}; //!< Row 0 is all zeros.
+
+  constexpr PieceSquareTable() {
+    constexpr char PIECES[] = "PNBRQKpnbrqk";
+    const int* const tables[] = {PAWN_TABLE, KNIGHT_TABLE, BISHOP_TABLE,
+                                 ROOK_TABLE, QUEEN_TABLE, KING_TABLE};
+    const int material[] = {Eval::PAWN, Eval::KNIGHT, Eval::BISHOP,
+                            Eval::ROOK, Eval::QUEEN, 0};
+    for (int piece = 0; piece < 12; ++piece) {
+      codes[int(PIECES[piece])] = piece + 1;
+      const bool white = piece < 6;
+      for (int sqr = 0; sqr < 64; ++sqr) {
+        const int value = material[piece % 6] +
+                          tables[piece % 6][white? sqr : sqr ^ 56];
+        values[piece + 1][sqr] = white? value : -value;
+      }
+    }
+  }
+};
+
+static constexpr PieceSquareTable PSQT;
+
+int Eval::pieceSquareValue(const char piece, const unsigned int sqr) noexcept {
+  return PSQT.values[PSQT.codes[int(piece)]][sqr];
+}
+
+//! Sums the table over the piece list, from white's point of view.
+static inline int psqtKernel(const Board& board) noexcept {
+  int score = 0;
+  for (unsigned int i = 0; i < board.getPieceCount(); ++i) {
+    const BoardSquare sqr = board.getPieceSquare(i);
+    score += PSQT.values[PSQT.codes[int(board.getVal(sqr))]][fromMailbox(sqr)];
+  }
+  return score;
+}
+
+//! Turns a white-relative score into the final score.
+static inline int finish(const Board& board, const MaterialEntry& material,
+                         int score) noexcept
+{
+  if (!board.isWhitesMove()) {
+    score = -score;
+  }
+  if (!material.isBitbase) {
+    return score;
+  }
+
+  switch (Bitbase::probe(board)) {
+    case Bitbase::Result::Draw:
+      return 0;
+    case Bitbase::Result::Win:
+      return Eval::KNOWN_WIN + score;
+    case Bitbase::Result::Loss:
+      return -Eval::KNOWN_WIN + score;
+    default:
+      return score;
+  }
+}
+
+//! Evaluates from white's point of view as the material entry says.
+static inline int evaluateWhite(const Board& board,
+                                const MaterialEntry& material) noexcept
+{
+  if (material.evaluate) {
+    return material.evaluate(board);
+  }
+  const int score = psqtKernel(board) + material.imbalance;
+  return material.scale? material.scale(board, score) : score;
+}
+
+int Eval::evaluate(const Board& board) noexcept {
+  const MaterialEntry& material = MaterialTable::getLocal().probe(board);
+  return finish(board, material, evaluateWhite(board, material));
+}
+
+/*!
+ *  @struct BatchBlock
+ *  @brief Eval::BATCH positions transposed for the batch kernels.
+ *
+ *  Square by square, the PSQT row of every position's piece there, 0 for
+ *  an empty square, so that a square's values for all the positions are
+ *  one in-register permute of that square's column of the table. Squares
+ *  empty in every position are skipped by the kernels.
+ */
+struct alignas(64) BatchBlock {
+  std::uint8_t rows[64][Eval::BATCH]; //!< PSQT rows by square and position.
+  std::uint64_t occupancy; //!< Squares occupied in at least one position.
+  int bias[Eval::BATCH];  //!< Material imbalance, white's point of view.
+  int sign[Eval::BATCH];  //!< 1 if white is to move, -1 otherwise.
+};
+
+/*!
+ *  @struct PsqtColumns
+ *  @brief The PSQT transposed: the values of every row on one square.
+ *
+ *  Rows 13 to 15 are zeros, padding a column to sixteen values.
+ */
+struct alignas(64) PsqtColumns {
+  int values[64][16] = {};
+
+  constexpr PsqtColumns() {
+    for (unsigned int sqr = 0; sqr < 64; ++sqr) {
+      for (unsigned int row = 0; row < 13; ++row) {
+        values[sqr][row] = PSQT.values[row][sqr];
+      }
+    }
+  }
+};
+
+static constexpr PsqtColumns COLUMNS;
+
+// Packed piece codes are in PSQT row order, one row down.
+static_assert(PSQT.codes[int('P')] == 1 && PSQT.codes[int('k')] == 12,
+              "Packed codes must map onto the PSQT rows");
+
+/*!
+ *  @brief Sums the table over a block, WIDTH positions per vector.
+ *
+ *  Written with GCC vector extensions, as a table lookup per lane is not
+ *  something the compiler vectorises on its own. With 16 lanes a column
+ *  is a single permute (vpermd on AVX-512); with 8 it takes two, one per
+ *  half of the column, and a blend.
+ */
+template <unsigned int WIDTH>
+__attribute__((always_inline))
+static inline void batchKernel(const BatchBlock& block, int* r_scores)
+    noexcept
+{
+  typedef int Vector __attribute__((vector_size(WIDTH * sizeof(int))));
+  constexpr unsigned int PARTS = 16 / WIDTH;
+  constexpr unsigned int GROUPS = Eval::BATCH / WIDTH;
+
+  Vector scores[GROUPS];
+  std::memcpy(scores, block.bias, sizeof(scores));
+  for (std::uint64_t occ = block.occupancy; occ; occ &= occ - 1) {
+    const unsigned int sqr = __builtin_ctzll(occ);
+    Vector column[PARTS];
+    std::memcpy(column, COLUMNS.values[sqr], sizeof(column));
+    for (unsigned int group = 0; group < GROUPS; ++group) {
+      int wide[WIDTH];
+      for (unsigned int i = 0; i < WIDTH; ++i) {
+        wide[i] = block.rows[sqr][group * WIDTH + i];
+      }
+      Vector rows;
+      std::memcpy(&rows, wide, sizeof(rows));
+      if constexpr (PARTS == 1) {
+        scores[group] += __builtin_shuffle(column[0], rows);
+      } else {
+        // Shuffle indices wrap around, so each half sees rows modulo 8.
+        scores[group] += rows >= int(WIDTH)?
+            __builtin_shuffle(column[1], rows) :
+            __builtin_shuffle(column[0], rows);
+      }
+    }
+  }
+
+  Vector signs[GROUPS];
+  std::memcpy(signs, block.sign, sizeof(signs));
+  for (unsigned int group = 0; group < GROUPS; ++group) {
+    scores[group] *= signs[group];
+  }
+  std::memcpy(r_scores, scores, sizeof(scores));
+}
+
+//! Sums the table over a block one lookup at a time.
+static void batchGeneric(const BatchBlock& block, int* r_scores) noexcept {
+  int scores[Eval::BATCH];
+  std::memcpy(scores, block.bias, sizeof(scores));
+  for (std::uint64_t occ = block.occupancy; occ; occ &= occ - 1) {
+    const unsigned int sqr = __builtin_ctzll(occ);
+    for (unsigned int lane = 0; lane < Eval::BATCH; ++lane) {
+      scores[lane] += COLUMNS.values[sqr][block.rows[sqr][lane]];
+    }
+  }
+  for (unsigned int lane = 0; lane < Eval::BATCH; ++lane) {
+    r_scores[lane] = scores[lane] * block.sign[lane];
+  }
+}
+
+NELLY_TARGET(NELLY_ISA_AVX2)
+static void batchAvx2(const BatchBlock& block, int* r_scores) noexcept {
+  batchKernel<8>(block, r_scores);
+}
+
+NELLY_TARGET(NELLY_ISA_AVX512)
+static void batchAvx512(const BatchBlock& block, int* r_scores) noexcept {
+  batchKernel<16>(block, r_scores);
+}
+
+/*!
+ *  Variants by Cpu::Tier, one per permute width. Without AVX2 there is no
+ *  variable permute, so the generic kernel looks the values up one by one.
+ */
+static void (*const BATCH_KERNELS[])(const BatchBlock&, int*) noexcept = {
+  batchGeneric, batchAvx2, batchAvx512
+};
+static_assert(sizeof(BATCH_KERNELS) / sizeof(BATCH_KERNELS[0]) ==
+              unsigned(Cpu::Tier::Count));
+
+//! One piece of a code in the four-bit counts of BatchMaterial.
+static constexpr std::uint64_t COUNT_UNITS[16] = {
+  1ull << 0, 1ull << 4, 1ull << 8, 1ull << 12, 1ull << 16, 1ull << 20,
+  1ull << 24, 1ull << 28, 1ull << 32, 1ull << 36, 1ull << 40, 1ull << 44
+};
+
+/*!
+ *  @struct BatchMaterial
+ *  @brief What the batch needs of the material of the last position.
+ *
+ *  Positions in a row mostly share their material, so the key is only
+ *  built and probed again when the piece counts change. Copied rather
+ *  than pointed to, as the fallback evaluations may replace the entry.
+ */
+struct BatchMaterial {
+  std::uint64_t counts = ~0ull; //!< Four bits per piece code.
+  int imbalance = 0;            //!< MaterialEntry::imbalance.
+  bool isTable = false;         //!< True if the tables alone evaluate it.
+};
+
+/*!
+ *  @brief Transposes a packed position into a lane of a cleared block.
+ *
+ *  The square loop only places the pieces and counts them, the material
+ *  is looked up afterwards, and only when the counts changed.
+ *  @return False, with the lane left empty, if the material needs more
+ *  than the tables: its own evaluation, scaling or a bitbase.
+ */
+static bool transpose(const PackedBoard& position, MaterialTable& table,
+                      BatchMaterial& r_material, BatchBlock& r_block,
+                      const unsigned int lane) noexcept
+{
+  // At most 15 of a piece besides the king, so a count fits four bits.
+  std::uint64_t counts = 0;
+  std::uint64_t halves[2];
+  std::memcpy(halves, position.pieces, sizeof(halves));
+  std::uint64_t left = position.occupancy;
+  for (std::uint64_t codes : halves) {
+    for (unsigned int i = 0; i < 16 && left; ++i, left &= left - 1) {
+      const unsigned int code = codes & 0xF;
+      codes >>= 4;
+      counts += COUNT_UNITS[code];
+      r_block.rows[__builtin_ctzll(left)][lane] = code + 1;
+    }
+  }
+
+  if (counts != r_material.counts) {
+    // The material key is the one the unpacked board would have.
+    std::uint64_t key = 0;
+    for (unsigned int code = 0; code < 12; ++code) {
+      for (unsigned int i = 0; i < (counts >> code * 4 & 0xF); ++i) {
+        key ^= ZOBRIST.material[code][i];
+      }
+    }
+    const MaterialEntry* material = table.find(key);
+    if (!material) {
+      material = &table.probe(position.toBoard());
+    }
+    r_material.counts = counts;
+    r_material.imbalance = material->imbalance;
+    r_material.isTable =
+        !material->evaluate && !material->scale && !material->isBitbase;
+  }
+  if (!r_material.isTable) {
+    for (std::uint64_t occ = position.occupancy; occ; occ &= occ - 1) {
+      r_block.rows[__builtin_ctzll(occ)][lane] = 0;
+    }
+    return false;
+  }
+  r_block.occupancy |= position.occupancy;
+  r_block.bias[lane] = r_material.imbalance;
+  r_block.sign[lane] = position.isWhitesMove()? 1 : -1;
+  return true;
+}
+
+void Eval::evaluate(const PackedBoard* positions, const unsigned int count,
+                    int* r_scores) noexcept
+{
+  void (*const kernel)(const BatchBlock&, int*) noexcept =
+      BATCH_KERNELS[int(Cpu::getTier())];
+  MaterialTable& table = MaterialTable::getLocal();
+  BatchMaterial material;
+  BatchBlock block;
+  for (unsigned int first = 0; first < count; first += BATCH) {
+    const unsigned int lanes = std::min(count - first, BATCH);
+    bool isTable[BATCH];
+    std::memset(&block, 0, sizeof(block));
+    for (unsigned int lane = 0; lane < lanes; ++lane) {
+      isTable[lane] = transpose(positions[first + lane], table, material,
+                                block, lane);
+    }
+
+    int scores[BATCH];
+    kernel(block, scores);
+    for (unsigned int lane = 0; lane < lanes; ++lane) {
+      r_scores[first + lane] = isTable[lane]? scores[lane] :
+          evaluate(positions[first + lane].toBoard());
+    }
+  }
+}
+
+void Eval::benchmark() noexcept {
+  Bitbase::init();
+  Logger::info("CPU: " + Cpu::describe());
+  Logger::info(std::string("Detected tier: ") +
+               Cpu::getName(Cpu::getDetected()));
+
+  // Positions from random games, most of them middlegames.
+  std::mt19937 rng(42);
+  std::vector<Board> boards;
+  for (unsigned int game = 0; game < 100; ++game) {
+    Board board;
+    board.loadFen();
+    for (unsigned int ply = 0; ply < 80; ++ply) {
+      const std::list<Move>& moves = board.getLegalMoves();
+      if (moves.empty()) {
+        break;
+      }
+      auto it = moves.begin();
+      std::advance(it, rng() % moves.size());
+      board = board.makeMove(*it);
+      boards.push_back(board);
+    }
+  }
+
+  std::vector<PackedBoard> packed;
+  for (const Board& board : boards) {
+    packed.push_back(PackedBoard::fromBoard(board));
+  }
+  std::vector<int> scalar(boards.size());
+  std::vector<int> batch(boards.size());
+
+  constexpr unsigned int ROUNDS = 200;
+  const Cpu::Tier active = Cpu::getTier();
+  for (unsigned int i = 0; i <= unsigned(Cpu::getDetected()); ++i) {
+    Cpu::setTier(Cpu::Tier(i));
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < ROUNDS; ++round) {
+      for (std::size_t j = 0; j < boards.size(); ++j) {
+        scalar[j] = evaluate(boards[j]);
+      }
+    }
+    const std::chrono::duration<double, std::nano> scalarTime =
+        std::chrono::steady_clock::now() - start;
+
+    // Packed positions scored one at a time have to be unpacked first.
+    start = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < ROUNDS; ++round) {
+      for (std::size_t j = 0; j < packed.size(); ++j) {
+        batch[j] = evaluate(packed[j].toBoard());
+      }
+    }
+    const std::chrono::duration<double, std::nano> unpackedTime =
+        std::chrono::steady_clock::now() - start;
+    bool isMismatch = batch != scalar;
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < ROUNDS; ++round) {
+      evaluate(packed.data(), packed.size(), batch.data());
+    }
+    const std::chrono::duration<double, std::nano> packedTime =
+        std::chrono::steady_clock::now() - start;
+    isMismatch |= batch != scalar;
+
+    const double evaluations = double(ROUNDS) * boards.size();
+    char line[160];
+    std::snprintf(line, sizeof(line),
+                  "%s: %.1f ns per evaluation of a board, unpacked first "
+                  "%.1f, packed batch %.1f%s", Cpu::getName(Cpu::Tier(i)),
+                  scalarTime.count() / evaluations,
+                  unpackedTime.count() / evaluations,
+                  packedTime.count() / evaluations,
+                  isMismatch? ", MISMATCH" : "");
+    Logger::info(line);
+  }
+  Cpu::setTier(active);
+}
@@ -0,0 +1,91 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EVAL__
+#define __EVAL__
+
+class Board;
+struct PackedBoard;
+
+/*!
+ *  @class Eval
+ *  @brief Static evaluation of a position.
+ *
+ *  Material plus piece-square tables and a bishop pair bonus. The thread's
+ *  MaterialTable tells which endings have their own evaluation or scaling
+ *  and which may be in the bitbases, which then score them exactly. Scores
+ *  are in centipawns from the side to move's point of view.
+ */
+class Eval {
+public:
+  static constexpr int PAWN = 100;    //!< Pawn value.
+  static constexpr int KNIGHT = 320;  //!< Knight value.
+  static constexpr int BISHOP = 330;  //!< Bishop value.
+  static constexpr int ROOK = 500;    //!< Rook value.
+  static constexpr int QUEEN = 900;   //!< Queen value.
+
+  //! Score of a position known to be won, well below mate scores.
+  static constexpr int KNOWN_WIN = 10000;
+
+  //! Positions the batch kernels evaluate side by side.
+  static constexpr unsigned int BATCH = 16;
+
+public:
+  //! Evaluates the board from the side to move's point of view.
+  static int evaluate(const Board& board) noexcept;
+
+  /*!
+   *  @brief Evaluates a batch of packed positions, each as evaluate() would.
+   *
+   *  Positions are transposed BATCH at a time into a structure of arrays,
+   *  the table row of every position by square, and summed across
+   *  positions with vector permutes over the squares any of them occupies,
+   *  without unpacking them into a Board. Runs of positions sharing their
+   *  material look it up once.
+   *  Endings with their own evaluation, scaling or a bitbase are unpacked
+   *  and fall back to evaluate().
+   *  Callers holding many positions, such as training data, should keep
+   *  them packed and score them here.
+   *
+   *  The batch API only exists for packed inputs. There is no overload for
+   *  boards: transposing a Board costs more than scoring it, so evaluate()
+   *  on each board is the fastest way to score positions already unpacked.
+   */
+  static void evaluate(const PackedBoard* positions, const unsigned int count,
+                       int* r_scores) noexcept;
+
+  //! Returns the material value of a piece notation, 0 for kings and empty.
+  static int pieceValue(const char piece) noexcept;
+
+  /*!
+   *  @brief Returns the material plus table bonus of a piece on a square.
+   *
+   *  Signed from white's point of view, the square being 0..63 with a8 = 0.
+   *  This is the term evaluate() sums, so that tuning can start from it.
+   */
+  static int pieceSquareValue(const char piece,
+                              const unsigned int sqr) noexcept;
+
+  /*!
+   *  Times evaluate() on boards, on packed positions one at a time and
+   *  in batches, with every supported kernel tier, logging the results.
+   */
+  static void benchmark() noexcept;
+};
+
+#endif
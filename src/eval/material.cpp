@@ -0,0 +1,198 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "material.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "../chess/board.h"
+#include "../chess/chess.h"
+#include "../chess/tables.h"
+#include "eval.h"
+
+using PieceType = Board::PieceType;
+
+//! Chebyshev distance between two 0..63 squares.
+static unsigned int distance(const unsigned int a, const unsigned int b) {
+  return ATTACKS.distance[a][b];
+}
+
+//! Returns true for light squares; a8 is light.
+static bool isLight(const unsigned int sqr) {
+  return (sqr % 8 + sqr / 8) % 2 == 0;
+}
+
+//! Returns the 0..63 square of the first piece of a side and type.
+static unsigned int squareOf(const Board& board, const bool white,
+                             const PieceType type)
+{
+  return fromMailbox(*board.getPieces(white, type));
+}
+
+//! Neither side can mate: bare kings or a lone minor piece each.
+static int evaluateDraw(const Board&) noexcept {
+  return 0;
+}
+
+/*!
+ *  @brief KBNK: drives the lone king to a corner of the bishop's colour.
+ *
+ *  Mate is only possible there, so the distance to the nearest such
+ *  corner counts most, then the distance between the kings.
+ */
+static int evaluateKbnk(const Board& board) noexcept {
+  const bool white = board.getPieceCount(true, PieceType::Bishop);
+  const unsigned int strong = squareOf(board, white, PieceType::King);
+  const unsigned int weak = squareOf(board, !white, PieceType::King);
+  const bool isLightBishop = isLight(squareOf(board, white,
+                                              PieceType::Bishop));
+
+  // Manhattan distance to the corners: a8 and h1 are light, h8 and a1 dark.
+  const unsigned int file = weak % 8;
+  const unsigned int row = weak / 8;
+  const unsigned int corner = isLightBishop?
+      std::min(file + row, 14 - file - row) :
+      std::min(7 - file + row, file + 7 - row);
+  const int score = Eval::KNOWN_WIN + 20 * (14 - corner) +
+                    10 * (7 - distance(strong, weak));
+  return white? score : -score;
+}
+
+/*!
+ *  @brief KRKP: won unless the pawn, backed by its king, outruns the rook.
+ *
+ *  The rook wins if its king stands in front of the pawn or the defending
+ *  king is far from both pawn and rook; otherwise the race between the
+ *  kings and the pawn decides how drawish it is.
+ */
+static int evaluateKrkp(const Board& board) noexcept {
+  const bool white = board.getPieceCount(true, PieceType::Rook);
+  const unsigned int strong = squareOf(board, white, PieceType::King);
+  const unsigned int weak = squareOf(board, !white, PieceType::King);
+  const unsigned int rook = squareOf(board, white, PieceType::Rook);
+  const unsigned int pawn = squareOf(board, !white, PieceType::Pawn);
+
+  // Rows as seen by the pawn's side, 0 being its back rank.
+  auto row = [white](const unsigned int sqr) {
+    return white? sqr / 8 : 7 - sqr / 8;
+  };
+  const unsigned int push = white? pawn + 8 : pawn - 8;
+  const unsigned int queening = white? 56 + pawn % 8 : pawn % 8;
+  const bool isWeakToMove = board.isWhitesMove() != white;
+
+  int score;
+  if (strong % 8 == pawn % 8 && row(strong) > row(pawn)) {
+    score = Eval::ROOK - int(distance(strong, pawn));
+  } else if (distance(weak, pawn) >= 3u + isWeakToMove &&
+             distance(weak, rook) >= 3)
+  {
+    score = Eval::ROOK - int(distance(strong, pawn));
+  } else if (row(weak) >= 5 && distance(weak, pawn) == 1 &&
+             row(strong) <= 4 &&
+             distance(strong, pawn) > 2u + !isWeakToMove)
+  {
+    score = 80 - 8 * int(distance(strong, pawn));
+  } else {
+    score = 200 - 8 * (int(distance(strong, push)) -
+                       int(distance(weak, push)) -
+                       int(distance(pawn, queening)));
+  }
+  return white? score : -score;
+}
+
+//! Halves the score when the only pieces are opposite coloured bishops.
+static int scaleOppositeBishops(const Board& board, const int score) noexcept
+{
+  return isLight(squareOf(board, true, PieceType::Bishop)) !=
+         isLight(squareOf(board, false, PieceType::Bishop))? score / 2
+                                                            : score;
+}
+
+MaterialTable::MaterialTable()
+  : m_entries(new MaterialEntry[SIZE]())
+{}
+
+MaterialTable& MaterialTable::getLocal() noexcept {
+  thread_local MaterialTable table;
+  return table;
+}
+
+void MaterialTable::compute(const Board& board,
+                            MaterialEntry& r_entry) noexcept
+{
+  unsigned int queens[2], rooks[2], bishops[2], knights[2], pawns[2];
+  for (unsigned int side = 0; side < 2; ++side) {
+    queens[side] = board.getPieceCount(side, PieceType::Queen);
+    rooks[side] = board.getPieceCount(side, PieceType::Rook);
+    bishops[side] = board.getPieceCount(side, PieceType::Bishop);
+    knights[side] = board.getPieceCount(side, PieceType::Knight);
+    pawns[side] = board.getPieceCount(side, PieceType::Pawn);
+    r_entry.nonPawn[side] = queens[side] * Eval::QUEEN +
+                            rooks[side] * Eval::ROOK +
+                            bishops[side] * Eval::BISHOP +
+                            knights[side] * Eval::KNIGHT;
+  }
+
+  r_entry.key = board.getMaterialKey();
+  r_entry.evaluate = nullptr;
+  r_entry.scale = nullptr;
+  r_entry.imbalance = BISHOP_PAIR * ((bishops[1] >= 2) - (bishops[0] >= 2));
+  r_entry.phase = std::min(
+      MAX_PHASE, knights[0] + knights[1] + bishops[0] + bishops[1] +
+                 2 * (rooks[0] + rooks[1]) + 4 * (queens[0] + queens[1]));
+  r_entry.isBitbase = board.getPieceCount() == 3;
+
+  if (!pawns[0] && !pawns[1] && r_entry.nonPawn[0] <= Eval::BISHOP &&
+      r_entry.nonPawn[1] <= Eval::BISHOP)
+  {
+    r_entry.evaluate = evaluateDraw;
+    return;
+  }
+
+  for (unsigned int side = 0; side < 2; ++side) {
+    const unsigned int other = !side;
+    const bool isBare = !pawns[other] && !r_entry.nonPawn[other];
+    if (isBare && !pawns[side] && r_entry.nonPawn[side] == 2 * Eval::KNIGHT &&
+        knights[side] == 2)
+    {
+      r_entry.evaluate = evaluateDraw;
+      return;
+    }
+    if (isBare && !pawns[side] && bishops[side] == 1 && knights[side] == 1 &&
+        r_entry.nonPawn[side] == Eval::BISHOP + Eval::KNIGHT)
+    {
+      r_entry.evaluate = evaluateKbnk;
+      return;
+    }
+    if (!pawns[side] && rooks[side] == 1 &&
+        r_entry.nonPawn[side] == Eval::ROOK && !r_entry.nonPawn[other] &&
+        pawns[other] == 1)
+    {
+      r_entry.evaluate = evaluateKrkp;
+      return;
+    }
+  }
+
+  if (bishops[0] == 1 && bishops[1] == 1 &&
+      r_entry.nonPawn[0] == Eval::BISHOP &&
+      r_entry.nonPawn[1] == Eval::BISHOP)
+  {
+    r_entry.scale = scaleOppositeBishops;
+  }
+}
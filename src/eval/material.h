@@ -0,0 +1,101 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MATERIAL__
+#define __MATERIAL__
+
+#include <cstdint>
+#include <memory>
+
+#include "../chess/board.h"
+
+/*!
+ *  @struct MaterialEntry
+ *  @brief What the piece counts alone tell about a position.
+ *
+ *  Scores are from white's point of view.
+ */
+struct MaterialEntry {
+  //! Evaluates an ending on its own, replacing the generic evaluation.
+  using Evaluator = int (*)(const Board& board) noexcept;
+
+  //! Adjusts the generic evaluation of an ending.
+  using Scaler = int (*)(const Board& board, const int score) noexcept;
+
+  std::uint64_t key;       //!< Board::getMaterialKey() of the entry.
+  Evaluator evaluate;      //!< Specialised evaluation, if any.
+  Scaler scale;            //!< Scaling of the generic evaluation, if any.
+  std::int16_t imbalance;  //!< Bonus for the mix of pieces.
+  std::int16_t nonPawn[2]; //!< Material without pawns and king, black first.
+  std::uint8_t phase;      //!< MaterialTable::MAX_PHASE down to 0.
+  bool isBitbase;          //!< True if a bitbase may cover the position.
+};
+
+static_assert(sizeof(MaterialEntry) == 32, "MaterialEntry must stay 32 bytes");
+
+/*!
+ *  @class MaterialTable
+ *  @brief Cache of MaterialEntry by material key, one per thread.
+ *
+ *  The piece counts change only on captures and promotions, so nearly every
+ *  lookup hits and evaluation learns at once which work the material needs:
+ *  whether bitbases can apply, and whether a known ending has its own
+ *  evaluator (KBNK, KRKP, insufficient material) or scaling (opposite
+ *  coloured bishops).
+ */
+class MaterialTable {
+public:
+  static constexpr unsigned int SIZE = 8192;    //!< Entries, a power of two.
+  static constexpr unsigned int MAX_PHASE = 24; //!< Phase of the start.
+  static constexpr int BISHOP_PAIR = 30;        //!< Bonus for both bishops.
+
+private:
+  std::unique_ptr<MaterialEntry[]> m_entries; //!< SIZE entries.
+
+public:
+  //! Creates an empty table.
+  MaterialTable();
+
+  MaterialTable(const MaterialTable&) = delete;
+
+public:
+  //! Returns the entry of the board's material, computing it on a miss.
+  const MaterialEntry& probe(const Board& board) noexcept {
+    const std::uint64_t key = board.getMaterialKey();
+    MaterialEntry& entry = m_entries[key & (SIZE - 1)];
+    if (entry.key != key) {
+      compute(board, entry);
+    }
+    return entry;
+  }
+
+  //! Returns the entry of a material key if it is cached, null otherwise.
+  const MaterialEntry* find(const std::uint64_t key) const noexcept {
+    const MaterialEntry& entry = m_entries[key & (SIZE - 1)];
+    return entry.key == key? &entry : nullptr;
+  }
+
+  //! Returns the calling thread's table.
+  static MaterialTable& getLocal() noexcept;
+
+private:
+  //! Fills 'r_entry' from the board's piece counts.
+  static void compute(const Board& board, MaterialEntry& r_entry) noexcept;
+};
+
+#endif
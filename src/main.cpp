@@ -16,18 +16,216 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
+#include <cstdint>
 #include <list>
+#include <string>
 
+#include "bench/bench.h"
+#include "bench/micro.h"
+#include "chess/attacks.h"
 #include "chess/board.h"
 #include "chess/move.h"
+#include "chess/movelist.h"
+#include "chess/packed.h"
 #include "chess/pieces.h"
 #include "cpp-logger/logger.h"
+#include "cpu/cpu.h"
+#include "endgame/bitbase.h"
+#include "eval/batch.h"
+#include "eval/eval.h"
+#include "pgn/pgn.h"
+#include "search/search.h"
+#include "selfplay/selfplay.h"
+#include "tune/tune.h"
+#include "uci/uci.h"
+
+//! Counts leaf nodes of the legal move tree.
+static std::uint64_t perft(const Board& board, const unsigned int depth) {
+  MoveList moves;
+  board.getLegalMoves(moves);
+  if (depth <= 1) {
+    return moves.size();
+  }
+  std::uint64_t nodes = 0;
+  for (const Move& move : moves) {
+    nodes += perft(board.makeMove(move), depth - 1);
+  }
+  return nodes;
+}
 
 int main(int argc, char* argv[]) {
   Logger::set_mode("debug");
+  if (argc == 1) {
+    // Keep stdout clean for the GUI.
+    Logger::set_terminal_output(false);
+    Uci().loop();
+    return 0;
+  }
+
   Logger::set_terminal_output(true);
   Logger::info("Running Nelly v0.0.1");
 
+  if (argc >= 2 && std::string(argv[1]) == "bench") {
+    // bench [depth] [threads] [hash] [multipv]
+    Bench::run(argc >= 3? std::stoul(argv[2]) : Bench::DEPTH,
+               argc >= 4? std::stoul(argv[3]) : Bench::THREADS,
+               argc >= 5? std::stoull(argv[4]) : Bench::HASH,
+               argc >= 6? std::stoul(argv[5]) : Bench::MULTI_PV);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "hashbench") {
+    // hashbench [hash] [depth]
+    Bench::pages(argc >= 3? std::stoull(argv[2]) : Bench::PAGES_HASH,
+                 argc >= 4? std::stoul(argv[3]) : Bench::DEPTH);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "sharebench") {
+    // sharebench [processes] [depth] [hash]
+    Bench::shared(argc >= 3? std::stoul(argv[2]) : Bench::PROCESSES,
+                  argc >= 4? std::stoul(argv[3]) : Bench::DEPTH,
+                  argc >= 5? std::stoull(argv[4]) : Bench::HASH);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "cachebench") {
+    // cachebench [path] [depth]
+    Bench::cache(argc >= 3? argv[2] : Bench::CACHE,
+                 argc >= 4? std::stoul(argv[3]) : Bench::DEPTH);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "matebench") {
+    // matebench [epd | -] [moves] [time]
+    const std::string path = argc >= 3? argv[2] : "-";
+    Bench::mate(path == "-"? "" : path,
+                argc >= 4? std::stoul(argv[3]) : Bench::MATE_MOVES,
+                argc >= 5? std::stoull(argv[4]) : Bench::MATE_TIME);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "startupbench") {
+    // startupbench [runs]
+    Bench::startup(argc >= 3? std::stoul(argv[2]) : Bench::STARTUP_RUNS);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "microbench") {
+    // microbench [output] [baseline] [threshold]
+    const bool passed = MicroBench::run(argc >= 3? argv[2] : "",
+                                        argc >= 4? argv[3] : "",
+                                        argc >= 5? std::stod(argv[4])
+                                                 : MicroBench::THRESHOLD);
+    return passed? 0 : 1;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "cpu") {
+    Eval::benchmark();
+    return 0;
+  }
+
+  if (argc == 2 && std::string(argv[1]) == "bitbase") {
+    Bitbase::benchmark();
+    return 0;
+  }
+
+  if (argc == 2 && std::string(argv[1]) == "packbench") {
+    PackedBoard::benchmark();
+    return 0;
+  }
+
+  if (argc == 2 && std::string(argv[1]) == "attackbench") {
+    AttackMap::benchmark();
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "prunebench") {
+    Bitbase::init();
+    Search::selectivityBenchmark(argc >= 3? std::stoul(argv[2]) : 6);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "selfplay") {
+    // selfplay [threads] [games] [nodes] [prefix]
+    SelfPlayConfig config;
+    if (argc >= 3) {
+      config.threads = std::stoul(argv[2]);
+    }
+    if (argc >= 4) {
+      config.games = std::stoull(argv[3]);
+    }
+    if (argc >= 5) {
+      config.nodes = std::stoull(argv[4]);
+    }
+    if (argc >= 6) {
+      config.prefix = argv[5];
+    }
+    SelfPlay(config).run();
+    return 0;
+  }
+
+  if (argc >= 3 && std::string(argv[1]) == "pgn") {
+    // pgn <file> [threads] [prefix]
+    PgnConfig config;
+    if (argc >= 4) {
+      config.threads = std::stoul(argv[3]);
+    }
+    if (argc >= 5) {
+      config.prefix = argv[4];
+    }
+    PgnStats stats;
+    return PgnReader(config).run(argv[2], stats)? 0 : 1;
+  }
+
+  if (argc >= 3 && std::string(argv[1]) == "tune") {
+    // tune <file> [threads] [iterations]
+    TuneConfig config;
+    if (argc >= 4) {
+      config.threads = std::stoul(argv[3]);
+    }
+    if (argc >= 5) {
+      config.iterations = std::stoul(argv[4]);
+    }
+    Tuner tuner(config);
+    if (!tuner.load(argv[2])) {
+      return 1;
+    }
+    tuner.run();
+    return 0;
+  }
+
+  if (argc >= 3 && std::string(argv[1]) == "evalfile") {
+    // evalfile <file> [threads] [output]
+    BatchConfig config;
+    if (argc >= 4) {
+      config.threads = std::stoul(argv[3]);
+    }
+    BatchStats stats;
+    return BatchEval(config).run(argv[2], argc >= 5? argv[4] : "", stats)?
+        0 : 1;
+  }
+
+  if (argc >= 3 && std::string(argv[1]) == "perft") {
+    Board board;
+    if (argc >= 4) {
+      board.loadFen(argv[3]);
+    } else {
+      board.loadFen();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const std::uint64_t nodes = perft(board, std::stoul(argv[2]));
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    Logger::info("Perft " + std::string(argv[2]) + ": " +
+                 std::to_string(nodes) + " nodes in " +
+                 std::to_string(elapsed.count()) + " s (" +
+                 std::to_string(std::uint64_t(nodes / elapsed.count())) +
+                 " nps)");
+    return 0;
+  }
+
   Board b;
   if (argc == 2) {
     b.loadFen(argv[1]);
@@ -0,0 +1,534 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pgn.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/movelist.h"
+#include "../chess/packed.h"
+
+//! Tag that starts every game.
+static constexpr char EVENT[] = "[Event ";
+static constexpr std::size_t EVENT_LENGTH = sizeof(EVENT) - 1;
+
+//! Serialized games buffered per shard before a single write.
+static constexpr std::size_t BATCH = 1 << 20;
+
+//! Result of an unfinished or unknown game.
+static constexpr int NO_RESULT = 2;
+
+//! Returns true if a game starts at 'p'.
+static bool isGameStart(const char* data, const char* p, const char* end) {
+  return (p == data || p[-1] == '\n') &&
+         std::size_t(end - p) >= EVENT_LENGTH &&
+         !std::memcmp(p, EVENT, EVENT_LENGTH);
+}
+
+//! Returns the first game start in [p, end), or end if there is none.
+static const char* findGame(const char* data, const char* p, const char* end) {
+  while (p < end) {
+    if (isGameStart(data, p, end)) {
+      return p;
+    }
+    const void* line = std::memchr(p, '\n', end - p);
+    if (!line) {
+      return end;
+    }
+    p = static_cast<const char*>(line) + 1;
+  }
+  return end;
+}
+
+//! Returns the result a token stands for, or NO_RESULT if it isn't one.
+static int resultOf(const char* token, const std::size_t length) {
+  if (length == 3 && !std::memcmp(token, "1-0", 3)) {
+    return 1;
+  }
+  if (length == 3 && !std::memcmp(token, "0-1", 3)) {
+    return -1;
+  }
+  if (length == 7 && !std::memcmp(token, "1/2-1/2", 7)) {
+    return 0;
+  }
+  return NO_RESULT;
+}
+
+/*!
+ *  @brief Returns false if a piece of the type can't possibly move between
+ *  the two squares (0..63).
+ *
+ *  Lets the SAN decoder skip generating moves of pieces that aren't
+ *  candidates; castling is handled separately.
+ */
+static bool canReach(const Board::PieceType type, const unsigned int from,
+                     const unsigned int to)
+{
+  const int rows = std::abs(int(from / 8) - int(to / 8));
+  const int files = std::abs(int(from % 8) - int(to % 8));
+  switch (type) {
+    case Board::PieceType::King:
+      return rows <= 1 && files <= 1;
+    case Board::PieceType::Queen:
+      return rows == files || !rows || !files;
+    case Board::PieceType::Rook:
+      return !rows || !files;
+    case Board::PieceType::Bishop:
+      return rows == files;
+    case Board::PieceType::Knight:
+      return rows * files == 2;
+    default:
+      return rows <= 2 && files <= 1;
+  }
+}
+
+/*!
+ *  @class GameWriter
+ *  @brief Buffered writer of one thread's games file.
+ */
+class GameWriter {
+  std::FILE* m_file;
+  std::vector<std::uint8_t> m_buffer;
+
+public:
+  explicit GameWriter(const std::string& path)
+    : m_file(path.empty()? nullptr : std::fopen(path.c_str(), "wb"))
+  {
+    m_buffer.reserve(BATCH);
+  }
+
+  GameWriter(const GameWriter&) = delete;
+
+  ~GameWriter() {
+    flush();
+    if (m_file) {
+      std::fclose(m_file);
+    }
+  }
+
+  //! Returns true if the file could be opened.
+  bool isOpen() const noexcept {
+    return m_file;
+  }
+
+  //! Queues a game, writing out full batches.
+  void append(const PackedGame& game) noexcept {
+    game.serialize(m_buffer);
+    if (m_buffer.size() >= BATCH) {
+      flush();
+    }
+  }
+
+  //! Writes out all queued games.
+  void flush() noexcept {
+    if (m_file && !m_buffer.empty()) {
+      std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    }
+    m_buffer.clear();
+  }
+};
+
+PgnReader::PgnReader(const PgnConfig& config, const Visitor& visitor)
+  : m_config(config)
+  , m_visitor(visitor)
+  , m_data(nullptr)
+  , m_size(0)
+  , m_nextChunk(0)
+  , m_games(0)
+  , m_malformed(0)
+  , m_positions(0)
+{}
+
+bool PgnReader::run(const std::string& path, PgnStats& r_stats) noexcept {
+  r_stats = PgnStats();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    Logger::error("PGN: can't open " + path);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) || info.st_size < 0) {
+    Logger::error("PGN: can't read " + path);
+    ::close(fd);
+    return false;
+  }
+
+  m_size = info.st_size;
+  void* memory = MAP_FAILED;
+  if (m_size) {
+    memory = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (memory == MAP_FAILED) {
+      Logger::error("PGN: can't map " + path);
+      ::close(fd);
+      return false;
+    }
+    madvise(memory, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(memory);
+  }
+  ::close(fd);
+
+  m_nextChunk = 0;
+  m_games = 0;
+  m_malformed = 0;
+  m_positions = 0;
+  Logger::info("PGN: reading " + path + " (" + std::to_string(m_size >> 20) +
+               " MiB) with " + std::to_string(m_config.threads) + " threads");
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned int id = 0; id < m_config.threads; ++id) {
+    threads.emplace_back(&PgnReader::worker, this, id);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (memory != MAP_FAILED) {
+    munmap(memory, m_size);
+  }
+  m_data = nullptr;
+
+  r_stats.games = m_games.load();
+  r_stats.malformed = m_malformed.load();
+  r_stats.positions = m_positions.load();
+  r_stats.bytes = m_size;
+  r_stats.seconds = elapsed.count();
+  Logger::info("PGN done: " + std::to_string(r_stats.games) + " games, " +
+               std::to_string(r_stats.positions) + " positions, " +
+               std::to_string(r_stats.malformed) + " malformed in " +
+               std::to_string(r_stats.seconds) + " s (" +
+               std::to_string(std::uint64_t(r_stats.games / r_stats.seconds)) +
+               " games/s, " +
+               std::to_string(std::uint64_t(r_stats.bytes / r_stats.seconds /
+                                            (1 << 20))) +
+               " MiB/s)");
+  return true;
+}
+
+bool PgnReader::parseSan(const Board& board, const char* san,
+                         std::size_t length, Move& r_move) noexcept
+{
+  // Check, mate and annotation suffixes.
+  while (length && std::strchr("+#!?", san[length - 1])) {
+    --length;
+  }
+  if (length < 2) {
+    return false;
+  }
+
+  // Kept per thread: constructing a MoveList initialises every slot.
+  thread_local MoveList moves;
+  const bool white = board.isWhitesMove();
+  const BoardSquare king = board.getKingSquare(white);
+  if ((length == 3 && (!std::memcmp(san, "O-O", 3) ||
+                       !std::memcmp(san, "0-0", 3))) ||
+      (length == 5 && (!std::memcmp(san, "O-O-O", 5) ||
+                       !std::memcmp(san, "0-0-0", 5))))
+  {
+    // The generator encodes castling as a two-square king move.
+    const Move castle(king, length == 3? king + 2 : king - 2);
+    moves.clear();
+    board.getValidMoves(king, moves);
+    for (const Move& move : moves) {
+      if (move == castle && board.makeMove(move).isLegal()) {
+        r_move = move;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Promotion, with or without '='.
+  char promotion = ' ';
+  if (std::strchr("QRBN", san[length - 1]) ||
+      (length >= 3 && std::strchr("qrbn", san[length - 1]) &&
+       (san[length - 2] == '=' ||
+        (san[length - 2] >= '1' && san[length - 2] <= '8'))))
+  {
+    promotion = san[--length] & ~0x20;
+    if (length && san[length - 1] == '=') {
+      --length;
+    }
+  }
+  if (length < 2) {
+    return false;
+  }
+
+  // Destination square.
+  const char toFile = san[length - 2];
+  const char toRank = san[length - 1];
+  if (toFile < 'a' || toFile > 'h' || toRank < '1' || toRank > '8') {
+    return false;
+  }
+  const BoardSquare to = toMailbox(('8' - toRank) * 8 + toFile - 'a');
+  length -= 2;
+
+  // Piece, then optional disambiguation and capture mark.
+  std::size_t i = 0;
+  Board::PieceType type = Board::PieceType::Pawn;
+  if (length && std::strchr("KQRBN", san[0])) {
+    type = Board::typeOf(san[0]);
+    ++i;
+  }
+  int fromFile = -1;
+  int fromRank = -1;
+  if (i < length && san[i] >= 'a' && san[i] <= 'h') {
+    fromFile = san[i++] - 'a';
+  }
+  if (i < length && san[i] >= '1' && san[i] <= '8') {
+    fromRank = '8' - san[i++];
+  }
+  if (i < length && (san[i] == 'x' || san[i] == ':')) {
+    ++i;
+  }
+  if (i != length || (promotion != ' ' && type != Board::PieceType::Pawn)) {
+    return false;
+  }
+
+  // Only the pieces of the named type are asked for moves.
+  const BoardSquare* from = board.getPieces(white, type);
+  const unsigned int count = board.getPieceCount(white, type);
+  unsigned int found = 0;
+  for (unsigned int p = 0; p < count; ++p) {
+    const unsigned int sqr = fromMailbox(from[p]);
+    if ((fromFile >= 0 && int(sqr % 8) != fromFile) ||
+        (fromRank >= 0 && int(sqr / 8) != fromRank) ||
+        !canReach(type, sqr, fromMailbox(to)))
+    {
+      continue;
+    }
+    moves.clear();
+    board.getValidMoves(from[p], moves);
+    for (const Move& move : moves) {
+      if (move.to != to ||
+          (move.isPromotion()? char(move.promotion & ~0x20) : ' ') !=
+              promotion ||
+          (type == Board::PieceType::King && move.from + 2 == move.to) ||
+          (type == Board::PieceType::King && move.from == move.to + 2) ||
+          !board.makeMove(move).isLegal())
+      {
+        continue;
+      }
+      if (found++) {
+        return false;
+      }
+      r_move = move;
+    }
+  }
+  return found == 1;
+}
+
+void PgnReader::worker(const unsigned int id) noexcept {
+  GameWriter writer(m_config.prefix.empty()? std::string() :
+                    m_config.prefix + "." + std::to_string(id) + ".games");
+  if (!m_config.prefix.empty() && !writer.isOpen()) {
+    Logger::error("PGN: can't open shard " + std::to_string(id));
+    return;
+  }
+
+  Board start;
+  start.loadFen();
+  std::vector<Board> boards(MAX_PLIES + 1);
+  std::vector<Move> moves(MAX_PLIES + 1);
+  std::string fen;
+  std::uint64_t games = 0;
+  std::uint64_t malformed = 0;
+  std::uint64_t positions = 0;
+
+  const char* const end = m_data + m_size;
+  std::size_t chunk;
+  while ((chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed)) *
+         CHUNK < m_size)
+  {
+    const char* const chunkEnd =
+        m_data + std::min(m_size, (chunk + 1) * CHUNK);
+    const char* game = findGame(m_data, m_data + chunk * CHUNK, chunkEnd);
+    while (game < chunkEnd) {
+      const char* const gameEnd =
+          findGame(m_data, game + EVENT_LENGTH, end);
+      const char* p = game;
+
+      // Tag pairs: only FEN and Result matter.
+      int result = NO_RESULT;
+      bool isValid = true;
+      fen.clear();
+      while (p < gameEnd && (*p == '[' || *p == ' ' || *p == '\t' ||
+                             *p == '\r' || *p == '\n'))
+      {
+        if (*p != '[') {
+          ++p;
+          continue;
+        }
+        const void* line = std::memchr(p, '\n', gameEnd - p);
+        const char* const lineEnd =
+            line? static_cast<const char*>(line) : gameEnd;
+        const char* const open =
+            static_cast<const char*>(std::memchr(p, '"', lineEnd - p));
+        const char* const close = open?
+            static_cast<const char*>(std::memchr(open + 1, '"',
+                                                 lineEnd - open - 1)) :
+            nullptr;
+        if (!close) {
+          isValid = false;
+          break;
+        }
+        const std::size_t nameLength = open - p - 1;
+        if (nameLength >= 4 && !std::memcmp(p + 1, "FEN ", 4)) {
+          fen.assign(open + 1, close);
+        } else if (nameLength >= 7 && !std::memcmp(p + 1, "Result ", 7)) {
+          result = resultOf(open + 1, close - open - 1);
+        }
+        p = lineEnd;
+      }
+
+      if (fen.empty()) {
+        boards[0] = start;
+      } else if (Board::isFenValid(fen)) {
+        Board board;
+        board.loadFen(fen);
+        boards[0] = board;
+        isValid = isValid && board.isLegal();
+      } else {
+        isValid = false;
+      }
+
+      // Movetext: moves are decoded straight from the mapped file.
+      unsigned int ply = 0;
+      bool isOver = false;
+      while (isValid && !isOver && p < gameEnd) {
+        const char c = *p;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '.') {
+          ++p;
+        } else if (c == '{') {
+          const void* close = std::memchr(p, '}', gameEnd - p);
+          isValid = close;
+          p = close? static_cast<const char*>(close) + 1 : gameEnd;
+        } else if (c == ';' || (c == '%' && p[-1] == '\n')) {
+          const void* line = std::memchr(p, '\n', gameEnd - p);
+          p = line? static_cast<const char*>(line) : gameEnd;
+        } else if (c == '(') {
+          // Variations, possibly nested and holding comments.
+          unsigned int depth = 0;
+          do {
+            if (*p == '(') {
+              ++depth;
+            } else if (*p == ')') {
+              --depth;
+            } else if (*p == '{') {
+              const void* close = std::memchr(p, '}', gameEnd - p);
+              p = close? static_cast<const char*>(close) : gameEnd - 1;
+            }
+            ++p;
+          } while (depth && p < gameEnd);
+          isValid = !depth;
+        } else if (c == '$') {
+          ++p;
+          while (p < gameEnd && *p >= '0' && *p <= '9') {
+            ++p;
+          }
+        } else if (c == '*') {
+          isOver = true;
+        } else if (c == '[' || c == ')' || c == '}') {
+          isValid = false;
+        } else {
+          const char* token = p;
+          while (p < gameEnd && !std::strchr(" \t\r\n{}();$", *p)) {
+            ++p;
+          }
+          const std::size_t length = p - token;
+          const int ending = resultOf(token, length);
+          if (ending != NO_RESULT) {
+            result = result == NO_RESULT? ending : result;
+            isOver = true;
+            continue;
+          }
+
+          // Move numbers, unless the token is castling written with zeros.
+          if (token[0] >= '0' && token[0] <= '9' &&
+              (length < 3 || std::memcmp(token, "0-0", 3)))
+          {
+            while (token < p && ((*token >= '0' && *token <= '9') ||
+                                 *token == '.'))
+            {
+              ++token;
+            }
+            if (token == p) {
+              continue;
+            }
+          }
+
+          if (ply == MAX_PLIES) {
+            isValid = false;
+            break;
+          }
+          Move& move = moves[ply + 1];
+          isValid = parseSan(boards[ply], token, p - token, move);
+          if (isValid) {
+            boards[ply + 1] = boards[ply].makeMove(move);
+            ++ply;
+          }
+        }
+      }
+
+      if (!isValid) {
+        ++malformed;
+      } else {
+        ++games;
+        positions += ply + 1;
+        if (m_visitor) {
+          for (unsigned int i = 0; i <= ply; ++i) {
+            m_visitor(PgnPosition{boards[i], i? moves[i] : Move(), i, result,
+                                  id});
+          }
+        }
+        if (writer.isOpen()) {
+          PackedGame packed(boards[0]);
+          for (unsigned int i = 1; i <= ply; ++i) {
+            packed.push(moves[i]);
+          }
+          writer.append(packed);
+        }
+      }
+      game = gameEnd;
+    }
+  }
+
+  m_games.fetch_add(games, std::memory_order_relaxed);
+  m_malformed.fetch_add(malformed, std::memory_order_relaxed);
+  m_positions.fetch_add(positions, std::memory_order_relaxed);
+}
@@ -0,0 +1,126 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PGN__
+#define __PGN__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+
+/*!
+ *  @struct PgnPosition
+ *  @brief A position of an imported game, as handed to the visitor.
+ */
+struct PgnPosition {
+  const Board& board;  //!< The position.
+  Move move;           //!< Move that led to it, empty for the first one.
+  unsigned int ply;    //!< Plies since the game's first position.
+  int result;          //!< 1 white won, 0 draw, -1 black won, 2 unknown.
+  unsigned int thread; //!< Worker handing the position over.
+};
+
+/*!
+ *  @struct PgnConfig
+ *  @brief Parameters of a PGN import.
+ */
+struct PgnConfig {
+  unsigned int threads = 1; //!< Worker threads.
+  std::string prefix;       //!< If set, games go to "<prefix>.<thread>.games".
+};
+
+/*!
+ *  @struct PgnStats
+ *  @brief Totals of a PGN import.
+ */
+struct PgnStats {
+  std::uint64_t games = 0;     //!< Games decoded.
+  std::uint64_t malformed = 0; //!< Games skipped as unreadable.
+  std::uint64_t positions = 0; //!< Positions handed over.
+  std::uint64_t bytes = 0;     //!< Size of the file.
+  double seconds = 0;          //!< Wall time of the import.
+};
+
+/*!
+ *  @class PgnReader
+ *  @brief Multi-threaded streaming reader of PGN game databases.
+ *
+ *  The file is memory-mapped and cut into chunks that workers claim one at
+ *  a time; a worker owns the games whose "[Event" tag starts in its chunk,
+ *  reading past the chunk's end to finish the last one. SAN moves are
+ *  matched in place against the board's move generator, so decoding a
+ *  move allocates nothing. A game is only handed over once all of its
+ *  moves decoded; one that does not is counted and skipped.
+ *
+ *  Decoded positions go to the visitor, called concurrently from all
+ *  workers, and with a prefix set every worker also writes its games as
+ *  PackedGame sequences into its own file.
+ */
+class PgnReader {
+public:
+  static constexpr std::size_t CHUNK = 1 << 20;  //!< Bytes per work unit.
+  static constexpr unsigned int MAX_PLIES = 1024; //!< Longer games are skipped.
+
+  //! Receives every decoded position, from any worker thread.
+  using Visitor = std::function<void(const PgnPosition&)>;
+
+private:
+  PgnConfig m_config;                   //!< Import parameters.
+  Visitor m_visitor;                    //!< May be empty.
+  const char* m_data;                   //!< Mapped file.
+  std::size_t m_size;                   //!< Its size.
+  std::atomic<std::size_t> m_nextChunk; //!< Next chunk to claim.
+  std::atomic<std::uint64_t> m_games;
+  std::atomic<std::uint64_t> m_malformed;
+  std::atomic<std::uint64_t> m_positions;
+
+public:
+  //! Prepares an import with the given parameters.
+  explicit PgnReader(const PgnConfig& config,
+                     const Visitor& visitor = Visitor());
+
+public:
+  /*!
+   *  @brief Imports the file, blocking until the workers are done.
+   *
+   *  @param r_stats Filled with the totals, also on failure.
+   *  @return False if the file can't be read.
+   */
+  bool run(const std::string& path, PgnStats& r_stats) noexcept;
+
+  /*!
+   *  @brief Finds the move a SAN token stands for.
+   *
+   *  Accepts check, mate and annotation suffixes and castling written with
+   *  letters or zeros.
+   *  @return False unless exactly one legal move matches.
+   */
+  static bool parseSan(const Board& board, const char* san,
+                       const std::size_t length, Move& r_move) noexcept;
+
+private:
+  //! Decodes the games starting in chunks until none are left.
+  void worker(const unsigned int id) noexcept;
+};
+
+#endif
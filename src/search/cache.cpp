@@ -0,0 +1,416 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*!
+ *  @struct FileHeader
+ *  @brief Start of a cache file, the records follow it.
+ */
+struct FileHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t recordSize;
+  std::uint64_t reserved[2];
+};
+
+//! Identifies cache files.
+static constexpr std::uint64_t MAGIC = 0x4E454C4C59434348ull;
+
+//! Layout of the records, bumped whenever Record or its packing changes.
+static constexpr std::uint32_t VERSION = 1;
+
+//! Fewest index slots.
+static constexpr std::size_t MIN_SLOTS = 1024;
+
+//! Returns the directory part of a path.
+static std::string directoryOf(const std::string& path) {
+  const std::size_t slash = path.rfind('/');
+  return slash == std::string::npos? "." : path.substr(0, slash + 1);
+}
+
+AnalysisCache::AnalysisCache()
+  : m_fd(-1)
+  , m_path()
+  , m_cap(SIZE * 1024 * 1024)
+  , m_records(nullptr)
+  , m_count(0)
+  , m_mapped(0)
+  , m_slots()
+  , m_positions(0)
+  , m_pending()
+  , m_pendingIndex()
+  , m_pendingMutex()
+  , m_probes(0)
+  , m_hits(0)
+  , m_rootHits(0)
+  , m_savedNodes(0)
+{}
+
+AnalysisCache::~AnalysisCache() {
+  close();
+}
+
+bool AnalysisCache::open(const std::string& path) {
+  close();
+  m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0) {
+    return false;
+  }
+  m_path = path;
+  m_probes = 0;
+  m_hits = 0;
+  m_rootHits = 0;
+  m_savedNodes = 0;
+  if (!load()) {
+    unload();
+    ::close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void AnalysisCache::close() noexcept {
+  if (!isOpen()) {
+    return;
+  }
+  flush();
+  unload();
+  ::close(m_fd);
+  m_fd = -1;
+}
+
+bool AnalysisCache::load() {
+  struct stat status;
+  if (fstat(m_fd, &status) != 0) {
+    return false;
+  }
+  std::size_t size = status.st_size;
+  FileHeader header = {MAGIC, VERSION, sizeof(Record), {0, 0}};
+  if (!size) {
+    if (pwrite(m_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        fdatasync(m_fd) != 0)
+    {
+      return false;
+    }
+    size = sizeof(header);
+  }
+  if (pread(m_fd, &header, sizeof(header), 0) != sizeof(header) ||
+      header.magic != MAGIC || header.version != VERSION ||
+      header.recordSize != sizeof(Record))
+  {
+    return false;
+  }
+  if (!map(size)) {
+    return false;
+  }
+
+  // Records past the first bad one were never completely written.
+  const std::size_t stored = (size - sizeof(FileHeader)) / sizeof(Record);
+  m_count = 0;
+  while (m_count < stored &&
+         m_records[m_count].check == checksum(m_records[m_count])) {
+    ++m_count;
+  }
+  const std::size_t valid = sizeof(FileHeader) + m_count * sizeof(Record);
+  if (valid != size && ftruncate(m_fd, valid) != 0) {
+    return false;
+  }
+
+  std::size_t slots = MIN_SLOTS;
+  while (slots < 2 * m_count) {
+    slots *= 2;
+  }
+  m_slots.assign(slots, 0);
+  m_positions = 0;
+  for (std::size_t i = 0; i < m_count; ++i) {
+    insert(i);
+  }
+  return true;
+}
+
+bool AnalysisCache::map(const std::size_t bytes) noexcept {
+  if (m_records) {
+    munmap(const_cast<char*>(reinterpret_cast<const char*>(m_records)) -
+           sizeof(FileHeader), m_mapped);
+    m_records = nullptr;
+  }
+  void* memory = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (memory == MAP_FAILED) {
+    m_mapped = 0;
+    return false;
+  }
+  m_records = reinterpret_cast<const Record*>(
+      static_cast<const char*>(memory) + sizeof(FileHeader));
+  m_mapped = bytes;
+  return true;
+}
+
+void AnalysisCache::unload() noexcept {
+  if (m_records) {
+    munmap(const_cast<char*>(reinterpret_cast<const char*>(m_records)) -
+           sizeof(FileHeader), m_mapped);
+  }
+  m_records = nullptr;
+  m_mapped = 0;
+  m_count = 0;
+  m_slots.clear();
+  m_positions = 0;
+}
+
+void AnalysisCache::insert(const std::uint32_t index) {
+  if (2 * (m_positions + 1) > m_slots.size()) {
+    std::vector<std::uint32_t> old(std::max(2 * m_slots.size(), MIN_SLOTS),
+                                   0);
+    old.swap(m_slots);
+    for (const std::uint32_t slot : old) {
+      if (slot) {
+        m_slots[find(m_records[slot - 1].key)] = slot;
+      }
+    }
+  }
+
+  const Record& record = m_records[index];
+  std::uint32_t& slot = m_slots[find(record.key)];
+  if (!slot) {
+    ++m_positions;
+  } else if (m_records[slot - 1].depth > record.depth) {
+    return;
+  }
+  slot = index + 1;
+}
+
+std::size_t AnalysisCache::find(const std::uint64_t key) const noexcept {
+  const std::size_t mask = m_slots.size() - 1;
+  std::size_t slot = key & mask;
+  while (m_slots[slot] && m_records[m_slots[slot] - 1].key != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+const AnalysisCache::Record*
+AnalysisCache::lookup(const std::uint64_t key) const noexcept {
+  if (m_slots.empty()) {
+    return nullptr;
+  }
+  const std::uint32_t slot = m_slots[find(key)];
+  return slot? &m_records[slot - 1] : nullptr;
+}
+
+bool AnalysisCache::probe(const std::uint64_t key,
+                          TranspositionTable::Data& r_data) const noexcept
+{
+  m_probes.fetch_add(1, std::memory_order_relaxed);
+  const Record* const record = lookup(key);
+  if (!record) {
+    return false;
+  }
+  m_hits.fetch_add(1, std::memory_order_relaxed);
+  r_data.move = record->move;
+  r_data.score = record->score;
+  r_data.depth = record->depth;
+  r_data.bound = TranspositionTable::Bound(record->bound);
+  return true;
+}
+
+bool AnalysisCache::probeRoot(const std::uint64_t key, const int depth,
+                              TranspositionTable::Data& r_data) noexcept
+{
+  const Record* const record = lookup(key);
+  if (!record || !record->move || record->depth < depth ||
+      TranspositionTable::Bound(record->bound) !=
+          TranspositionTable::Bound::Exact ||
+      !probe(key, r_data))
+  {
+    return false;
+  }
+  m_rootHits.fetch_add(1, std::memory_order_relaxed);
+  m_savedNodes.fetch_add(record->nodes, std::memory_order_relaxed);
+  return true;
+}
+
+void AnalysisCache::add(const std::uint64_t key, const std::uint16_t move,
+                        const int score, const int depth,
+                        const TranspositionTable::Bound bound,
+                        const std::uint64_t nodes)
+{
+  if (!isOpen()) {
+    return;
+  }
+  Record record = {};
+  record.key = key;
+  record.nodes = nodes;
+  record.move = move;
+  record.score = std::int16_t(score);
+  record.depth = std::uint8_t(depth);
+  record.bound = std::uint8_t(bound);
+  record.check = checksum(record);
+
+  const std::lock_guard<std::mutex> lock(m_pendingMutex);
+  const auto queued = m_pendingIndex.emplace(key, m_pending.size());
+  if (queued.second) {
+    m_pending.push_back(record);
+  } else if (m_pending[queued.first->second].depth <= record.depth) {
+    m_pending[queued.first->second] = record;
+  }
+}
+
+bool AnalysisCache::flush() {
+  if (!isOpen()) {
+    return false;
+  }
+  std::vector<Record> pending;
+  {
+    const std::lock_guard<std::mutex> lock(m_pendingMutex);
+    pending.swap(m_pending);
+    m_pendingIndex.clear();
+  }
+  if (!pending.empty()) {
+    // Written past the valid records, over any torn tail of a failed flush.
+    const std::size_t offset = sizeof(FileHeader) + m_count * sizeof(Record);
+    const std::size_t bytes = pending.size() * sizeof(Record);
+    if (pwrite(m_fd, pending.data(), bytes, offset) != ssize_t(bytes) ||
+        fdatasync(m_fd) != 0 || !map(offset + bytes))
+    {
+      return false;
+    }
+    const std::size_t first = m_count;
+    m_count += pending.size();
+    for (std::size_t i = first; i < m_count; ++i) {
+      insert(i);
+    }
+  }
+  return getSize() <= m_cap || compact();
+}
+
+bool AnalysisCache::compact() {
+  if (!isOpen()) {
+    return false;
+  }
+  std::vector<std::uint32_t> kept;
+  kept.reserve(m_positions);
+  for (const std::uint32_t slot : m_slots) {
+    if (slot) {
+      kept.push_back(slot - 1);
+    }
+  }
+  const std::size_t fit =
+      (m_cap * 3 / 4 - std::min(m_cap * 3 / 4, sizeof(FileHeader))) /
+      sizeof(Record);
+  if (kept.size() > fit) {
+    std::nth_element(kept.begin(), kept.begin() + fit, kept.end(),
+                     [this](const std::uint32_t a, const std::uint32_t b) {
+      return m_records[a].depth > m_records[b].depth;
+    });
+    kept.resize(fit);
+  }
+  // Keeping the file order keeps the newest result winning ties.
+  std::sort(kept.begin(), kept.end());
+
+  std::vector<Record> records;
+  records.reserve(kept.size());
+  for (const std::uint32_t index : kept) {
+    records.push_back(m_records[index]);
+  }
+
+  // Written and synced aside, then renamed over the old file.
+  const std::string temporary = m_path + ".tmp";
+  const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  const FileHeader header = {MAGIC, VERSION, sizeof(Record), {0, 0}};
+  const std::size_t bytes = records.size() * sizeof(Record);
+  const bool written =
+      write(fd, &header, sizeof(header)) == sizeof(header) &&
+      write(fd, records.data(), bytes) == ssize_t(bytes) && fsync(fd) == 0;
+  ::close(fd);
+  if (!written || rename(temporary.c_str(), m_path.c_str()) != 0) {
+    unlink(temporary.c_str());
+    return false;
+  }
+  const int directory = ::open(directoryOf(m_path).c_str(), O_RDONLY);
+  if (directory >= 0) {
+    fsync(directory);
+    ::close(directory);
+  }
+
+  // Queued results stay queued for the new file.
+  unload();
+  ::close(m_fd);
+  // Closed without close(), whose flush could compact again.
+  m_fd = ::open(m_path.c_str(), O_RDWR);
+  if (m_fd < 0 || !load()) {
+    unload();
+    if (m_fd >= 0) {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+    const std::lock_guard<std::mutex> lock(m_pendingMutex);
+    m_pending.clear();
+    m_pendingIndex.clear();
+    return false;
+  }
+  return true;
+}
+
+std::size_t AnalysisCache::getSize() const noexcept {
+  return isOpen()? sizeof(FileHeader) + m_count * sizeof(Record) : 0;
+}
+
+std::string AnalysisCache::describe() const {
+  const std::uint64_t probes = m_probes.load();
+  const std::uint64_t hits = m_hits.load();
+  return "cache " + m_path + ": " + std::to_string(m_count) + " records, " +
+         std::to_string(m_positions) + " positions, " +
+         std::to_string(getSize() / 1024) + " KiB, hits " +
+         std::to_string(hits) + "/" + std::to_string(probes) + " (" +
+         std::to_string(probes? hits * 100 / probes : 0) + "%), answered " +
+         std::to_string(m_rootHits.load()) + " searches saving " +
+         std::to_string(m_savedNodes.load()) + " nodes";
+}
+
+std::uint64_t AnalysisCache::checksum(const Record& record) noexcept {
+  std::uint64_t packed = std::uint64_t(record.move) |
+                         std::uint64_t(std::uint16_t(record.score)) << 16 |
+                         std::uint64_t(record.depth) << 32 |
+                         std::uint64_t(record.bound) << 40 |
+                         std::uint64_t(record.reserved) << 48;
+  std::uint64_t hash = MAGIC;
+  for (const std::uint64_t word : {record.key, record.nodes, packed}) {
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 29;
+  }
+  // Zero is what a hole in the file reads as, never a valid checksum.
+  return hash? hash : 1;
+}
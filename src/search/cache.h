@@ -0,0 +1,192 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CACHE__
+#define __CACHE__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tt.h"
+
+/*!
+ *  @class AnalysisCache
+ *  @brief Deep search results kept on disk from one session to the next.
+ *
+ *  The file is a header followed by fixed-size records, each carrying a
+ *  checksum. Records are only ever appended, once per search and synced
+ *  to disk, so a crash can at worst leave a torn tail, which the next
+ *  open cuts off. Opening maps the file and indexes it by key without
+ *  copying the records, the newest of the deepest result of a position
+ *  winning. When the file outgrows its cap it is compacted into a new file
+ *  holding one record per position, the deepest ones if it must shrink
+ *  further, which then atomically replaces the old one.
+ *
+ *  Probes may come from several search threads at once, the index only
+ *  changes in flush(), between searches.
+ */
+class AnalysisCache {
+public:
+  static constexpr int MIN_DEPTH = 6;       //!< Shallowest result recorded.
+  static constexpr unsigned int MAX_PLY = 2; //!< Deepest ply consulted.
+  static constexpr std::size_t SIZE = 256;  //!< Default size cap in MiB.
+
+private:
+  /*!
+   *  @struct Record
+   *  @brief A search result as stored in the file.
+   */
+  struct Record {
+    std::uint64_t key;   //!< Zobrist key of the position.
+    std::uint64_t nodes; //!< Nodes the search of the position took.
+    std::uint16_t move;  //!< Best move packed by PackedGame::packMove.
+    std::int16_t score;  //!< Score as stored in the hash table.
+    std::uint8_t depth;  //!< Depth searched.
+    std::uint8_t bound;  //!< TranspositionTable::Bound.
+    std::uint16_t reserved;
+    std::uint64_t check; //!< Checksum of the fields above.
+  };
+
+  int m_fd;                            //!< Open file, -1 if closed.
+  std::string m_path;                  //!< Path of the file.
+  std::size_t m_cap;                   //!< Size cap in bytes.
+  const Record* m_records;             //!< Mapped records.
+  std::size_t m_count;                 //!< Number of valid records.
+  std::size_t m_mapped;                //!< Bytes mapped.
+  std::vector<std::uint32_t> m_slots;  //!< Record index + 1 per key, 0 empty.
+  std::size_t m_positions;             //!< Keys in m_slots.
+  std::vector<Record> m_pending;       //!< Results not yet written.
+  std::unordered_map<std::uint64_t, std::size_t> m_pendingIndex; //!< Per key.
+  std::mutex m_pendingMutex;           //!< Guards m_pending.
+
+  mutable std::atomic<std::uint64_t> m_probes; //!< Lookups.
+  mutable std::atomic<std::uint64_t> m_hits;   //!< Successful lookups.
+  std::atomic<std::uint64_t> m_rootHits;       //!< Searches answered.
+  std::atomic<std::uint64_t> m_savedNodes;     //!< Their recorded nodes.
+
+public:
+  AnalysisCache();
+  ~AnalysisCache();
+
+  AnalysisCache(const AnalysisCache&) = delete;
+  AnalysisCache& operator=(const AnalysisCache&) = delete;
+
+public:
+  /*!
+   *  @brief Opens or creates the cache file at 'path'.
+   *
+   *  Fails if the file exists but is not a cache of this version.
+   */
+  bool open(const std::string& path);
+
+  //! Writes pending results and closes the file.
+  void close() noexcept;
+
+  //! Returns true if a file is open.
+  bool isOpen() const noexcept {
+    return m_fd >= 0;
+  }
+
+  //! Sets the size cap in MiB, compacting on the next flush if exceeded.
+  void setCap(const std::size_t mb) noexcept {
+    m_cap = mb * 1024 * 1024;
+  }
+
+  //! Looks the key up, filling 'r_data' like a hash table hit.
+  bool probe(const std::uint64_t key,
+             TranspositionTable::Data& r_data) const noexcept;
+
+  /*!
+   *  @brief Looks up an exact result of at least 'depth' for a root.
+   *
+   *  A hit answers the search or spares its first iterations, so its nodes
+   *  are counted as saved.
+   */
+  bool probeRoot(const std::uint64_t key, const int depth,
+                 TranspositionTable::Data& r_data) noexcept;
+
+  /*!
+   *  @brief Queues a result, written by the next flush().
+   *
+   *  Only the deepest, then newest, result per position stays queued.
+   */
+  void add(const std::uint64_t key, const std::uint16_t move,
+           const int score, const int depth,
+           const TranspositionTable::Bound bound,
+           const std::uint64_t nodes);
+
+  /*!
+   *  @brief Appends the queued results and syncs them to disk.
+   *
+   *  Compacts the file afterwards if it is over the cap.
+   */
+  bool flush();
+
+  /*!
+   *  @brief Rewrites the file with one record per position.
+   *
+   *  If that is still over three quarters of the cap, only the deepest
+   *  results that fit are kept.
+   */
+  bool compact();
+
+  //! Returns the number of records in the file.
+  std::size_t getCount() const noexcept {
+    return m_count;
+  }
+
+  //! Returns the number of distinct positions.
+  std::size_t getPositions() const noexcept {
+    return m_positions;
+  }
+
+  //! Returns the file size in bytes.
+  std::size_t getSize() const noexcept;
+
+  //! Describes the contents and hit rate since the file was opened.
+  std::string describe() const;
+
+private:
+  //! Maps the file and indexes its valid records, cutting a torn tail.
+  bool load();
+
+  //! Maps the first 'bytes' of the file, replacing the current mapping.
+  bool map(const std::size_t bytes) noexcept;
+
+  //! Unmaps the file and empties the index.
+  void unload() noexcept;
+
+  //! Returns the record of a key, null if missing.
+  const Record* lookup(const std::uint64_t key) const noexcept;
+
+  //! Indexes record 'index', keeping the deepest, then newest, per key.
+  void insert(const std::uint32_t index);
+
+  //! Returns the slot of a key, empty if the key is missing.
+  std::size_t find(const std::uint64_t key) const noexcept;
+
+  //! Computes the checksum of a record.
+  static std::uint64_t checksum(const Record& record) noexcept;
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/movelist.h"
+#include "proof.h"
+
+//! Frames needed: one per ply of the longest mate and one for the mated side.
+static constexpr unsigned int FRAMES = 2 * MateSearch::MAX_MOVES;
+
+//! Initial proof number of an unsearched position where no check was given.
+static constexpr std::uint32_t QUIET = 2;
+
+//! Returns 'value' capped at INF.
+static std::uint32_t capped(const std::uint64_t value) noexcept {
+  return std::uint32_t(std::min<std::uint64_t>(value, MateSearch::INF));
+}
+
+MateSearch::MateSearch(const std::size_t mb)
+  : m_table(mb)
+  , m_frames(new Frame[FRAMES])
+  , m_limits()
+  , m_reporter()
+  , m_start()
+  , m_nodes(0)
+  , m_stopped(false)
+{}
+
+MateResult MateSearch::go(const Board& board, const unsigned int moves,
+                          const SearchLimits& limits) noexcept
+{
+  m_limits = limits;
+  m_start = Clock::now();
+  m_nodes = 0;
+  m_stopped = false;
+
+  // No iterative deepening: disproving the shorter mates first would cost
+  // far more than the proof itself.
+  MateResult result;
+  const unsigned int remaining = 2 * std::min(moves, MAX_MOVES) - 1;
+  prove(board, remaining, true, INF, INF, 0);
+  const ProofEntry* root = m_table.probe(board.getKey(), remaining);
+  if (!m_stopped && root && !root->proof) {
+    result.found = true;
+    result.moves = (root->mate + 1) / 2;
+    extractLine(board, remaining, result);
+  }
+
+  result.nodes = m_nodes;
+  result.time = elapsed();
+  if (result.found && m_reporter) {
+    m_reporter(result);
+  }
+  return result;
+}
+
+unsigned int MateSearch::expand(const Board& board,
+                                const unsigned int remaining,
+                                const bool attacker,
+                                const unsigned int ply) noexcept
+{
+  Frame& frame = m_frames[ply];
+  frame.moves.clear();
+  board.getValidMoves(frame.moves);
+
+  unsigned int count = 0;
+  for (const Move& move : frame.moves) {
+    Board& child = frame.children[count];
+    child = board.makeMove(move);
+    if (!child.isLegal()) {
+      continue;
+    }
+    // With one ply left only a check can mate.
+    if (attacker && remaining == 1 && !child.isInCheck()) {
+      continue;
+    }
+    frame.moves[count++] = move;
+    // A defender out of plies only needs to know it isn't mated.
+    if (!attacker && !remaining) {
+      break;
+    }
+  }
+  frame.moves.resize(count);
+  return count;
+}
+
+void MateSearch::prove(const Board& board, const unsigned int remaining,
+                       const bool attacker, const std::uint32_t proofLimit,
+                       const std::uint32_t disproofLimit,
+                       const unsigned int ply) noexcept
+{
+  const std::uint64_t nodes = m_nodes;
+  visitNode();
+  const std::uint64_t key = board.getKey();
+  const unsigned int count = expand(board, remaining, attacker, ply);
+
+  // Mate, stalemate, no moves left or no checks on the last ply.
+  if (!count || (!attacker && !remaining)) {
+    const bool isMate = !attacker && !count && board.isInCheck();
+    m_table.store(key, remaining, isMate? 0 : INF, isMate? INF : 0, 1, 0);
+    return;
+  }
+
+  // Children's numbers are read once, then only the searched child's.
+  Frame& frame = m_frames[ply];
+  for (unsigned int i = 0; i < count; ++i) {
+    load(frame, i, remaining - 1);
+  }
+
+  std::uint32_t proof = 0;
+  std::uint32_t disproof = 0;
+  unsigned int mate = 0;
+  for (;;) {
+    // The node's numbers from its children's: the attacker needs one
+    // proven child, the defender one disproven.
+    const std::uint32_t* minimised = attacker? frame.proof : frame.disproof;
+    const std::uint32_t* summed = attacker? frame.disproof : frame.proof;
+    std::uint64_t sum = 0;
+    std::uint32_t least = INF;
+    std::uint32_t second = INF;
+    unsigned int best = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+      sum += summed[i];
+      if (minimised[i] < least) {
+        second = least;
+        least = minimised[i];
+        best = i;
+      } else if (minimised[i] < second) {
+        second = minimised[i];
+      }
+    }
+    // Without a resolved child the sum must not pass for one.
+    const std::uint32_t total = capped(sum) == INF && least? INF - 1 :
+                                                             capped(sum);
+    proof = attacker? least : total;
+    disproof = attacker? total : least;
+    if (proof >= proofLimit || disproof >= disproofLimit || m_stopped) {
+      break;
+    }
+
+    // Search the best child until it stops being the best, with a margin
+    // over the second best so that close siblings don't alternate.
+    const std::uint32_t margin = second + second / 4 + 1;
+    if (attacker) {
+      prove(frame.children[best], remaining - 1, false,
+            std::min(proofLimit, margin),
+            capped(std::uint64_t(disproofLimit) - disproof +
+                   frame.disproof[best]),
+            ply + 1);
+    } else {
+      prove(frame.children[best], remaining - 1, true,
+            capped(std::uint64_t(proofLimit) - proof + frame.proof[best]),
+            std::min(disproofLimit, margin),
+            ply + 1);
+    }
+    load(frame, best, remaining - 1);
+  }
+
+  // Plies to mate: the quickest proven move, or the longest defence.
+  if (!proof) {
+    mate = attacker? ~0u : 0;
+    for (unsigned int i = 0; i < count; ++i) {
+      if (!frame.proof[i]) {
+        mate = attacker? std::min<unsigned int>(mate, frame.mate[i] + 1)
+                       : std::max<unsigned int>(mate, frame.mate[i] + 1);
+      }
+    }
+  }
+  m_table.store(key, remaining, proof, disproof,
+                capped(m_nodes - nodes), proof? 0 : mate);
+}
+
+void MateSearch::extractLine(const Board& board, unsigned int remaining,
+                             MateResult& r_result) noexcept
+{
+  Board current = board;
+  bool attacker = true;
+  for (unsigned int ply = 0; remaining; ++ply) {
+    const unsigned int count = expand(current, remaining, attacker, ply);
+    Frame& frame = m_frames[ply];
+
+    // The attacker plays its quickest proven mate, the defender holds out
+    // longest. Children the table dropped are proven again; the attacker
+    // only does so if none of its moves is still known to mate.
+    int chosen = -1;
+    unsigned int mate = 0;
+    for (unsigned int pass = 0; pass < 2 && chosen < 0; ++pass) {
+      for (unsigned int i = 0; i < count; ++i) {
+        const Board& child = frame.children[i];
+        const ProofEntry* entry = m_table.probe(child.getKey(), remaining - 1);
+        if ((pass || !attacker) &&
+            (!entry || (entry->proof && entry->disproof)))
+        {
+          prove(child, remaining - 1, !attacker, INF, INF, ply + 1);
+          entry = m_table.probe(child.getKey(), remaining - 1);
+        }
+        if (!entry || entry->proof) {
+          continue;
+        }
+        if (chosen < 0 || (attacker? entry->mate < mate : entry->mate > mate)) {
+          chosen = i;
+          mate = entry->mate;
+        }
+      }
+    }
+    if (chosen < 0 || m_stopped) {
+      return;
+    }
+
+    r_result.pv[r_result.pvLength++] = frame.moves[chosen];
+    current = frame.children[chosen];
+    attacker = !attacker;
+    --remaining;
+  }
+}
+
+void MateSearch::load(Frame& r_frame, const unsigned int i,
+                      const unsigned int remaining) noexcept
+{
+  const ProofEntry* entry =
+      m_table.probe(r_frame.children[i].getKey(), remaining);
+  r_frame.proof[i] = entry? entry->proof :
+                     r_frame.children[i].isInCheck()? 1 : QUIET;
+  r_frame.disproof[i] = entry? entry->disproof : 1;
+  r_frame.mate[i] = entry? entry->mate : 0;
+}
+
+bool MateSearch::visitNode() noexcept {
+  ++m_nodes;
+  if (m_limits.nodes && m_nodes >= m_limits.nodes) {
+    m_stopped = true;
+  }
+  // Clock and external requests are polled every 1024 nodes.
+  if (!(m_nodes & 1023)) {
+    if ((m_limits.stop && m_limits.stop->load(std::memory_order_relaxed)) ||
+        (m_limits.time && elapsed() >= m_limits.time))
+    {
+      m_stopped = true;
+    }
+  }
+  return m_stopped;
+}
+
+std::uint64_t MateSearch::elapsed() const noexcept {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - m_start).count();
+}
@@ -0,0 +1,157 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MATE__
+#define __MATE__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/movelist.h"
+#include "proof.h"
+#include "search.h"
+
+/*!
+ *  @struct MateResult
+ *  @brief Outcome of a mate search.
+ */
+struct MateResult {
+  bool found = false;        //!< True if a mate was proven.
+  unsigned int moves = 0;    //!< Mate in this many moves, if found.
+  Move pv[SearchFrame::MAX_PLY]; //!< Mating line, longest defence.
+  unsigned int pvLength = 0; //!< Number of moves in pv.
+  std::uint64_t nodes = 0;   //!< Positions expanded.
+  std::uint64_t time = 0;    //!< Milliseconds spent.
+};
+
+/*!
+ *  @class MateSearch
+ *  @brief Depth-first proof-number (df-pn) search for forced mates.
+ *
+ *  The side to move attacks: a position is proven when one of its moves
+ *  leads to a proven position, and a defending position when all of its
+ *  moves do. Proof and disproof numbers, the number of leaves still to
+ *  resolve for either outcome, steer the search to the most promising line
+ *  with thresholds that let it stay depth-first.
+ *
+ *  The plies left are part of every position's identity, so the search
+ *  graph has no cycles and each result holds exactly for its depth. The
+ *  mate is proven for the full depth at once, so it need not be the
+ *  shortest; the line reported takes the quickest mate the proof knows and
+ *  the longest defence, re-proving any part of it the table dropped.
+ */
+class MateSearch {
+public:
+  static constexpr unsigned int MAX_MOVES = 32;  //!< Longest mate searched.
+  static constexpr std::uint32_t INF = 1u << 30; //!< Bigger than any number.
+
+  //! Called whenever a mate was proven.
+  using Reporter = std::function<void(const MateResult&)>;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /*!
+   *  @struct Frame
+   *  @brief Children of the position expanded at one ply.
+   */
+  struct Frame {
+    MoveList moves;                            //!< Legal moves searched.
+    Board children[MoveList::CAPACITY];        //!< Positions after 'moves'.
+    std::uint32_t proof[MoveList::CAPACITY];   //!< Children's proof numbers.
+    std::uint32_t disproof[MoveList::CAPACITY]; //!< And disproof numbers.
+    std::uint16_t mate[MoveList::CAPACITY];    //!< Plies to mate if proven.
+  };
+
+  ProofTable m_table;                 //!< Proof and disproof numbers.
+  std::unique_ptr<Frame[]> m_frames;  //!< One per ply.
+  SearchLimits m_limits;              //!< Limits of the running search.
+  Reporter m_reporter;                //!< May be empty.
+  Clock::time_point m_start;          //!< When the running search started.
+  std::uint64_t m_nodes;              //!< Positions expanded so far.
+  bool m_stopped;                     //!< Set once a limit is hit.
+
+public:
+  //! Creates a search with a table of 'mb' MiB.
+  explicit MateSearch(const std::size_t mb = 16);
+
+public:
+  /*!
+   *  @brief Looks for a mate in at most 'moves' moves.
+   *
+   *  Only the time, node and stop limits apply.
+   */
+  MateResult go(const Board& board, const unsigned int moves,
+                const SearchLimits& limits) noexcept;
+
+  //! Sets the callback invoked once a mate is proven.
+  void setReporter(const Reporter& reporter) {
+    m_reporter = reporter;
+  }
+
+  //! Reallocates the table with 'mb' MiB.
+  void setHashSize(const std::size_t mb) {
+    m_table.resize(mb);
+  }
+
+  //! Drops all proof numbers.
+  void clear() noexcept {
+    m_table.clear();
+  }
+
+  //! Returns the proof table.
+  const ProofTable& getTable() const noexcept {
+    return m_table;
+  }
+
+private:
+  /*!
+   *  @brief Searches the position until its numbers reach the thresholds.
+   *
+   *  @param remaining Plies the attacker has left.
+   *  @param attacker True if the attacker is to move.
+   */
+  void prove(const Board& board, const unsigned int remaining,
+             const bool attacker, const std::uint32_t proofLimit,
+             const std::uint32_t disproofLimit, const unsigned int ply) noexcept;
+
+  //! Fills 'ply's frame with the moves worth searching, returns their count.
+  unsigned int expand(const Board& board, const unsigned int remaining,
+                      const bool attacker, const unsigned int ply) noexcept;
+
+  //! Reads the numbers of child 'i' from the table into the frame.
+  void load(Frame& r_frame, const unsigned int i,
+            const unsigned int remaining) noexcept;
+
+  //! Follows the proven tree from the root into 'r_result'.
+  void extractLine(const Board& board, unsigned int remaining,
+                   MateResult& r_result) noexcept;
+
+  //! Counts a node, returns true once a limit is hit.
+  bool visitNode() noexcept;
+
+  //! Milliseconds since the search started.
+  std::uint64_t elapsed() const noexcept;
+};
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mcts.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/movelist.h"
+#include "../chess/packed.h"
+#include "../eval/eval.h"
+
+//! Fixed-point unit of the node values.
+static constexpr std::uint64_t ONE = 1 << 16;
+
+//! Value of an unvisited child below its parent's, from the parent's side.
+static constexpr float FIRST_PLAY_REDUCTION = 0.1f;
+
+//! Returns the win probability of a score from the side to move.
+static float winProbability(const int score) noexcept {
+  return 1.0f / (1.0f + std::exp(-score / Mcts::SCALE));
+}
+
+Mcts::Mcts(const std::size_t mb)
+  : m_nodes()
+  , m_capacity(0)
+  , m_used(0)
+  , m_root()
+  , m_hasTree(false)
+  , m_threads(1)
+  , m_limits()
+  , m_history()
+  , m_reporter()
+  , m_start()
+  , m_playouts(0)
+  , m_stopped(false)
+  , m_reused(0)
+{
+  static_assert(sizeof(Node) == 24, "MCTS nodes must stay 24 bytes");
+  setMemory(mb);
+}
+
+void Mcts::setMemory(const std::size_t mb) {
+  const std::size_t nodes = (std::max<std::size_t>(mb, 1) << 20) / sizeof(Node);
+  m_capacity = std::min<std::size_t>(nodes, UINT32_MAX);
+  m_nodes.reset(new Node[m_capacity]);
+  m_hasTree = false;
+}
+
+MctsResult Mcts::go(const Board& board, const SearchLimits& limits,
+                    const KeyHistory& history) noexcept
+{
+  m_limits = limits;
+  m_history = history;
+  m_start = Clock::now();
+  m_playouts = 0;
+  m_stopped = false;
+  setRoot(board);
+  m_hasTree = true;
+
+  std::vector<std::thread> helpers;
+  for (unsigned int id = 1; id < m_threads; ++id) {
+    helpers.emplace_back(&Mcts::worker, this, id);
+  }
+  worker(0);
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+
+  const MctsResult& result = getResult();
+  if (m_reporter) {
+    m_reporter(result);
+  }
+  return result;
+}
+
+void Mcts::worker(const unsigned int id) noexcept {
+  KeyHistory history = m_history;
+  std::unique_ptr<Leaf[]> leaves(new Leaf[BATCH]);
+  std::uint64_t reported = 0;
+
+  while (!m_stopped.load(std::memory_order_relaxed)) {
+    // Gather the batch; known results need no evaluation.
+    unsigned int count = 0;
+    while (count < BATCH && !m_stopped.load(std::memory_order_relaxed)) {
+      descend(leaves[count++], history);
+    }
+
+    for (unsigned int i = 0; i < count; ++i) {
+      Leaf& leaf = leaves[i];
+      if (leaf.isKnown) {
+        backup(leaf);
+        continue;
+      }
+      // The result is for the side that moved into the leaf.
+      leaf.value = 1.0f - winProbability(Eval::evaluate(leaf.board));
+      Node& node = m_nodes[leaf.path[leaf.length - 1]];
+      if (leaf.expand && expand(node, leaf.board)) {
+        const State state = node.state.load(std::memory_order_relaxed);
+        if (state == State::Lost) {
+          leaf.value = 1.0f;
+        } else if (state == State::Drawn) {
+          leaf.value = 0.5f;
+        }
+      }
+      backup(leaf);
+    }
+
+    // Limits; a decided root has nothing left to search.
+    const std::uint64_t playouts = m_playouts.fetch_add(count) + count;
+    const State root = m_nodes[0].state.load(std::memory_order_relaxed);
+    if ((m_limits.nodes && playouts >= m_limits.nodes) ||
+        (m_limits.stop && m_limits.stop->load(std::memory_order_relaxed)) ||
+        (m_limits.time && elapsed() >= m_limits.time) ||
+        root == State::Lost || root == State::Drawn)
+    {
+      m_stopped = true;
+    }
+    if (!id && m_reporter && elapsed() >= reported + REPORT) {
+      reported = elapsed();
+      m_reporter(getResult());
+    }
+  }
+}
+
+void Mcts::descend(Leaf& r_leaf, KeyHistory& r_history) noexcept {
+  r_leaf.board = m_root;
+  r_leaf.length = 0;
+  r_leaf.isKnown = false;
+  r_leaf.expand = false;
+
+  std::uint32_t index = 0;
+  for (;;) {
+    Node& node = m_nodes[index];
+    r_leaf.path[r_leaf.length++] = index;
+    node.visits.fetch_add(1, std::memory_order_relaxed);
+
+    const State state = node.state.load(std::memory_order_acquire);
+    if (state == State::Lost || state == State::Drawn) {
+      r_leaf.isKnown = true;
+      r_leaf.value = state == State::Lost? 1.0f : 0.5f;
+      break;
+    }
+    if (r_leaf.length > 1 && (r_leaf.board.isFiftyMoveDraw() ||
+                              r_history.isRepetition(r_leaf.board)))
+    {
+      r_leaf.isKnown = true;
+      r_leaf.value = 0.5f;
+      break;
+    }
+    if (state == State::Leaf) {
+      State expected = State::Leaf;
+      r_leaf.expand = node.state.compare_exchange_strong(
+          expected, State::Expanding, std::memory_order_acq_rel);
+      break;
+    }
+    if (state == State::Expanding || r_leaf.length == SearchFrame::MAX_PLY) {
+      break;
+    }
+
+    index = select(node);
+    r_history.push(r_leaf.board.getKey());
+    r_leaf.board = r_leaf.board.makeMove(PackedGame::unpackMove(
+        m_nodes[index].move, r_leaf.board.isWhitesMove()));
+  }
+
+  for (unsigned int i = 1; i < r_leaf.length; ++i) {
+    r_history.pop();
+  }
+}
+
+std::uint32_t Mcts::select(const Node& node) const noexcept {
+  const std::uint32_t first = node.children.load(std::memory_order_acquire);
+  const std::uint32_t visits = node.visits.load(std::memory_order_relaxed);
+  const float parent = visits?
+      1.0f - float(node.value.load(std::memory_order_relaxed)) /
+             (float(visits) * ONE) : 0.5f;
+  const float firstPlay = std::max(0.0f, parent - FIRST_PLAY_REDUCTION);
+  const float exploration = EXPLORATION * std::sqrt(float(visits));
+
+  std::uint32_t best = first;
+  float bestScore = -1.0f;
+  for (std::uint32_t i = first; i < first + node.count; ++i) {
+    const Node& child = m_nodes[i];
+    const std::uint32_t n = child.visits.load(std::memory_order_relaxed);
+    const float q = n? float(child.value.load(std::memory_order_relaxed)) /
+                       (float(n) * ONE) : firstPlay;
+    const float score = q + exploration * child.prior / (1 + n);
+    if (score > bestScore) {
+      bestScore = score;
+      best = i;
+    }
+  }
+  return best;
+}
+
+bool Mcts::expand(Node& r_node, const Board& board) noexcept {
+  // Kept per thread: constructing a MoveList initialises every slot.
+  thread_local MoveList moves;
+  moves.clear();
+  board.getLegalMoves(moves);
+  if (moves.empty()) {
+    r_node.state.store(board.isInCheck()? State::Lost : State::Drawn,
+                       std::memory_order_release);
+    return true;
+  }
+
+  // Once full, the pointer is left alone so that it cannot wrap around.
+  const std::uint32_t count = moves.size();
+  if (std::uint64_t(m_used.load(std::memory_order_relaxed)) + count >
+      m_capacity)
+  {
+    r_node.state.store(State::Leaf, std::memory_order_release);
+    return false;
+  }
+  const std::uint32_t first = m_used.fetch_add(count);
+  if (std::uint64_t(first) + count > m_capacity) {
+    r_node.state.store(State::Leaf, std::memory_order_release);
+    return false;
+  }
+
+  // Priors: captures by the victim's value, promotions by the new piece's.
+  float weights[MoveList::CAPACITY];
+  float total = 0;
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const Move& move = moves[i];
+    weights[i] = 1.0f +
+        float(Eval::pieceValue(board.getVal(move.to))) / Eval::PAWN +
+        float(Eval::pieceValue(move.isPromotion()? move.promotion : ' ')) /
+        Eval::PAWN;
+    total += weights[i];
+  }
+  for (std::uint32_t i = 0; i < count; ++i) {
+    Node& child = m_nodes[first + i];
+    child.value.store(0, std::memory_order_relaxed);
+    child.visits.store(0, std::memory_order_relaxed);
+    child.children.store(0, std::memory_order_relaxed);
+    child.move = PackedGame::packMove(moves[i]);
+    child.count = 0;
+    child.state.store(State::Leaf, std::memory_order_relaxed);
+    child.prior = weights[i] / total;
+  }
+
+  r_node.count = count;
+  r_node.children.store(first, std::memory_order_relaxed);
+  r_node.state.store(State::Inner, std::memory_order_release);
+  return true;
+}
+
+void Mcts::backup(const Leaf& leaf) noexcept {
+  float value = leaf.value;
+  for (unsigned int i = leaf.length; i-- > 0;) {
+    m_nodes[leaf.path[i]].value.fetch_add(std::uint64_t(value * ONE),
+                                          std::memory_order_relaxed);
+    value = 1.0f - value;
+  }
+}
+
+void Mcts::setRoot(const Board& board) noexcept {
+  if (m_hasTree) {
+    if (board.getKey() == m_root.getKey()) {
+      m_reused = std::min(m_used.load(), m_capacity);
+      return;
+    }
+    const std::uint32_t index = find(0, m_root, board.getKey(), REUSE_PLIES);
+    if (index) {
+      compact(index);
+      m_root = board;
+      m_reused = m_used;
+      return;
+    }
+  }
+  reset();
+  m_root = board;
+}
+
+std::uint32_t Mcts::find(const std::uint32_t index, const Board& board,
+                         const std::uint64_t key,
+                         const unsigned int plies) const noexcept
+{
+  const Node& node = m_nodes[index];
+  if (!plies || node.state.load(std::memory_order_relaxed) != State::Inner) {
+    return 0;
+  }
+  const std::uint32_t first = node.children.load(std::memory_order_relaxed);
+  for (std::uint32_t i = first; i < first + node.count; ++i) {
+    if (!m_nodes[i].visits.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    const Board& child = board.makeMove(
+        PackedGame::unpackMove(m_nodes[i].move, board.isWhitesMove()));
+    if (child.getKey() == key) {
+      return i;
+    }
+    const std::uint32_t found = find(i, child, key, plies - 1);
+    if (found) {
+      return found;
+    }
+  }
+  return 0;
+}
+
+void Mcts::compact(const std::uint32_t index) noexcept {
+  /*!
+   *  @struct Copy
+   *  @brief A node's fields outside the arena.
+   */
+  struct Copy {
+    std::uint64_t value;
+    std::uint32_t visits;
+    std::uint32_t children;
+    std::uint16_t move;
+    std::uint8_t count;
+    State state;
+    float prior;
+  };
+
+  // Breadth first, so that every node's children stay contiguous.
+  std::vector<std::uint32_t> order(1, index);
+  std::vector<Copy> copies;
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    const Node& node = m_nodes[order[i]];
+    const State state = node.state.load(std::memory_order_relaxed);
+    copies.push_back(Copy{node.value.load(std::memory_order_relaxed),
+                          node.visits.load(std::memory_order_relaxed),
+                          0, node.move, node.count, state, node.prior});
+    if (state == State::Inner) {
+      copies.back().children = order.size();
+      const std::uint32_t first =
+          node.children.load(std::memory_order_relaxed);
+      for (std::uint32_t child = 0; child < node.count; ++child) {
+        order.push_back(first + child);
+      }
+    }
+  }
+
+  for (std::size_t i = 0; i < copies.size(); ++i) {
+    Node& node = m_nodes[i];
+    node.value.store(copies[i].value, std::memory_order_relaxed);
+    node.visits.store(copies[i].visits, std::memory_order_relaxed);
+    node.children.store(copies[i].children, std::memory_order_relaxed);
+    node.move = copies[i].move;
+    node.count = copies[i].count;
+    node.state.store(copies[i].state, std::memory_order_relaxed);
+    node.prior = copies[i].prior;
+  }
+  m_used = copies.size();
+}
+
+void Mcts::reset() noexcept {
+  Node& root = m_nodes[0];
+  root.value.store(0, std::memory_order_relaxed);
+  root.visits.store(0, std::memory_order_relaxed);
+  root.children.store(0, std::memory_order_relaxed);
+  root.move = 0;
+  root.count = 0;
+  root.state.store(State::Leaf, std::memory_order_relaxed);
+  root.prior = 1.0f;
+  m_used = 1;
+  m_reused = 0;
+}
+
+MctsResult Mcts::getResult() const noexcept {
+  MctsResult result;
+  result.playouts = m_playouts.load(std::memory_order_relaxed);
+  result.nodes = std::min(m_used.load(std::memory_order_relaxed), m_capacity);
+  result.memory = result.nodes * sizeof(Node);
+  result.reused = m_reused;
+  result.time = elapsed();
+
+  // Most visited line; the first move's value gives the score.
+  std::uint32_t index = 0;
+  bool white = m_root.isWhitesMove();
+  while (result.pvLength < SearchFrame::MAX_PLY &&
+         m_nodes[index].state.load(std::memory_order_acquire) == State::Inner)
+  {
+    const Node& node = m_nodes[index];
+    const std::uint32_t first = node.children.load(std::memory_order_acquire);
+    std::uint32_t best = first;
+    for (std::uint32_t i = first; i < first + node.count; ++i) {
+      if (m_nodes[i].visits.load(std::memory_order_relaxed) >
+          m_nodes[best].visits.load(std::memory_order_relaxed))
+      {
+        best = i;
+      }
+    }
+    const std::uint32_t visits =
+        m_nodes[best].visits.load(std::memory_order_relaxed);
+    if (!visits) {
+      break;
+    }
+    if (!result.pvLength) {
+      const float q = std::clamp(
+          float(m_nodes[best].value.load(std::memory_order_relaxed)) /
+          (float(visits) * ONE), 0.001f, 0.999f);
+      result.score = int(SCALE * std::log(q / (1.0f - q)));
+    }
+    result.pv[result.pvLength++] =
+        PackedGame::unpackMove(m_nodes[best].move, white);
+    white = !white;
+    index = best;
+  }
+  if (result.pvLength) {
+    result.bestMove = result.pv[0];
+  }
+  return result;
+}
+
+std::uint64_t Mcts::elapsed() const noexcept {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - m_start).count();
+}
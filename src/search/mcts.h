@@ -0,0 +1,212 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MCTS__
+#define __MCTS__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "repetition.h"
+#include "search.h"
+#include "stack.h"
+
+/*!
+ *  @struct MctsResult
+ *  @brief State of a Monte Carlo tree search.
+ */
+struct MctsResult {
+  Move bestMove;                 //!< Most visited root move.
+  Move pv[SearchFrame::MAX_PLY]; //!< Most visited line.
+  unsigned int pvLength = 0;     //!< Number of moves in pv.
+  int score = 0;                 //!< Centipawns equivalent of bestMove's value.
+  std::uint64_t playouts = 0;    //!< Playouts of this search.
+  std::uint64_t nodes = 0;       //!< Nodes in the tree.
+  std::size_t memory = 0;        //!< Bytes used by the nodes.
+  std::uint64_t reused = 0;      //!< Nodes kept from the previous search.
+  std::uint64_t time = 0;        //!< Milliseconds spent.
+};
+
+/*!
+ *  @class Mcts
+ *  @brief Multi-threaded Monte Carlo tree search with PUCT selection.
+ *
+ *  Nodes are 24 bytes, allocated from one preallocated arena with an
+ *  atomic bump pointer; the children of a node are contiguous, so a node
+ *  only stores the index of the first one. Threads descend the tree
+ *  without locks: visits are counted on the way down, before the result is
+ *  known, which is a virtual loss steering the other threads to other
+ *  lines until the result is backed up. The first thread to reach a leaf
+ *  expands it; the others evaluate it as it is.
+ *
+ *  Every thread gathers BATCH leaves before evaluating and backing them up.
+ *  Leaves are scored one at a time: the batched evaluator only takes packed
+ *  positions, and packing a board costs more than scoring it. Static scores
+ *  become win probabilities with a logistic curve, and priors come from
+ *  captures and promotions.
+ *
+ *  The tree is kept after a search. If the next root is the old root or a
+ *  position up to REUSE_PLIES plies below it, its subtree is moved to the
+ *  start of the arena and searched further.
+ */
+class Mcts {
+public:
+  static constexpr unsigned int BATCH = 16;       //!< Leaves per round.
+  static constexpr std::size_t MEMORY = 64;       //!< Default arena in MiB.
+  static constexpr unsigned int REUSE_PLIES = 4;  //!< Deepest reused root.
+  static constexpr float EXPLORATION = 1.5f;      //!< PUCT constant.
+  static constexpr float SCALE = 400.0f;          //!< Centipawns per logit.
+  static constexpr std::uint64_t REPORT = 1000;   //!< Ms between reports.
+
+  //! Called periodically and once the search ends.
+  using Reporter = std::function<void(const MctsResult&)>;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /*!
+   *  @enum State
+   *  @brief Expansion state of a node, or its known outcome.
+   */
+  enum class State : std::uint8_t
+  {
+    Leaf,      //!< Not expanded yet.
+    Expanding, //!< A thread is expanding it.
+    Inner,     //!< Children are valid.
+    Lost,      //!< Side to move is mated.
+    Drawn      //!< Stalemate.
+  };
+
+  /*!
+   *  @struct Node
+   *  @brief A position of the tree, identified by the move leading to it.
+   */
+  struct Node {
+    std::atomic<std::uint64_t> value;    //!< Results of the mover, 1/65536.
+    std::atomic<std::uint32_t> visits;   //!< Visits, running descents included.
+    std::atomic<std::uint32_t> children; //!< First child, valid once Inner.
+    std::uint16_t move;                  //!< Packed move leading here.
+    std::uint8_t count;                  //!< Number of children.
+    std::atomic<State> state;            //!< Expansion state.
+    float prior;                         //!< Probability of the move.
+  };
+
+  /*!
+   *  @struct Leaf
+   *  @brief A descent waiting for its evaluation.
+   */
+  struct Leaf {
+    Board board;                              //!< Position reached.
+    std::uint32_t path[SearchFrame::MAX_PLY]; //!< Nodes from the root.
+    unsigned int length;                      //!< Number of nodes in path.
+    float value;                              //!< Result for the mover.
+    bool isKnown;                             //!< True for draws and mates.
+    bool expand;                              //!< True if this one expands.
+  };
+
+  std::unique_ptr<Node[]> m_nodes;       //!< The arena, root first.
+  std::uint32_t m_capacity;              //!< Nodes in the arena.
+  std::atomic<std::uint32_t> m_used;     //!< Nodes allocated.
+  Board m_root;                          //!< Position of node 0.
+  bool m_hasTree;                        //!< False until a search ran.
+  unsigned int m_threads;                //!< Threads per search.
+  SearchLimits m_limits;                 //!< Limits of the running search.
+  KeyHistory m_history;                  //!< Game keys before the root.
+  Reporter m_reporter;                   //!< May be empty.
+  Clock::time_point m_start;             //!< When the running search started.
+  std::atomic<std::uint64_t> m_playouts; //!< Playouts so far.
+  std::atomic<bool> m_stopped;           //!< Set once a limit is hit.
+  std::uint64_t m_reused;                //!< Nodes kept by the last search.
+
+public:
+  //! Creates a search with an arena of 'mb' MiB.
+  explicit Mcts(const std::size_t mb = MEMORY);
+
+  Mcts(const Mcts&) = delete;
+
+public:
+  /*!
+   *  @brief Searches the board until a limit is hit.
+   *
+   *  The node limit counts playouts; the depth limit is ignored.
+   */
+  MctsResult go(const Board& board, const SearchLimits& limits,
+                const KeyHistory& history = KeyHistory()) noexcept;
+
+  //! Reallocates the arena with 'mb' MiB, dropping the tree.
+  void setMemory(const std::size_t mb);
+
+  //! Sets the number of threads searching.
+  void setThreads(const unsigned int threads) noexcept {
+    m_threads = threads? threads : 1;
+  }
+
+  //! Drops the tree.
+  void clear() noexcept {
+    m_hasTree = false;
+  }
+
+  //! Sets the callback invoked while searching.
+  void setReporter(const Reporter& reporter) {
+    m_reporter = reporter;
+  }
+
+private:
+  //! Descends and backs up playouts until the search stops.
+  void worker(const unsigned int id) noexcept;
+
+  //! Walks from the root to a leaf, counting the visits on the way.
+  void descend(Leaf& r_leaf, KeyHistory& r_history) noexcept;
+
+  //! Gives a leaf being expanded its children, returns false if full.
+  bool expand(Node& r_node, const Board& board) noexcept;
+
+  //! Adds the result to the leaf's path, flipping it at every ply.
+  void backup(const Leaf& leaf) noexcept;
+
+  //! Returns the child of 'node' with the best PUCT score.
+  std::uint32_t select(const Node& node) const noexcept;
+
+  //! Makes node 0 the root of 'board', reusing the old tree if it can.
+  void setRoot(const Board& board) noexcept;
+
+  //! Finds 'key' up to 'plies' plies below 'index', or returns 0.
+  std::uint32_t find(const std::uint32_t index, const Board& board,
+                     const std::uint64_t key,
+                     const unsigned int plies) const noexcept;
+
+  //! Moves the subtree of 'index' to the start of the arena.
+  void compact(const std::uint32_t index) noexcept;
+
+  //! Resets the arena to a lone root.
+  void reset() noexcept;
+
+  //! Snapshot of the search for the reporter.
+  MctsResult getResult() const noexcept;
+
+  //! Milliseconds since the search started.
+  std::uint64_t elapsed() const noexcept;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pool.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../chess/board.h"
+
+SearchPool::SearchPool(const std::size_t mb)
+  : m_tt(mb)
+  , m_cache()
+  , m_searches()
+  , m_helperStop(false)
+{
+  setThreads(1);
+}
+
+void SearchPool::setThreads(const unsigned int threads) {
+  const SearchOptions options =
+      m_searches.empty()? SearchOptions() : getOptions();
+  const unsigned int count = threads? threads : 1;
+  m_searches.resize(count);
+  for (unsigned int i = 0; i < count; ++i) {
+    std::unique_ptr<Search>& search = m_searches[i];
+    if (!search) {
+      search.reset(new Search());
+      search->setHelper(i);
+      search->setTable(&m_tt);
+      search->setCache(m_cache.isOpen()? &m_cache : nullptr);
+      search->setOptions(options);
+    }
+  }
+}
+
+void SearchPool::setOptions(const SearchOptions& options) noexcept {
+  for (std::unique_ptr<Search>& search : m_searches) {
+    search->setOptions(options);
+  }
+}
+
+SearchResult SearchPool::go(const Board& board, const SearchLimits& limits,
+                            const KeyHistory& history) noexcept
+{
+  m_tt.newSearch();
+  m_helperStop.store(false, std::memory_order_relaxed);
+
+  // Helpers only stop on request, their node counts are added at the end.
+  SearchLimits helperLimits = limits;
+  helperLimits.nodes = 0;
+  helperLimits.time = 0;
+  helperLimits.stop = &m_helperStop;
+
+  std::vector<std::uint64_t> helperNodes(m_searches.size(), 0);
+  std::vector<std::thread> helpers;
+  for (unsigned int i = 1; i < m_searches.size(); ++i) {
+    helpers.emplace_back([this, i, &board, &helperLimits, &history,
+                          &helperNodes]() {
+      helperNodes[i] = m_searches[i]->go(board, helperLimits, history).nodes;
+    });
+  }
+
+  SearchResult result = m_searches.front()->go(board, limits, history);
+
+  m_helperStop.store(true, std::memory_order_relaxed);
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+  for (const std::uint64_t nodes : helperNodes) {
+    result.nodes += nodes;
+  }
+  if (m_cache.isOpen()) {
+    m_cache.flush();
+  }
+  return result;
+}
+
+bool SearchPool::openCache(const std::string& path) {
+  m_cache.close();
+  const bool opened = !path.empty() && m_cache.open(path);
+  for (std::unique_ptr<Search>& search : m_searches) {
+    search->setCache(opened? &m_cache : nullptr);
+  }
+  return opened;
+}
+
+SearchStats SearchPool::getStats() const noexcept {
+  SearchStats stats;
+  for (const std::unique_ptr<Search>& search : m_searches) {
+    stats.merge(search->getStats());
+  }
+  return stats;
+}
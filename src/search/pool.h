@@ -0,0 +1,147 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __POOL__
+#define __POOL__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "repetition.h"
+#include "search.h"
+#include "stats.h"
+#include "tt.h"
+
+class Board;
+
+/*!
+ *  @class SearchPool
+ *  @brief Runs several searches of the same root sharing one hash table.
+ *
+ *  Lazy SMP: helper threads search the root alongside the main one with no
+ *  coordination other than the transposition table, which makes the main
+ *  thread reach its depths sooner. Helpers skip depths by their index, so
+ *  that some are always an iteration ahead. The main search runs in the
+ *  calling thread and owns the result; helpers are stopped when it returns.
+ *  With a single thread the search is fully deterministic.
+ *
+ *  An analysis cache file may be opened, in which case every thread
+ *  consults it and the results are appended after each search.
+ */
+class SearchPool {
+private:
+  TranspositionTable m_tt;                        //!< Shared hash table.
+  AnalysisCache m_cache;                          //!< Persistent results.
+  std::vector<std::unique_ptr<Search>> m_searches; //!< Main search first.
+  std::atomic<bool> m_helperStop;                 //!< Stops the helpers.
+
+public:
+  //! Creates a single threaded pool with a table of 'mb' MiB.
+  explicit SearchPool(const std::size_t mb = 16);
+
+public:
+  /*!
+   *  @brief Searches the board with all threads.
+   *
+   *  Limits apply to the main thread. The returned node count covers all
+   *  threads.
+   */
+  SearchResult go(const Board& board, const SearchLimits& limits,
+                  const KeyHistory& history = KeyHistory()) noexcept;
+
+  //! Sets the number of search threads, at least one.
+  void setThreads(const unsigned int threads);
+
+  //! Returns the number of search threads.
+  unsigned int getThreads() const noexcept {
+    return m_searches.size();
+  }
+
+  /*!
+   *  @brief Reallocates the hash table with 'mb' MiB.
+   *
+   *  @return False if a shared table could not be shared again.
+   */
+  bool setHashSize(const std::size_t mb) {
+    return m_tt.resize(mb, getThreads());
+  }
+
+  /*!
+   *  @brief Allows or forbids huge pages for the hash table, reallocating it.
+   *
+   *  @return False if a shared table could not be shared again.
+   */
+  bool setLargePages(const bool enabled) {
+    return m_tt.setLargePages(enabled, getThreads());
+  }
+
+  //! Shares the hash table with other processes, see TranspositionTable.
+  bool attachShared(const std::string& name) {
+    return m_tt.attach(name);
+  }
+
+  //! Goes back to a hash table private to this process.
+  void detachShared() {
+    m_tt.detach(getThreads());
+  }
+
+  //! Opens the analysis cache file at 'path', an empty path closes it.
+  bool openCache(const std::string& path);
+
+  //! Sets the size cap of the analysis cache in MiB.
+  void setCacheSize(const std::size_t mb) noexcept {
+    m_cache.setCap(mb);
+  }
+
+  //! Returns the analysis cache.
+  const AnalysisCache& getCache() const noexcept {
+    return m_cache;
+  }
+
+  //! Returns the hash table.
+  const TranspositionTable& getTable() const noexcept {
+    return m_tt;
+  }
+
+  //! Forgets everything learned so far, as for a new game.
+  void clear() noexcept {
+    m_tt.clear(getThreads());
+  }
+
+  //! Sets the selective techniques of every thread.
+  void setOptions(const SearchOptions& options) noexcept;
+
+  //! Returns the selective techniques in use.
+  const SearchOptions& getOptions() const noexcept {
+    return m_searches.front()->getOptions();
+  }
+
+  //! Returns the counters of the last search merged over all threads.
+  SearchStats getStats() const noexcept;
+
+  //! Sets the iteration callback, invoked by the main thread only.
+  void setReporter(const Search::Reporter& reporter) {
+    m_searches.front()->setReporter(reporter);
+  }
+};
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "proof.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+//! Returns the largest power of two of buckets fitting in 'mb' MiB.
+static std::size_t bucketsFor(const std::size_t mb) noexcept {
+  const std::size_t bytes = std::max<std::size_t>(mb, 1) << 20;
+  std::size_t buckets = 1;
+  while (buckets * 2 * ProofTable::BUCKET * sizeof(ProofEntry) <= bytes) {
+    buckets *= 2;
+  }
+  return buckets;
+}
+
+ProofTable::ProofTable(const std::size_t mb)
+  : m_entries()
+  , m_count(0)
+  , m_mask(0)
+  , m_used(0)
+  , m_collections(0)
+{
+  resize(mb);
+}
+
+void ProofTable::resize(const std::size_t mb) {
+  const std::size_t buckets = bucketsFor(mb);
+  m_entries.reset();
+  m_count = buckets * BUCKET;
+  m_entries.reset(static_cast<ProofEntry*>(
+      std::calloc(m_count, sizeof(ProofEntry))));
+  m_mask = buckets - 1;
+  m_used = 0;
+  m_collections = 0;
+}
+
+void ProofTable::clear() noexcept {
+  // An empty table is still all zeros, and stays untouched.
+  if (m_used) {
+    std::memset(m_entries.get(), 0, m_count * sizeof(ProofEntry));
+  }
+  m_used = 0;
+  m_collections = 0;
+}
+
+const ProofEntry* ProofTable::probe(const std::uint64_t key,
+                                    const unsigned int remaining) const noexcept
+{
+  const ProofEntry* entry = &m_entries[(key & m_mask) * BUCKET];
+  for (unsigned int i = 0; i < BUCKET; ++i) {
+    if (entry[i].key == key && entry[i].remaining == remaining) {
+      return &entry[i];
+    }
+  }
+  return nullptr;
+}
+
+void ProofTable::store(const std::uint64_t key, const unsigned int remaining,
+                       const std::uint32_t proof,
+                       const std::uint32_t disproof, const std::uint32_t work,
+                       const unsigned int mate) noexcept
+{
+  ProofEntry* entry = bucket(key);
+  ProofEntry* slot = nullptr;
+  for (unsigned int i = 0; i < BUCKET; ++i) {
+    if (entry[i].key == key && entry[i].remaining == remaining) {
+      slot = &entry[i];
+      break;
+    }
+  }
+
+  if (!slot) {
+    if (m_used * 100 >= m_count * LOAD) {
+      collect();
+    }
+    for (unsigned int i = 0; i < BUCKET && !slot; ++i) {
+      if (!entry[i].key) {
+        slot = &entry[i];
+        ++m_used;
+      }
+    }
+    if (!slot) {
+      slot = std::min_element(entry, entry + BUCKET,
+                              [](const ProofEntry& a, const ProofEntry& b) {
+                                return a.work < b.work;
+                              });
+    }
+  }
+
+  slot->key = key;
+  slot->proof = proof;
+  slot->disproof = disproof;
+  slot->work = work;
+  slot->mate = mate;
+  slot->remaining = remaining;
+  slot->reserved = 0;
+}
+
+void ProofTable::collect() noexcept {
+  // Entries per power of two of work, then the cut that keeps KEEP percent.
+  std::size_t counts[33] = {};
+  for (std::size_t i = 0; i < m_count; ++i) {
+    const ProofEntry& entry = m_entries[i];
+    if (entry.key) {
+      ++counts[32 - __builtin_clz(entry.work | 1)];
+    }
+  }
+  const std::size_t keep = m_count * KEEP / 100;
+  std::size_t kept = 0;
+  unsigned int cut = 33;
+  while (cut > 0 && kept + counts[cut - 1] <= keep) {
+    kept += counts[--cut];
+  }
+
+  for (std::size_t i = 0; i < m_count; ++i) {
+    ProofEntry& entry = m_entries[i];
+    if (entry.key && unsigned(32 - __builtin_clz(entry.work | 1)) < cut) {
+      entry = ProofEntry{};
+      --m_used;
+    }
+  }
+  ++m_collections;
+}
@@ -0,0 +1,125 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROOF__
+#define __PROOF__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+/*!
+ *  @struct ProofEntry
+ *  @brief Proof and disproof numbers of a position at a remaining depth.
+ */
+struct ProofEntry {
+  std::uint64_t key;       //!< Position key, 0 for an empty entry.
+  std::uint32_t proof;     //!< Proof number, 0 once the mate is proven.
+  std::uint32_t disproof;  //!< Disproof number, 0 once disproven.
+  std::uint32_t work;      //!< Nodes spent below the position.
+  std::uint16_t mate;      //!< Plies to mate once proven.
+  std::uint8_t remaining;  //!< Plies the attacker had left.
+  std::uint8_t reserved;   //!< Always zero.
+};
+
+static_assert(sizeof(ProofEntry) == 24, "ProofEntry must stay 24 bytes");
+
+/*!
+ *  @class ProofTable
+ *  @brief Bounded hash table of the proof-number search.
+ *
+ *  Entries sit in buckets of four, keyed by the position and the plies
+ *  left, as a proof found with more plies says nothing about fewer.
+ *
+ *  Once the table is nearly full it collects garbage: the entries with the
+ *  least work below them are dropped until half of the table is free, so
+ *  the expensive results survive however long the search runs. A bucket
+ *  that is still full then gives up its cheapest entry.
+ *
+ *  The entries come zeroed from calloc, which leaves large blocks to the
+ *  system's zero pages, so an unused table costs nothing at startup.
+ */
+class ProofTable {
+public:
+  static constexpr unsigned int BUCKET = 4;   //!< Entries per bucket.
+  static constexpr unsigned int LOAD = 90;    //!< Collect above this percent.
+  static constexpr unsigned int KEEP = 50;    //!< Percent kept by a collection.
+
+private:
+  //! Releases what calloc allocated.
+  struct Free {
+    void operator()(ProofEntry* entries) const noexcept {
+      std::free(entries);
+    }
+  };
+
+  std::unique_ptr<ProofEntry[], Free> m_entries; //!< Buckets, side by side.
+  std::size_t m_count;                           //!< Number of entries.
+  std::size_t m_mask;                            //!< Bucket count minus one.
+  std::size_t m_used;                            //!< Non-empty entries.
+  std::uint64_t m_collections;                   //!< Collections so far.
+
+public:
+  //! Creates a table of at most 'mb' MiB.
+  explicit ProofTable(const std::size_t mb = 16);
+
+  ProofTable(const ProofTable&) = delete;
+
+public:
+  //! Reallocates the table with at most 'mb' MiB, dropping all entries.
+  void resize(const std::size_t mb);
+
+  //! Drops all entries.
+  void clear() noexcept;
+
+  //! Returns the entry of the position, null if there is none.
+  const ProofEntry* probe(const std::uint64_t key,
+                          const unsigned int remaining) const noexcept;
+
+  //! Stores or updates the entry of the position.
+  void store(const std::uint64_t key, const unsigned int remaining,
+             const std::uint32_t proof, const std::uint32_t disproof,
+             const std::uint32_t work, const unsigned int mate) noexcept;
+
+  //! Returns the number of non-empty entries.
+  std::size_t getUsed() const noexcept {
+    return m_used;
+  }
+
+  //! Returns the memory held by the entries, in bytes.
+  std::size_t getSize() const noexcept {
+    return m_count * sizeof(ProofEntry);
+  }
+
+  //! Returns the number of garbage collections since the last clear.
+  std::uint64_t getCollections() const noexcept {
+    return m_collections;
+  }
+
+private:
+  //! Returns the first entry of the key's bucket.
+  ProofEntry* bucket(const std::uint64_t key) noexcept {
+    return &m_entries[(key & m_mask) * BUCKET];
+  }
+
+  //! Drops the cheapest entries until at most KEEP percent are left.
+  void collect() noexcept;
+};
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repetition.h"
+
+#include <cstdint>
+
+#include "../chess/board.h"
+#include "../chess/chess.h"
+#include "../chess/zobrist.h"
+
+//! Returns true if the piece reaches 'to' from 'from' on an empty board.
+static constexpr bool reaches(const char piece, const unsigned int from,
+                              const unsigned int to)
+{
+  const int rows = from / 8 > to / 8? from / 8 - to / 8 : to / 8 - from / 8;
+  const int cols = from % 8 > to % 8? from % 8 - to % 8 : to % 8 - from % 8;
+  switch (piece & 0b11011111) {
+    case 'N':
+      return (rows == 1 && cols == 2) || (rows == 2 && cols == 1);
+    case 'B':
+      return rows == cols;
+    case 'R':
+      return rows == 0 || cols == 0;
+    case 'Q':
+      return rows == cols || rows == 0 || cols == 0;
+    case 'K':
+      return rows <= 1 && cols <= 1;
+    default:
+      return false;
+  }
+}
+
+/*!
+ *  @struct CuckooTable
+ *  @brief Keys of all reversible piece moves, built at compile time.
+ *
+ *  A move key is the XOR of the piece on both squares and the side key,
+ *  i.e. exactly what the move changes in a position's key. Every key sits
+ *  in one of its two hash slots.
+ */
+struct CuckooTable {
+  static constexpr unsigned int SIZE = 8192;
+
+  std::uint64_t keys[SIZE];  //!< Move keys, 0 if the slot is free.
+  std::uint16_t moves[SIZE]; //!< Both squares (0..63) in 6 bits each.
+  unsigned int count;        //!< Stored moves.
+
+  static constexpr unsigned int first(const std::uint64_t key) {
+    return key & (SIZE - 1);
+  }
+
+  static constexpr unsigned int second(const std::uint64_t key) {
+    return (key >> 16) & (SIZE - 1);
+  }
+
+  constexpr CuckooTable()
+    : keys()
+    , moves()
+    , count(0)
+  {
+    for (const char piece : {'N', 'B', 'R', 'Q', 'K', 'n', 'b', 'r', 'q', 'k'}) {
+      for (unsigned int from = 0; from < 64; ++from) {
+        for (unsigned int to = from + 1; to < 64; ++to) {
+          if (!reaches(piece, from, to)) {
+            continue;
+          }
+
+          std::uint64_t key = ZOBRIST.piece(piece, from) ^
+                              ZOBRIST.piece(piece, to) ^ ZOBRIST.side;
+          std::uint16_t move = from | to << 6;
+          unsigned int slot = first(key);
+          while (true) {
+            const std::uint64_t evictedKey = keys[slot];
+            const std::uint16_t evictedMove = moves[slot];
+            keys[slot] = key;
+            moves[slot] = move;
+            if (!evictedMove) {
+              break;
+            }
+            key = evictedKey;
+            move = evictedMove;
+            slot = slot == first(key)? second(key) : first(key);
+          }
+          ++count;
+        }
+      }
+    }
+  }
+};
+
+static constexpr CuckooTable CUCKOO;
+static_assert(CUCKOO.count == 3668, "Unexpected number of reversible moves");
+
+//! Returns true if no piece stands strictly between the mailbox squares.
+static bool isPathClear(const Board& board, const int from, const int to) {
+  const int diff = to > from? to - from : from - to;
+  int step;
+  if (diff < 8) {
+    step = 1;
+  } else if (diff % Board::WIDTH == 0) {
+    step = Board::WIDTH;
+  } else if (diff % (Board::WIDTH - 1) == 0) {
+    step = Board::WIDTH - 1;
+  } else if (diff % (Board::WIDTH + 1) == 0) {
+    step = Board::WIDTH + 1;
+  } else {
+    return true; // Knight jump.
+  }
+  if (to < from) {
+    step = -step;
+  }
+
+  for (int sqr = from + step; sqr != to; sqr += step) {
+    if (!board.isEmpty(sqr)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+unsigned int KeyHistory::window(const Board& board) const noexcept {
+  const unsigned int available = m_count < CAPACITY? m_count : CAPACITY;
+  return board.getHalfMoves() < available? board.getHalfMoves() : available;
+}
+
+unsigned int KeyHistory::repetitions(const Board& board) const noexcept {
+  const unsigned int end = window(board);
+  unsigned int count = 0;
+  for (unsigned int distance = 4; distance <= end; distance += 2) {
+    count += at(distance) == board.getKey();
+  }
+  return count;
+}
+
+bool KeyHistory::isRepetition(const Board& board) const noexcept {
+  const unsigned int end = window(board);
+  for (unsigned int distance = 4; distance <= end; distance += 2) {
+    if (at(distance) == board.getKey()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool KeyHistory::hasUpcomingRepetition(const Board& board,
+                                       const unsigned int ply) const noexcept
+{
+  const unsigned int end = window(board);
+  for (unsigned int distance = 3; distance <= end && distance < ply;
+       distance += 2)
+  {
+    const std::uint64_t moveKey = board.getKey() ^ at(distance);
+    unsigned int slot = CuckooTable::first(moveKey);
+    if (CUCKOO.keys[slot] != moveKey) {
+      slot = CuckooTable::second(moveKey);
+      if (CUCKOO.keys[slot] != moveKey) {
+        continue;
+      }
+    }
+
+    const int from = toMailbox(CUCKOO.moves[slot] & 63);
+    const int to = toMailbox(CUCKOO.moves[slot] >> 6);
+    const BoardSquare piece = board.isEmpty(from)? to : from;
+    if (board.isWhite(piece) == board.isWhitesMove() &&
+        isPathClear(board, from, to))
+    {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,97 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REPETITION__
+#define __REPETITION__
+
+#include <cstdint>
+
+class Board;
+
+/*!
+ *  @class KeyHistory
+ *  @brief Zobrist keys of the positions leading to the current one.
+ *
+ *  A fixed ring buffer: a repetition can only happen since the last
+ *  capture or pawn move, and the 7-bit halfmove clock caps that window
+ *  below the capacity, so older keys may be overwritten. Nothing is
+ *  allocated and every check is O(window).
+ */
+class KeyHistory {
+public:
+  static constexpr unsigned int CAPACITY = 256; //!< Keys kept.
+
+private:
+  std::uint64_t m_keys[CAPACITY]; //!< Ring buffer of keys.
+  unsigned int m_count;           //!< Keys pushed so far.
+
+public:
+  //! Creates an empty history.
+  KeyHistory()
+    : m_count(0)
+  {}
+
+public:
+  //! Appends the key of a position that is being left.
+  void push(const std::uint64_t key) noexcept {
+    m_keys[m_count++ % CAPACITY] = key;
+  }
+
+  //! Drops the last key.
+  void pop() noexcept {
+    --m_count;
+  }
+
+  //! Drops all keys.
+  void clear() noexcept {
+    m_count = 0;
+  }
+
+  /*!
+   *  @brief Counts earlier occurrences of the board's position.
+   *
+   *  Only positions with the same side to move inside the reversible
+   *  window are compared.
+   */
+  unsigned int repetitions(const Board& board) const noexcept;
+
+  //! Returns true if the board's position occurred before.
+  bool isRepetition(const Board& board) const noexcept;
+
+  /*!
+   *  @brief Detects that the side to move can repeat a position.
+   *
+   *  Looks up the difference between the current key and each earlier key
+   *  in a cuckoo table of all reversible piece moves; a hit whose path is
+   *  free means one move brings back an earlier position. Only cycles
+   *  inside the search tree count, i.e. those fewer than 'ply' plies back.
+   */
+  bool hasUpcomingRepetition(const Board& board,
+                             const unsigned int ply) const noexcept;
+
+private:
+  //! Returns the key 'distance' plies back, 1 being the parent.
+  std::uint64_t at(const unsigned int distance) const noexcept {
+    return m_keys[(m_count - distance) % CAPACITY];
+  }
+
+  //! Returns the number of plies that can be looked back.
+  unsigned int window(const Board& board) const noexcept;
+};
+
+#endif
@@ -0,0 +1,821 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/movelist.h"
+#include "../chess/packed.h"
+#include "../eval/eval.h"
+#include "../eval/material.h"
+#include "cache.h"
+#include "tt.h"
+
+//! Deepest node where reverse futility pruning applies.
+static constexpr int RFP_DEPTH = 6;
+
+//! Reverse futility margin per ply of depth.
+static constexpr int RFP_MARGIN = 120;
+
+//! Deepest node where futility pruning applies.
+static constexpr int FUTILITY_DEPTH = 3;
+
+//! Futility margins by remaining depth.
+static constexpr int FUTILITY_MARGIN[FUTILITY_DEPTH + 1] = {0, 150, 300, 500};
+
+//! Deepest node where late move pruning applies.
+static constexpr int LMP_DEPTH = 4;
+
+//! Half width of the MultiPV aspiration windows.
+static constexpr int ASPIRATION_WINDOW = 40;
+
+//! Null-move cutoffs at or above this depth are verified.
+static constexpr int NULL_VERIFY_DEPTH = 8;
+
+/*!
+ *  Lazy SMP depth skipping, by helper index minus one modulo the table
+ *  size: a helper leaves out the depths where (depth + phase) / size is
+ *  odd, so the threads spread over several depths instead of searching
+ *  the same tree in lockstep. The first helper searches the even depths,
+ *  one ahead of the main search, the second the odd ones.
+ */
+static constexpr unsigned int SKIP_SIZE[] = {
+  1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4
+};
+static constexpr unsigned int SKIP_PHASE[] = {
+  0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7
+};
+static_assert(sizeof(SKIP_SIZE) == sizeof(SKIP_PHASE));
+
+/*!
+ *  @struct ReductionTable
+ *  @brief Late move reductions by depth and move number, built at startup.
+ */
+struct ReductionTable {
+  int values[64][64];
+
+  ReductionTable() {
+    for (int depth = 0; depth < 64; ++depth) {
+      for (int count = 0; count < 64; ++count) {
+        values[depth][count] = (depth && count)?
+            int(0.75 + std::log(depth) * std::log(count) / 2.25) : 0;
+      }
+    }
+  }
+
+  //! Returns the reduction, depth and move number clamped to the table.
+  int get(const int depth, const unsigned int count) const noexcept {
+    return values[depth < 63? depth : 63][count < 63? count : 63];
+  }
+};
+
+static const ReductionTable REDUCTIONS;
+
+//! Ordering key: promotions and captures first, most valuable victim first.
+static int orderKey(const Board& board, const Move& move) noexcept {
+  int key = 0;
+  if (move.isPromotion()) {
+    key += Eval::pieceValue(move.promotion);
+  }
+  if (board.isEnemyPiece(move.to)) {
+    key += 10 * Eval::pieceValue(board.getVal(move.to)) -
+           Eval::pieceValue(board.getVal(move.from)) / 10;
+  }
+  return key;
+}
+
+/*!
+ *  @brief Sorts moves by ordering key, with 'first' put in front if present.
+ *
+ *  Killers, if given, come right after captures and promotions. Insertion
+ *  sort into the frame's key buffer: lists are short, equal keys keep
+ *  their generation order and nothing is allocated.
+ */
+static void orderMoves(const Board& board, MoveList& r_moves, int* r_keys,
+                       const Move& first, const Move* killers) noexcept
+{
+  for (unsigned int i = 0; i < r_moves.size(); ++i) {
+    const Move move = r_moves[i];
+    int key = orderKey(board, move);
+    if (killers && !key) {
+      key = move == killers[0]? 2 : move == killers[1]? 1 : 0;
+    }
+    unsigned int j = i;
+    for (; j > 0 && r_keys[j - 1] < key; --j) {
+      r_moves[j] = r_moves[j - 1];
+      r_keys[j] = r_keys[j - 1];
+    }
+    r_moves[j] = move;
+    r_keys[j] = key;
+  }
+  for (unsigned int i = 0; i < r_moves.size(); ++i) {
+    if (r_moves[i] == first) {
+      std::rotate(r_moves.begin(), r_moves.begin() + i,
+                  r_moves.begin() + i + 1);
+      break;
+    }
+  }
+}
+
+//! Returns true if the move captures nothing and promotes nothing.
+static bool isQuiet(const Board& board, const Move& move) noexcept {
+  return board.isEmpty(move.to) && !move.isPromotion() &&
+         !(board.isPawn(move.from) && board.isEnPass(move.to));
+}
+
+//! Returns the material of the side to move, pawns and king excluded.
+static int nonPawnMaterial(const Board& board) noexcept {
+  return MaterialTable::getLocal().probe(board).nonPawn[board.isWhitesMove()];
+}
+
+Search::Search()
+  : m_limits()
+  , m_options()
+  , m_reporter()
+  , m_start()
+  , m_nodes(0)
+  , m_stopped(false)
+  , m_rootBest()
+  , m_history()
+  , m_tt(nullptr)
+  , m_cache(nullptr)
+  , m_stats()
+  , m_stack()
+  , m_selDepth(0)
+  , m_lines()
+  , m_lineCount(0)
+  , m_helper(0)
+{}
+
+SearchResult Search::go(const Board& board, const SearchLimits& limits,
+                        const KeyHistory& history) noexcept
+{
+  m_history = history;
+  m_limits = limits;
+  m_start = Clock::now();
+  m_nodes = 0;
+  m_stopped = false;
+  m_rootBest = Move();
+  m_stats = SearchStats();
+  m_selDepth = 0;
+  m_stack.clear();
+
+  // Everything below works in the preallocated frames.
+  SearchFrame& root = m_stack[0];
+  root.board = board;
+  root.moves.clear();
+  root.board.getLegalMoves(root.moves);
+
+  SearchResult result;
+  if (root.moves.empty()) {
+    result.score = board.isInCheck()? -MATE : 0;
+    return result;
+  }
+  result.bestMove = root.moves[0];
+  result.pv[0] = result.bestMove;
+  result.pvLength = 1;
+
+  // An exact result of an earlier session is the answer if it is deep
+  // enough. Short of that it seeds a search bounded by time or nodes,
+  // which then goes on from the next depth.
+  const bool toDepth = m_limits.depth < SearchLimits().depth &&
+                       !m_limits.time && !m_limits.nodes;
+  unsigned int first = 1;
+  TranspositionTable::Data cached;
+  if (!m_helper && m_cache && m_options.multiPv <= 1 &&
+      m_cache->probeRoot(board.getKey(), toDepth? int(m_limits.depth) :
+                                                  AnalysisCache::MIN_DEPTH,
+                         cached))
+  {
+    const Move move = PackedGame::unpackMove(cached.move,
+                                             board.isWhitesMove());
+    for (const Move& legal : root.moves) {
+      if (legal == move) {
+        result.bestMove = result.pv[0] = move;
+        result.score = TranspositionTable::fromTable(cached.score, 0);
+        result.depth = cached.depth;
+        result.time = elapsed();
+        if (m_reporter) {
+          m_reporter(result);
+        }
+        if (unsigned(cached.depth) >= m_limits.depth) {
+          return result;
+        }
+        if (m_tt) {
+          m_tt->store(board.getKey(), cached.move, cached.score,
+                      cached.depth, TranspositionTable::Bound::Exact);
+        }
+        first = cached.depth + 1;
+        break;
+      }
+    }
+  }
+
+  const unsigned int lines = std::min(
+      std::clamp(m_options.multiPv, 1u, MAX_MULTI_PV), root.moves.size());
+  m_lineCount = 0;
+  SearchResult other;
+
+  constexpr unsigned int SKIPS = sizeof(SKIP_SIZE) / sizeof(SKIP_SIZE[0]);
+  const unsigned int skip = (m_helper + SKIPS - 1) % SKIPS;
+  for (unsigned int depth = first; depth <= m_limits.depth; ++depth) {
+    if (m_helper && depth > 1 &&
+        (depth + SKIP_PHASE[skip]) / SKIP_SIZE[skip] % 2)
+    {
+      continue;
+    }
+    [[maybe_unused]] const std::uint64_t nodes = m_nodes;
+    [[maybe_unused]] const std::uint64_t allocations =
+        SearchStats::threadAllocations();
+    const int score = lines > 1? searchRoot(root.board, depth, lines)
+                               : negamax(root.board, depth, -INF, INF, 0, true);
+    NELLY_STAT(m_stats.allocations +=
+               SearchStats::threadAllocations() - allocations);
+    if (m_stopped) {
+      break;
+    }
+    if (depth <= SearchStats::MAX_DEPTH) {
+      NELLY_STAT(m_stats.iterationNodes[depth] = m_nodes - nodes);
+    }
+
+    for (unsigned int line = 0; line < lines; ++line) {
+      const Move* const pv = lines > 1? m_lines[line].pv : root.pv;
+      SearchResult& current = line? other : result;
+      current.bestMove = lines > 1? pv[0] : m_rootBest;
+      current.pvLength = lines > 1? m_lines[line].pvLength : root.pvLength;
+      std::copy(pv, pv + current.pvLength, current.pv);
+      current.multiPv = line + 1;
+      current.score = lines > 1? m_lines[line].score : score;
+      current.depth = depth;
+      current.selDepth = m_selDepth;
+      current.nodes = m_nodes;
+      current.time = elapsed();
+      if (m_reporter) {
+        m_reporter(current);
+      }
+    }
+    if (lines == 1 && isMateScore(score) &&
+        MATE - std::abs(score) <= int(depth))
+    {
+      break; // Mate found within the full-width horizon.
+    }
+  }
+
+  result.nodes = m_nodes;
+  result.time = elapsed();
+  NELLY_STAT(m_stats.stackBytes = (m_selDepth + 2) * sizeof(SearchFrame));
+  return result;
+}
+
+std::uint64_t Search::elapsed() const noexcept {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - m_start).count();
+}
+
+void Search::generate(const Board& board, MoveList& r_moves) noexcept {
+  NELLY_STAT(++m_stats.generatorCalls);
+  const bool sampled = SearchStats::isSampled(m_stats.generatorCalls);
+  const std::uint64_t start = sampled? SearchStats::cycles() : 0;
+  r_moves.clear();
+  board.getValidMoves(r_moves);
+  if (sampled) {
+    m_stats.generatorCycles += SearchStats::cycles() - start;
+    ++m_stats.generatorSamples;
+  }
+  NELLY_STAT(m_stats.movesGenerated += r_moves.size());
+}
+
+int Search::evaluate(const Board& board) noexcept {
+  NELLY_STAT(++m_stats.evalCalls);
+  const bool sampled = SearchStats::isSampled(m_stats.evalCalls);
+  const std::uint64_t start = sampled? SearchStats::cycles() : 0;
+  const int score = Eval::evaluate(board);
+  if (sampled) {
+    m_stats.evalCycles += SearchStats::cycles() - start;
+    ++m_stats.evalSamples;
+  }
+  return score;
+}
+
+bool Search::visitNode() noexcept {
+  ++m_nodes;
+  if (m_limits.nodes && m_nodes >= m_limits.nodes) {
+    m_stopped = true;
+  }
+  // Clock and external requests are polled every 1024 nodes.
+  if (!(m_nodes & 1023)) {
+    if ((m_limits.stop && m_limits.stop->load(std::memory_order_relaxed)) ||
+        (m_limits.time && elapsed() >= m_limits.time))
+    {
+      m_stopped = true;
+    }
+  }
+  return m_stopped;
+}
+
+int Search::negamax(const Board& board, int depth, int alpha, int beta,
+                    const unsigned int ply, const bool allowNull) noexcept
+{
+  SearchFrame& frame = m_stack[ply];
+  frame.pvLength = 0;
+  m_selDepth = std::max(m_selDepth, ply);
+  const std::uint64_t nodes = m_nodes;
+
+  const bool isPv = beta - alpha > 1;
+  if (ply > 0) {
+    if (board.isFiftyMoveDraw() || m_history.isRepetition(board)) {
+      return 0;
+    }
+    // A drawing cycle is available, so a draw is the least we get.
+    if (alpha < 0 && m_history.hasUpcomingRepetition(board, ply)) {
+      alpha = 0;
+      if (alpha >= beta) {
+        return alpha;
+      }
+    }
+  }
+
+  const bool inCheck = board.isInCheck();
+  if (inCheck) {
+    ++depth;
+  }
+  if (depth <= 0 || ply >= MAX_PLY) {
+    return quiesce(board, alpha, beta, ply);
+  }
+  if (visitNode()) {
+    return 0;
+  }
+  NELLY_STAT(++(isPv? m_stats.pvNodes : m_stats.nonPvNodes));
+
+  const int alphaOrig = alpha;
+  Move ttMove;
+  TranspositionTable::Data entry;
+  NELLY_STAT(m_stats.hashProbes += m_tt != nullptr);
+  bool found = m_tt && m_tt->probe(board.getKey(), entry);
+  // Near the root, results of earlier sessions stand in for the hash.
+  if (!found && m_cache && ply <= AnalysisCache::MAX_PLY) {
+    found = m_cache->probe(board.getKey(), entry);
+  }
+  if (found) {
+    NELLY_STAT(++m_stats.hashHits);
+    if (entry.move) {
+      ttMove = PackedGame::unpackMove(entry.move, board.isWhitesMove());
+    }
+    const int score = TranspositionTable::fromTable(entry.score, ply);
+    if (!isPv && ply > 0 && entry.depth >= depth &&
+        (entry.bound == TranspositionTable::Bound::Exact ||
+         (entry.bound == TranspositionTable::Bound::Lower && score >= beta) ||
+         (entry.bound == TranspositionTable::Bound::Upper && score <= alpha)))
+    {
+      NELLY_STAT(++m_stats.hashCutoffs);
+      return score;
+    }
+  }
+
+  // Pruning needs a static eval and scores far from mate.
+  const bool canPrune = !isPv && !inCheck && !isMateScore(beta);
+  const int staticEval = canPrune? evaluate(board) : 0;
+  frame.staticEval = staticEval;
+
+  if (m_options.reverseFutility && canPrune && depth <= RFP_DEPTH &&
+      staticEval - RFP_MARGIN * depth >= beta)
+  {
+    return staticEval;
+  }
+
+  if (m_options.nullMove && canPrune && allowNull && depth >= 3 &&
+      staticEval >= beta)
+  {
+    const int material = nonPawnMaterial(board);
+    if (material) {
+      const int reduction = 3 + depth / 6;
+      m_history.push(board.getKey());
+      m_stack[ply + 1].board = board.makeNullMove();
+      const int score = -negamax(m_stack[ply + 1].board,
+                                 depth - 1 - reduction, -beta, -beta + 1,
+                                 ply + 1, false);
+      m_history.pop();
+      if (m_stopped) {
+        return 0;
+      }
+
+      if (score >= beta) {
+        // With a lone minor or rook zugzwang is likely, so verify the
+        // cutoff with a reduced search that can't pass.
+        if (material > Eval::ROOK && depth < NULL_VERIFY_DEPTH) {
+          return isMateScore(score)? beta : score;
+        }
+        const int verified =
+            negamax(board, depth - 1 - reduction, beta - 1, beta, ply, false);
+        if (m_stopped) {
+          return 0;
+        }
+        if (verified >= beta) {
+          return verified;
+        }
+      }
+    }
+  }
+
+  MoveList& moves = frame.moves;
+  generate(board, moves);
+  orderMoves(board, moves, frame.keys,
+             ply == 0 && m_rootBest.from != m_rootBest.to? m_rootBest : ttMove,
+             frame.killers);
+
+  const bool isFutile = m_options.futility && canPrune &&
+                        depth <= FUTILITY_DEPTH &&
+                        staticEval + FUTILITY_MARGIN[depth] <= alpha;
+  const unsigned int lmpCount = 3 + depth * depth;
+
+  int best = -INF;
+  Move bestMove;
+  unsigned int legalCount = 0;
+  m_history.push(board.getKey());
+  for (const Move& move : moves) {
+    const bool quiet = isQuiet(board, move);
+    NELLY_STAT(++m_stats.makeMoveCalls);
+    const Board& next = m_stack[ply + 1].board = board.makeMove(move);
+    // Warm the child's bucket up while its legality and reductions are
+    // worked out; children going straight to quiescence never probe.
+    if (m_tt && depth > 1) {
+      m_tt->prefetch(next.getKey());
+    }
+    if (!next.isLegal()) {
+      continue;
+    }
+    ++legalCount;
+
+    const bool givesCheck = next.isInCheck();
+    if (legalCount > 1 && quiet && !givesCheck) {
+      if (isFutile) {
+        continue;
+      }
+      if (m_options.lateMovePruning && canPrune && depth <= LMP_DEPTH &&
+          legalCount > lmpCount)
+      {
+        continue;
+      }
+    }
+
+    int score;
+    if (legalCount == 1) {
+      score = -negamax(next, depth - 1, -beta, -alpha, ply + 1, true);
+    } else {
+      int reduction = 0;
+      if (m_options.lateMoveReductions && depth >= 3 && quiet && !inCheck &&
+          !givesCheck)
+      {
+        reduction = REDUCTIONS.get(depth, legalCount) - isPv;
+        reduction = std::max(0, std::min(reduction, depth - 2));
+      }
+
+      score = -negamax(next, depth - 1 - reduction, -alpha - 1, -alpha,
+                       ply + 1, true);
+      if (score > alpha && reduction) {
+        score = -negamax(next, depth - 1, -alpha - 1, -alpha, ply + 1, true);
+      }
+      if (score > alpha && score < beta) {
+        score = -negamax(next, depth - 1, -beta, -alpha, ply + 1, true);
+      }
+    }
+    if (m_stopped) {
+      m_history.pop();
+      return 0;
+    }
+
+    if (score > best) {
+      best = score;
+      bestMove = move;
+      if (ply == 0) {
+        m_rootBest = move;
+      }
+    }
+    if (score > alpha) {
+      alpha = score;
+      if (isPv) {
+        const SearchFrame& child = m_stack[ply + 1];
+        frame.pv[0] = move;
+        std::copy(child.pv, child.pv + child.pvLength, frame.pv + 1);
+        frame.pvLength = child.pvLength + 1;
+      }
+      if (alpha >= beta) {
+        NELLY_STAT(++m_stats.betaCutoffs);
+        NELLY_STAT(m_stats.firstMoveCutoffs += legalCount == 1);
+        if (quiet && !(move == frame.killers[0])) {
+          frame.killers[1] = frame.killers[0];
+          frame.killers[0] = move;
+        }
+        break;
+      }
+    }
+  }
+  m_history.pop();
+
+  if (!legalCount) {
+    return inCheck? -MATE + int(ply) : 0;
+  }
+
+  const TranspositionTable::Bound bound =
+      best >= beta? TranspositionTable::Bound::Lower :
+      best > alphaOrig? TranspositionTable::Bound::Exact :
+                        TranspositionTable::Bound::Upper;
+  const std::uint16_t packed =
+      best > alphaOrig? PackedGame::packMove(bestMove) : 0;
+  if (m_tt) {
+    m_tt->store(board.getKey(), packed,
+                TranspositionTable::toTable(best, ply), depth, bound);
+  }
+  // Helpers search the same tree with other depths and windows, only the
+  // main thread's results are kept.
+  if (m_cache && !m_helper && ply <= AnalysisCache::MAX_PLY &&
+      depth >= AnalysisCache::MIN_DEPTH && !m_stopped)
+  {
+    m_cache->add(board.getKey(), packed,
+                 TranspositionTable::toTable(best, ply), depth, bound,
+                 m_nodes - nodes);
+  }
+  return best;
+}
+
+int Search::searchRoot(const Board& board, int depth,
+                       const unsigned int lines) noexcept
+{
+  SearchFrame& frame = m_stack[0];
+  frame.pvLength = 0;
+  const bool inCheck = board.isInCheck();
+  if (inCheck) {
+    ++depth;
+  }
+  if (visitNode()) {
+    return 0;
+  }
+
+  // Last iteration's lines first, in rank order, then the rest.
+  int previous[MAX_MULTI_PV];
+  const unsigned int previousCount = m_lineCount;
+  for (unsigned int line = 0; line < previousCount; ++line) {
+    previous[line] = m_lines[line].score;
+  }
+  MoveList& moves = frame.moves;
+  generate(board, moves);
+  orderMoves(board, moves, frame.keys, Move(), nullptr);
+  for (unsigned int line = m_lineCount; line-- > 0;) {
+    Move* const it = std::find(moves.begin(), moves.end(), m_lines[line].pv[0]);
+    if (it != moves.end()) {
+      std::rotate(moves.begin(), it, it + 1);
+    }
+  }
+
+  // Exact score, in an aspiration window around the last iteration's score
+  // of the move ranked 'index' if there is one.
+  auto searchExact = [&](const Board& next, const unsigned int index,
+                         const int bound) {
+    if (index < previousCount && !isMateScore(previous[index])) {
+      const int alpha = std::max(bound, previous[index] - ASPIRATION_WINDOW);
+      const int beta = previous[index] + ASPIRATION_WINDOW;
+      if (alpha < beta) {
+        const int score = -negamax(next, depth - 1, -beta, -alpha, 1, true);
+        if (score > alpha && score < beta) {
+          return score;
+        }
+      }
+    }
+    return m_stopped? 0 : -negamax(next, depth - 1, -INF, -bound, 1, true);
+  };
+
+  // Null window at 'bound', reduced for late quiet moves; exact only if the
+  // move fails high.
+  auto searchAbove = [&](const Board& next, const bool quiet,
+                         const unsigned int index, const int bound) {
+    int reduction = 0;
+    if (m_options.lateMoveReductions && depth >= 3 && quiet && !inCheck &&
+        !next.isInCheck() && index >= lines)
+    {
+      reduction = REDUCTIONS.get(depth, index - lines + 1) - 1;
+      reduction = std::max(0, std::min(reduction, depth - 2));
+    }
+
+    int score = -negamax(next, depth - 1 - reduction, -bound - 1, -bound, 1,
+                         true);
+    if (score > bound && reduction && !m_stopped) {
+      score = -negamax(next, depth - 1, -bound - 1, -bound, 1, true);
+    }
+    if (score > bound && !m_stopped) {
+      score = searchExact(next, index, bound);
+    }
+    return score;
+  };
+
+  // Inserts in rank order, the worst line dropping out when full.
+  auto keep = [&](const Move& move, const int score) {
+    unsigned int rank = m_lineCount == lines? lines - 1 : m_lineCount++;
+    for (; rank > 0 && m_lines[rank - 1].score < score; --rank) {
+      m_lines[rank] = m_lines[rank - 1];
+    }
+    const SearchFrame& child = m_stack[1];
+    Line& line = m_lines[rank];
+    line.score = score;
+    line.pv[0] = move;
+    std::copy(child.pv, child.pv + child.pvLength, line.pv + 1);
+    line.pvLength = child.pvLength + 1;
+  };
+
+  // Only the best move is searched exactly outright. The others are first
+  // tested against the worst line of the last iteration, less a window,
+  // and the ones failing low are only searched again if fewer lines than
+  // asked for end up above that threshold.
+  const int threshold =
+      previousCount >= lines && !isMateScore(previous[lines - 1])?
+      previous[lines - 1] - ASPIRATION_WINDOW : -INF;
+  Move deferred[MoveList::CAPACITY];
+  unsigned int deferredCount = 0;
+  unsigned int legalCount = 0;
+  m_lineCount = 0;
+  m_history.push(board.getKey());
+  for (const Move& move : moves) {
+    const bool quiet = isQuiet(board, move);
+    NELLY_STAT(++m_stats.makeMoveCalls);
+    const Board& next = m_stack[1].board = board.makeMove(move);
+    if (m_tt && depth > 1) {
+      m_tt->prefetch(next.getKey());
+    }
+    if (!next.isLegal()) {
+      continue;
+    }
+    ++legalCount;
+
+    const bool full = m_lineCount == lines;
+    int score;
+    int bound = -INF;
+    if (!full && (legalCount == 1 || threshold == -INF)) {
+      score = searchExact(next, legalCount - 1, -INF);
+    } else {
+      bound = full? m_lines[lines - 1].score : threshold;
+      score = searchAbove(next, quiet, legalCount - 1, bound);
+    }
+    if (m_stopped) {
+      m_history.pop();
+      return 0;
+    }
+    if (score <= bound) {
+      if (!full) {
+        deferred[deferredCount++] = move;
+      }
+      continue;
+    }
+    keep(move, score);
+  }
+
+  if (m_lineCount < lines || m_lines[lines - 1].score < threshold) {
+    for (unsigned int i = 0; i < deferredCount; ++i) {
+      const Move& move = deferred[i];
+      NELLY_STAT(++m_stats.makeMoveCalls);
+      const Board& next = m_stack[1].board = board.makeMove(move);
+      const bool full = m_lineCount == lines;
+      const int bound = full? m_lines[lines - 1].score : -INF;
+      const int score = full?
+          searchAbove(next, isQuiet(board, move), lines + i, bound) :
+          searchExact(next, MAX_MULTI_PV, -INF);
+      if (m_stopped) {
+        m_history.pop();
+        return 0;
+      }
+      if (score > bound) {
+        keep(move, score);
+      }
+    }
+  }
+  m_history.pop();
+
+  m_rootBest = m_lines[0].pv[0];
+  return m_lines[0].score;
+}
+
+int Search::quiesce(const Board& board, int alpha, const int beta,
+                    const unsigned int ply) noexcept
+{
+  SearchFrame& frame = m_stack[ply];
+  frame.pvLength = 0;
+  m_selDepth = std::max(m_selDepth, ply);
+
+  if (visitNode()) {
+    return 0;
+  }
+  NELLY_STAT(++m_stats.quiescenceNodes);
+
+  const int standPat = evaluate(board);
+  if (standPat >= beta || ply >= MAX_PLY) {
+    return standPat;
+  }
+  if (standPat > alpha) {
+    alpha = standPat;
+  }
+
+  MoveList& moves = frame.moves;
+  generate(board, moves);
+  unsigned int captures = 0;
+  for (const Move& move : moves) {
+    if (board.isEnemyPiece(move.to) || move.isPromotion()) {
+      moves[captures++] = move;
+    }
+  }
+  moves.resize(captures);
+  orderMoves(board, moves, frame.keys, Move(), nullptr);
+
+  for (const Move& move : moves) {
+    NELLY_STAT(++m_stats.makeMoveCalls);
+    const Board& next = m_stack[ply + 1].board = board.makeMove(move);
+    if (!next.isLegal()) {
+      continue;
+    }
+
+    const int score = -quiesce(next, -beta, -alpha, ply + 1);
+    if (m_stopped) {
+      return 0;
+    }
+    if (score > alpha) {
+      alpha = score;
+      if (alpha >= beta) {
+        break;
+      }
+    }
+  }
+
+  return alpha;
+}
+
+void Search::selectivityBenchmark(const unsigned int depth) noexcept {
+  static const char* const POSITIONS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "8/8/4k3/8/2p5/8/B2K4/8 w - - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  };
+
+  struct Config {
+    const char* name;
+    SearchOptions options;
+  };
+  SearchOptions none;
+  none.nullMove = none.lateMoveReductions = none.futility = false;
+  none.reverseFutility = none.lateMovePruning = false;
+  Config configs[] = {{"none", none}, {"null move", none}, {"lmr", none},
+                      {"futility", none}, {"reverse futility", none},
+                      {"late move pruning", none}, {"all", SearchOptions()}};
+  configs[1].options.nullMove = true;
+  configs[2].options.lateMoveReductions = true;
+  configs[3].options.futility = true;
+  configs[4].options.reverseFutility = true;
+  configs[5].options.lateMovePruning = true;
+
+  Board boards[sizeof(POSITIONS) / sizeof(POSITIONS[0])];
+  for (unsigned int i = 0; i < sizeof(POSITIONS) / sizeof(POSITIONS[0]); ++i) {
+    boards[i].loadFen(POSITIONS[i]);
+  }
+
+  SearchLimits limits;
+  limits.depth = depth;
+  Logger::info("Selectivity benchmark at depth " + std::to_string(depth));
+  for (const Config& config : configs) {
+    Search search;
+    search.setOptions(config.options);
+    std::uint64_t nodes = 0;
+    std::uint64_t time = 0;
+    for (const Board& board : boards) {
+      const SearchResult& result = search.go(board, limits);
+      nodes += result.nodes;
+      time += result.time;
+    }
+    Logger::info(std::string(config.name) + ": " + std::to_string(nodes) +
+                 " nodes, " + std::to_string(time) + " ms");
+  }
+}
@@ -0,0 +1,240 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SEARCH__
+#define __SEARCH__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "../chess/move.h"
+#include "repetition.h"
+#include "stack.h"
+#include "stats.h"
+
+class AnalysisCache;
+class Board;
+class TranspositionTable;
+
+/*!
+ *  @struct SearchLimits
+ *  @brief Conditions under which a search stops.
+ */
+struct SearchLimits {
+  unsigned int depth = 64;  //!< Maximal iterative deepening depth.
+  std::uint64_t nodes = 0;  //!< Node budget, 0 for unlimited.
+  std::uint64_t time = 0;   //!< Time budget in milliseconds, 0 for unlimited.
+
+  //! External stop request, checked periodically if set.
+  const std::atomic<bool>* stop = nullptr;
+};
+
+/*!
+ *  @struct SearchOptions
+ *  @brief Toggles of the selective search techniques and analysis settings.
+ */
+struct SearchOptions {
+  unsigned int multiPv = 1;       //!< Number of best lines to search.
+  bool nullMove = true;           //!< Null-move pruning.
+  bool lateMoveReductions = true; //!< Late move reductions.
+  bool futility = true;           //!< Futility pruning at frontier nodes.
+  bool reverseFutility = true;    //!< Reverse futility (static null move).
+  bool lateMovePruning = true;    //!< Skipping late quiet moves.
+};
+
+/*!
+ *  @struct SearchResult
+ *  @brief Outcome of the last completed iteration.
+ */
+struct SearchResult {
+  Move bestMove;            //!< Best move, empty if there are no moves.
+  Move pv[SearchFrame::MAX_PLY]; //!< Principal variation, bestMove first.
+  unsigned int pvLength = 0; //!< Number of moves in pv.
+  unsigned int multiPv = 1; //!< Rank of the line, 1 for the best one.
+  int score = 0;            //!< Score from the side to move's point of view.
+  unsigned int depth = 0;   //!< Depth of the last completed iteration.
+  unsigned int selDepth = 0; //!< Deepest ply reached.
+  std::uint64_t nodes = 0;  //!< Nodes visited by the whole search.
+  std::uint64_t time = 0;   //!< Milliseconds spent.
+};
+
+/*!
+ *  @class Search
+ *  @brief Iterative deepening principal variation search with quiescence.
+ *
+ *  On top of the full-width search, a selectivity layer prunes and reduces
+ *  lines that are unlikely to matter, each technique toggled by
+ *  SearchOptions. Holds all of its state, so every thread owns its own
+ *  instance; only the transposition table may be shared between them.
+ *  Positions, move lists and lines live in a SearchStack allocated with
+ *  the instance, so a search allocates no memory.
+ */
+class Search {
+public:
+  static constexpr int INF = 32001;        //!< Bigger than any score.
+  static constexpr int MATE = 32000;       //!< Score of being mated now.
+  //! Deepest reachable ply.
+  static constexpr unsigned int MAX_PLY = SearchFrame::MAX_PLY;
+
+  //! Most lines searched in MultiPV mode.
+  static constexpr unsigned int MAX_MULTI_PV = 64;
+
+  //! Called after every completed iteration, once per MultiPV line.
+  using Reporter = std::function<void(const SearchResult&)>;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /*!
+   *  @struct Line
+   *  @brief A MultiPV line: exact score and principal variation.
+   */
+  struct Line {
+    int score;
+    unsigned int pvLength;
+    Move pv[MAX_PLY];
+  };
+
+  SearchLimits m_limits;    //!< Limits of the running search.
+  SearchOptions m_options;  //!< Enabled selective techniques.
+  Reporter m_reporter;      //!< Iteration callback, may be empty.
+  Clock::time_point m_start; //!< When the running search started.
+  std::uint64_t m_nodes;    //!< Nodes visited so far.
+  bool m_stopped;           //!< Set once a limit is hit.
+  Move m_rootBest;          //!< Best root move of the running iteration.
+  KeyHistory m_history;     //!< Keys of the game and of the current line.
+  TranspositionTable* m_tt; //!< Shared hash table, may be null.
+  AnalysisCache* m_cache;   //!< Results of earlier sessions, may be null.
+  SearchStats m_stats;      //!< Counters of the last search.
+  SearchStack m_stack;      //!< Per-ply boards, moves and lines.
+  unsigned int m_selDepth;  //!< Deepest ply of the running search.
+  Line m_lines[MAX_MULTI_PV]; //!< MultiPV lines, best first.
+  unsigned int m_lineCount; //!< Number of valid m_lines.
+  unsigned int m_helper;    //!< Lazy SMP helper index, 0 for the main one.
+
+public:
+  //! Creates an idle search with all techniques enabled.
+  Search();
+
+public:
+  /*!
+   *  @brief Searches the board until a limit is hit.
+   *
+   *  @param board Root position.
+   *  @param limits When to stop.
+   *  @param history Keys of the game positions before the root.
+   */
+  SearchResult go(const Board& board, const SearchLimits& limits,
+                  const KeyHistory& history = KeyHistory()) noexcept;
+
+  //! Sets which selective techniques are used.
+  void setOptions(const SearchOptions& options) noexcept {
+    m_options = options;
+  }
+
+  //! Returns the enabled selective techniques.
+  const SearchOptions& getOptions() const noexcept {
+    return m_options;
+  }
+
+  /*!
+   *  @brief Makes this search the given Lazy SMP helper, 0 for the main one.
+   *
+   *  Helpers skip iterations in a pattern of their own, so that threads
+   *  sharing a table do not all search the same depth.
+   */
+  void setHelper(const unsigned int helper) noexcept {
+    m_helper = helper;
+  }
+
+  //! Sets the transposition table, null to search without one.
+  void setTable(TranspositionTable* tt) noexcept {
+    m_tt = tt;
+  }
+
+  //! Sets the persistent analysis cache, null to search without one.
+  void setCache(AnalysisCache* cache) noexcept {
+    m_cache = cache;
+  }
+
+  //! Sets the callback invoked after every completed iteration.
+  void setReporter(const Reporter& reporter) {
+    m_reporter = reporter;
+  }
+
+  //! Returns the counters of the last search, all zero unless enabled.
+  const SearchStats& getStats() const noexcept {
+    return m_stats;
+  }
+
+  //! Returns true if the score announces a mate.
+  static bool isMateScore(const int score) noexcept {
+    return score > MATE - int(MAX_PLY) || score < -MATE + int(MAX_PLY);
+  }
+
+  /*!
+   *  @brief Fixed-depth benchmark of the selective techniques.
+   *
+   *  Searches a set of positions with all techniques off, with each one
+   *  alone and with all of them on, logging nodes and time to depth.
+   */
+  static void selectivityBenchmark(const unsigned int depth) noexcept;
+
+private:
+  /*!
+   *  @brief Principal variation search, 'ply' plies below the root.
+   *
+   *  @param allowNull False right after a null move.
+   */
+  int negamax(const Board& board, int depth, int alpha, int beta,
+              const unsigned int ply, const bool allowNull) noexcept;
+
+  /*!
+   *  @brief MultiPV root search, filling m_lines with the best 'lines'.
+   *
+   *  A single pass over the root moves. The best move of the last
+   *  iteration is searched exactly; every other move first gets a null
+   *  window, at the last iteration's worst line less the aspiration window
+   *  while the lines fill up, then at the worst line kept, and is searched
+   *  exactly only if it fails high. Moves that failed low while filling
+   *  are searched again only if too few lines ended up above the mark.
+   *  @return Score of the best line.
+   */
+  int searchRoot(const Board& board, int depth,
+                 const unsigned int lines) noexcept;
+
+  //! Resolves captures until the position is quiet.
+  int quiesce(const Board& board, int alpha, const int beta,
+              const unsigned int ply) noexcept;
+
+  //! Generates pseudo-legal moves into 'r_moves', counting them.
+  void generate(const Board& board, MoveList& r_moves) noexcept;
+
+  //! Evaluates the board, counting the call.
+  int evaluate(const Board& board) noexcept;
+
+  //! Counts a node and returns true if the search must stop.
+  bool visitNode() noexcept;
+
+  //! Returns milliseconds since the search started.
+  std::uint64_t elapsed() const noexcept;
+};
+
+#endif
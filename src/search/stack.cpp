@@ -0,0 +1,35 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stack.h"
+
+SearchStack::SearchStack()
+  : m_frames(new SearchFrame[SIZE])
+{
+  clear();
+}
+
+void SearchStack::clear() noexcept {
+  for (unsigned int ply = 0; ply < SIZE; ++ply) {
+    SearchFrame& frame = m_frames[ply];
+    frame.moves.clear();
+    frame.killers[0] = frame.killers[1] = Move();
+    frame.staticEval = 0;
+    frame.pvLength = 0;
+  }
+}
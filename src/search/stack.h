@@ -0,0 +1,84 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STACK__
+#define __STACK__
+
+#include <cstddef>
+#include <memory>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/movelist.h"
+
+/*!
+ *  @struct SearchFrame
+ *  @brief Everything the search keeps for one ply.
+ */
+struct alignas(64) SearchFrame {
+  static constexpr unsigned int MAX_PLY = 128; //!< Deepest reachable ply.
+
+  Board board;                    //!< Position at this ply.
+  MoveList moves;                 //!< Moves generated at this ply.
+  int keys[MoveList::CAPACITY];   //!< Ordering keys of 'moves'.
+  Move killers[2];                //!< Quiet moves that failed high here.
+  int staticEval;                 //!< Static evaluation, if computed.
+  unsigned int pvLength;          //!< Number of moves in 'pv'.
+  Move pv[MAX_PLY];               //!< Best line found from this ply.
+};
+
+/*!
+ *  @class SearchStack
+ *  @brief Preallocated frames for every ply of a search thread.
+ *
+ *  Allocated once when the search is created, so searching itself never
+ *  touches the allocator, and adjacent plies sit next to each other in
+ *  memory instead of being spread over the call stack and the heap.
+ */
+class SearchStack {
+public:
+  //! Frames: the root, MAX_PLY plies below it and one for the leaf child.
+  static constexpr unsigned int SIZE = SearchFrame::MAX_PLY + 2;
+
+private:
+  std::unique_ptr<SearchFrame[]> m_frames; //!< The frames, root first.
+
+public:
+  //! Allocates and initialises all frames.
+  SearchStack();
+
+public:
+  //! Returns the frame of a ply.
+  SearchFrame& operator[](const unsigned int ply) noexcept {
+    return m_frames[ply];
+  }
+
+  const SearchFrame& operator[](const unsigned int ply) const noexcept {
+    return m_frames[ply];
+  }
+
+  //! Clears the per-game heuristics of all frames.
+  void clear() noexcept;
+
+  //! Returns the memory held by the frames, in bytes.
+  static constexpr std::size_t getSize() noexcept {
+    return SIZE * sizeof(SearchFrame);
+  }
+};
+
+#endif
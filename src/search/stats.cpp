@@ -0,0 +1,126 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+
+#ifdef NELLY_STATS
+//! Allocations of the current thread, counted by the operators below.
+static thread_local std::uint64_t t_allocations = 0;
+
+void* operator new(const std::size_t size) {
+  ++t_allocations;
+  if (void* const memory = std::malloc(size? size : 1)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* const memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* const memory, const std::size_t) noexcept {
+  std::free(memory);
+}
+#endif
+
+std::uint64_t SearchStats::threadAllocations() noexcept {
+#ifdef NELLY_STATS
+  return t_allocations;
+#else
+  return 0;
+#endif
+}
+
+//! Returns a / b, or 0 when nothing was counted.
+static double ratio(const std::uint64_t a, const std::uint64_t b) noexcept {
+  return b? double(a) / double(b) : 0.0;
+}
+
+void SearchStats::merge(const SearchStats& other) noexcept {
+  pvNodes += other.pvNodes;
+  nonPvNodes += other.nonPvNodes;
+  quiescenceNodes += other.quiescenceNodes;
+  generatorCalls += other.generatorCalls;
+  movesGenerated += other.movesGenerated;
+  makeMoveCalls += other.makeMoveCalls;
+  evalCalls += other.evalCalls;
+  allocations += other.allocations;
+  stackBytes = std::max(stackBytes, other.stackBytes);
+  hashProbes += other.hashProbes;
+  hashHits += other.hashHits;
+  hashCutoffs += other.hashCutoffs;
+  betaCutoffs += other.betaCutoffs;
+  firstMoveCutoffs += other.firstMoveCutoffs;
+  for (unsigned int i = 0; i <= MAX_DEPTH; ++i) {
+    iterationNodes[i] += other.iterationNodes[i];
+  }
+  generatorCycles += other.generatorCycles;
+  generatorSamples += other.generatorSamples;
+  evalCycles += other.evalCycles;
+  evalSamples += other.evalSamples;
+}
+
+std::string SearchStats::toJson() const {
+  std::ostringstream out;
+  out << "{\"nodes\":{\"pv\":" << pvNodes
+      << ",\"nonpv\":" << nonPvNodes
+      << ",\"quiescence\":" << quiescenceNodes << '}'
+      << ",\"generator\":{\"calls\":" << generatorCalls
+      << ",\"moves\":" << movesGenerated
+      << ",\"movesPerCall\":" << ratio(movesGenerated, generatorCalls) << '}'
+      << ",\"makeMove\":" << makeMoveCalls
+      << ",\"eval\":" << evalCalls
+      << ",\"allocations\":" << allocations
+      << ",\"stackBytes\":" << stackBytes
+      << ",\"hash\":{\"probes\":" << hashProbes
+      << ",\"hits\":" << hashHits
+      << ",\"cutoffs\":" << hashCutoffs
+      << ",\"hitRate\":" << ratio(hashHits, hashProbes) << '}'
+      << ",\"cutoffs\":{\"beta\":" << betaCutoffs
+      << ",\"firstMove\":" << firstMoveCutoffs
+      << ",\"firstMoveRate\":" << ratio(firstMoveCutoffs, betaCutoffs) << '}';
+
+  // Nodes spent on each iteration and their ratio to the previous one.
+  out << ",\"depths\":[";
+  std::uint64_t previous = 0;
+  bool first = true;
+  for (unsigned int depth = 1; depth <= MAX_DEPTH; ++depth) {
+    if (!iterationNodes[depth]) {
+      continue;
+    }
+    out << (first? "" : ",") << "{\"depth\":" << depth
+        << ",\"nodes\":" << iterationNodes[depth]
+        << ",\"branching\":" << ratio(iterationNodes[depth], previous) << '}';
+    previous = iterationNodes[depth];
+    first = false;
+  }
+  out << ']';
+
+  out << ",\"cycles\":{\"generator\":" << ratio(generatorCycles, generatorSamples)
+      << ",\"eval\":" << ratio(evalCycles, evalSamples) << "}}";
+  return out.str();
+}
@@ -0,0 +1,120 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATS__
+#define __STATS__
+
+#include <cstdint>
+#include <string>
+
+// Cycle sampling is an addition to the counters.
+#if defined(NELLY_STATS_CYCLES) && !defined(NELLY_STATS)
+#define NELLY_STATS
+#endif
+
+#if defined(NELLY_STATS_CYCLES) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/*!
+ *  @brief Executes the statement only in statistics builds.
+ *
+ *  Build with "make STATS=1" to define NELLY_STATS, or "make CYCLES=1" to
+ *  also sample generator and evaluator cycles with rdtsc. Otherwise every
+ *  counter update vanishes and the search runs at full speed.
+ */
+#ifdef NELLY_STATS
+#define NELLY_STAT(statement) do { statement; } while (false)
+#else
+#define NELLY_STAT(statement) do {} while (false)
+#endif
+
+/*!
+ *  @struct SearchStats
+ *  @brief Counters of a single search thread.
+ *
+ *  Each thread updates its own copy without atomics; copies are merged
+ *  once the search is over.
+ */
+struct SearchStats {
+#ifdef NELLY_STATS
+  static constexpr bool ENABLED = true;
+#else
+  static constexpr bool ENABLED = false;
+#endif
+
+  static constexpr unsigned int MAX_DEPTH = 64; //!< Iterations tracked.
+  static constexpr unsigned int SAMPLE_RATE = 64; //!< Calls per cycle sample.
+
+  std::uint64_t pvNodes = 0;        //!< Full window main search nodes.
+  std::uint64_t nonPvNodes = 0;     //!< Zero window main search nodes.
+  std::uint64_t quiescenceNodes = 0; //!< Quiescence nodes.
+
+  std::uint64_t generatorCalls = 0; //!< Board::getValidMoves() calls.
+  std::uint64_t movesGenerated = 0; //!< Pseudo-legal moves returned.
+  std::uint64_t makeMoveCalls = 0;  //!< Board::makeMove() calls.
+  std::uint64_t evalCalls = 0;      //!< Eval::evaluate() calls.
+
+  std::uint64_t hashProbes = 0;     //!< Transposition table lookups.
+  std::uint64_t hashHits = 0;       //!< Lookups finding the position.
+  std::uint64_t hashCutoffs = 0;    //!< Hits returning without a search.
+
+  std::uint64_t betaCutoffs = 0;    //!< Fail highs in the move loop.
+  std::uint64_t firstMoveCutoffs = 0; //!< Fail highs on the first move.
+
+  std::uint64_t allocations = 0;   //!< Heap allocations while searching.
+  std::uint64_t stackBytes = 0;    //!< Peak search stack memory in use.
+
+  //! Nodes spent on each completed iteration.
+  std::uint64_t iterationNodes[MAX_DEPTH + 1] = {};
+
+  std::uint64_t generatorCycles = 0; //!< Sampled generator cycles.
+  std::uint64_t generatorSamples = 0; //!< Generator calls sampled.
+  std::uint64_t evalCycles = 0;      //!< Sampled evaluator cycles.
+  std::uint64_t evalSamples = 0;     //!< Evaluator calls sampled.
+
+  //! Adds the counters of another thread.
+  void merge(const SearchStats& other) noexcept;
+
+  //! Formats all counters and derived rates as a one line JSON object.
+  std::string toJson() const;
+
+  //! Returns the heap allocations made by the calling thread so far.
+  static std::uint64_t threadAllocations() noexcept;
+
+  //! Returns the time stamp counter when cycle sampling is built in, or 0.
+  static std::uint64_t cycles() noexcept {
+#if defined(NELLY_STATS_CYCLES) && defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+  }
+
+  //! Returns true if the call with this ordinal should be timed.
+  static bool isSampled(const std::uint64_t call) noexcept {
+#if defined(NELLY_STATS_CYCLES) && defined(__x86_64__)
+    return !(call % SAMPLE_RATE);
+#else
+    (void)call;
+    return false;
+#endif
+  }
+};
+
+#endif
@@ -0,0 +1,485 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tt.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "search.h"
+
+static constexpr std::size_t HUGE_PAGE = 2 * 1024 * 1024; //!< x86-64 size.
+
+//! Marks a shared segment whose header is complete.
+static constexpr std::uint64_t SHARED_MAGIC = 0x4E454C4C59545431ull;
+
+//! Layout of the header and packed entries, bumped whenever either changes.
+static constexpr std::uint32_t SHARED_VERSION = 2;
+
+//! Rounds 'bytes' up to a multiple of 'unit'.
+static std::size_t roundUp(const std::size_t bytes,
+                           const std::size_t unit) noexcept
+{
+  return (bytes + unit - 1) / unit * unit;
+}
+
+/*!
+ *  @brief Maps 'r_bytes' of zeroed memory, preferring huge pages.
+ *
+ *  Explicit huge pages need pages reserved by the administrator, so they
+ *  usually fail and transparent ones are tried next: the mapping is
+ *  aligned to a huge page and advised, which the kernel honours in both
+ *  the "always" and "madvise" modes. 'r_bytes' is updated to the size
+ *  actually mapped.
+ */
+static void* allocate(std::size_t& r_bytes, const bool large,
+                      TranspositionTable::Pages& r_pages) noexcept
+{
+#if defined(__linux__)
+  constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+  constexpr int PROT = PROT_READ | PROT_WRITE;
+  if (large) {
+    const std::size_t bytes = roundUp(r_bytes, HUGE_PAGE);
+#if defined(MAP_HUGETLB)
+    void* memory = mmap(nullptr, bytes, PROT, FLAGS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+      r_bytes = bytes;
+      r_pages = TranspositionTable::Pages::Huge;
+      return memory;
+    }
+#endif
+#if defined(MADV_HUGEPAGE)
+    // Over-map by one huge page and trim both ends to align it.
+    char* raw = static_cast<char*>(
+        mmap(nullptr, bytes + HUGE_PAGE, PROT, FLAGS, -1, 0));
+    if (raw != MAP_FAILED) {
+      char* aligned = reinterpret_cast<char*>(
+          roundUp(reinterpret_cast<std::uintptr_t>(raw), HUGE_PAGE));
+      if (aligned > raw) {
+        munmap(raw, aligned - raw);
+      }
+      if (raw + HUGE_PAGE > aligned) {
+        munmap(aligned + bytes, raw + HUGE_PAGE - aligned);
+      }
+      madvise(aligned, bytes, MADV_HUGEPAGE);
+      r_bytes = bytes;
+      r_pages = TranspositionTable::Pages::Transparent;
+      return aligned;
+    }
+#endif
+  }
+  void* memory = mmap(nullptr, r_bytes, PROT, FLAGS, -1, 0);
+  r_pages = TranspositionTable::Pages::Normal;
+  return memory != MAP_FAILED? memory : nullptr;
+#else
+  (void)large;
+  r_pages = TranspositionTable::Pages::Normal;
+  return std::aligned_alloc(64, r_bytes);
+#endif
+}
+
+//! Releases memory obtained from allocate().
+static void release(void* memory, const std::size_t bytes) noexcept {
+  if (!memory) {
+    return;
+  }
+#if defined(__linux__)
+  munmap(memory, bytes);
+#else
+  (void)bytes;
+  std::free(memory);
+#endif
+}
+
+#if defined(__linux__)
+/*!
+ *  @brief Opens and locks the lock object of the shared segment 'path'.
+ *
+ *  Attaching, detaching and clearing a shared table all happen under this
+ *  lock, so a segment is never removed while another process opens it.
+ *  The last process out removes the lock object too, so a lock taken on
+ *  an object that was removed meanwhile is dropped and taken again.
+ *  @return The locked descriptor, -1 on failure.
+ */
+static int lockSegment(const std::string& path) noexcept {
+  const std::string name = path + ".lock";
+  while (true) {
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+      return -1;
+    }
+    struct stat status;
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &status) != 0) {
+      close(fd);
+      return -1;
+    }
+    if (status.st_nlink) {
+      return fd;
+    }
+    close(fd);
+  }
+}
+
+/*!
+ *  @brief Returns true if no other process holds the segment 'fd'.
+ *
+ *  Processes hold a shared flock on the segment while attached, which the
+ *  kernel drops when they exit, however that happens. Must be called with
+ *  the segment lock held: the conversion to an exclusive lock may drop the
+ *  shared one for a moment, and the shared lock is held again on return.
+ */
+static bool isAlone(const int fd) noexcept {
+  const bool alone = flock(fd, LOCK_EX | LOCK_NB) == 0;
+  flock(fd, LOCK_SH);
+  return alone;
+}
+#endif
+
+//! Packs entry fields: move, score, depth, bound and generation.
+static std::uint64_t pack(const std::uint16_t move, const int score,
+                          const int depth, const TranspositionTable::Bound bound,
+                          const std::uint8_t generation) noexcept
+{
+  return std::uint64_t(move) |
+         std::uint64_t(std::uint16_t(std::int16_t(score))) << 16 |
+         std::uint64_t(std::uint8_t(depth)) << 32 |
+         std::uint64_t(bound) << 40 |
+         std::uint64_t(generation) << 48;
+}
+
+static int depthOf(const std::uint64_t data) noexcept {
+  return std::uint8_t(data >> 32);
+}
+
+static std::uint8_t generationOf(const std::uint64_t data) noexcept {
+  return std::uint8_t(data >> 48);
+}
+
+TranspositionTable::TranspositionTable(const std::size_t mb,
+                                       const bool largePages)
+  : m_header(nullptr)
+  , m_name()
+  , m_fd(-1)
+  , m_buckets(nullptr)
+  , m_count(0)
+  , m_mapped(0)
+  , m_pages(Pages::Normal)
+  , m_largePages(largePages)
+  , m_generation(0)
+{
+  resize(mb);
+}
+
+TranspositionTable::~TranspositionTable() {
+  unmap();
+}
+
+bool TranspositionTable::resize(const std::size_t mb,
+                                const unsigned int threads)
+{
+  const std::string name = m_name;
+  unmap();
+  m_count = std::max<std::size_t>(mb * 1024 * 1024 / sizeof(Bucket), 1);
+  allocatePrivate();
+  clear(threads);
+  return name.empty() || attach(name);
+}
+
+void TranspositionTable::allocatePrivate() {
+  m_mapped = m_count * sizeof(Bucket);
+  m_buckets = static_cast<Bucket*>(allocate(m_mapped, m_largePages, m_pages));
+  if (!m_buckets) {
+    // Out of memory: keep a single bucket rather than no table at all.
+    m_count = 1;
+    m_mapped = sizeof(Bucket);
+    m_buckets = static_cast<Bucket*>(allocate(m_mapped, false, m_pages));
+  }
+}
+
+void TranspositionTable::unmap() noexcept {
+  if (!m_header) {
+    release(m_buckets, m_mapped);
+  }
+#if defined(__linux__)
+  else {
+    // The last process out removes the name, the memory goes with the
+    // last mapping.
+    const int lock = lockSegment(m_name);
+    munmap(m_header, m_mapped);
+    if (lock >= 0 && isAlone(m_fd)) {
+      shm_unlink(m_name.c_str());
+      shm_unlink((m_name + ".lock").c_str());
+    }
+    close(m_fd);
+    if (lock >= 0) {
+      close(lock);
+    }
+  }
+#endif
+  m_header = nullptr;
+  m_name.clear();
+  m_fd = -1;
+  m_buckets = nullptr;
+  m_mapped = 0;
+}
+
+bool TranspositionTable::attach(const std::string& name) {
+#if defined(__linux__)
+  const std::string path = name.empty() || name[0] != '/'? "/" + name : name;
+  if (m_header && path == m_name) {
+    return true;
+  }
+  const std::size_t bytes = sizeof(Header) + m_count * sizeof(Bucket);
+  const int lock = lockSegment(path);
+  if (lock < 0) {
+    return false;
+  }
+
+  // A segment nobody holds, left behind by processes that died or made
+  // for another size or build, is replaced; once only, as a fresh one must
+  // fit.
+  Header* header = nullptr;
+  int fd = -1;
+  for (unsigned int attempt = 0; attempt < 2 && !header; ++attempt) {
+    fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      break;
+    }
+    const bool created = status.st_size == 0;
+    void* memory = MAP_FAILED;
+    if (created? ftruncate(fd, bytes) == 0
+               : std::size_t(status.st_size) == bytes) {
+      memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                    0);
+    }
+
+    // The kernel hands out zeroed pages, which is an empty table.
+    header = static_cast<Header*>(memory);
+    if (created && memory != MAP_FAILED) {
+      new (header) Header();
+      header->version = SHARED_VERSION;
+      header->bucketSize = sizeof(Bucket);
+      header->count = m_count;
+      header->generation.store(0);
+      header->magic.store(SHARED_MAGIC, std::memory_order_release);
+    } else if (memory != MAP_FAILED &&
+               (header->magic.load(std::memory_order_acquire) !=
+                    SHARED_MAGIC ||
+                header->version != SHARED_VERSION ||
+                header->bucketSize != sizeof(Bucket) ||
+                header->count != m_count)) {
+      munmap(memory, bytes);
+      memory = MAP_FAILED;
+    }
+    if (memory == MAP_FAILED) {
+      header = nullptr;
+      const bool unused = created || flock(fd, LOCK_EX | LOCK_NB) == 0;
+      if (unused) {
+        shm_unlink(path.c_str());
+      }
+      close(fd);
+      fd = -1;
+      if (!unused) {
+        break;
+      }
+    }
+  }
+  if (!header) {
+    close(lock);
+    return false;
+  }
+  flock(fd, LOCK_SH);
+  close(lock);
+
+  unmap();
+  m_header = header;
+  m_name = path;
+  m_fd = fd;
+  m_buckets = reinterpret_cast<Bucket*>(header + 1);
+  m_mapped = bytes;
+  m_pages = Pages::Normal;
+  m_generation = header->generation.load();
+  return true;
+#else
+  (void)name;
+  return false;
+#endif
+}
+
+void TranspositionTable::detach(const unsigned int threads) {
+  if (!m_header) {
+    return;
+  }
+  unmap();
+  allocatePrivate();
+  clear(threads);
+}
+
+bool TranspositionTable::setLargePages(const bool enabled,
+                                       const unsigned int threads)
+{
+  m_largePages = enabled;
+  return resize(getSize() / (1024 * 1024), threads);
+}
+
+const char* TranspositionTable::getPagesName(const Pages pages) noexcept {
+  switch (pages) {
+    case Pages::Huge:
+      return "huge";
+    case Pages::Transparent:
+      return "transparent huge";
+    default:
+      return "normal";
+  }
+}
+
+void TranspositionTable::clear(const unsigned int threads) noexcept {
+  // Other processes may attach while the table is cleared, not before.
+  int lock = -1;
+#if defined(__linux__)
+  if (m_header) {
+    lock = lockSegment(m_name);
+    if (lock < 0 || !isAlone(m_fd)) {
+      if (lock >= 0) {
+        close(lock);
+      }
+      return;
+    }
+  }
+#endif
+
+  // Each thread writes, and so first-touches, a contiguous slice.
+  auto clearSlice = [this](const std::size_t begin, const std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      for (Entry& entry : m_buckets[i].entries) {
+        entry.check.store(0, std::memory_order_relaxed);
+        entry.data.store(0, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  const std::size_t count =
+      std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(
+          m_count * sizeof(Bucket) / HUGE_PAGE, 1));
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < count; ++i) {
+    workers.emplace_back(clearSlice, m_count * i / count,
+                         m_count * (i + 1) / count);
+  }
+  clearSlice(0, m_count / count);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  m_generation = 0;
+  if (m_header) {
+    m_header->generation.store(0);
+  }
+#if defined(__linux__)
+  if (lock >= 0) {
+    close(lock);
+  }
+#endif
+}
+
+bool TranspositionTable::probe(const std::uint64_t key,
+                               Data& r_data) const noexcept
+{
+  for (const Entry& entry : bucket(key).entries) {
+    const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+    const std::uint64_t check = entry.check.load(std::memory_order_relaxed);
+    if ((check ^ data) != key || !data) {
+      continue;
+    }
+    r_data.move = std::uint16_t(data);
+    r_data.score = std::int16_t(data >> 16);
+    r_data.depth = depthOf(data);
+    r_data.bound = Bound(data >> 40 & 0b11);
+    return true;
+  }
+  return false;
+}
+
+void TranspositionTable::store(const std::uint64_t key,
+                               const std::uint16_t move, const int score,
+                               const int depth, const Bound bound) noexcept
+{
+  // Same key first, otherwise the shallowest entry, older ones counting less.
+  Entry* replace = nullptr;
+  int worst = 0;
+  std::uint16_t oldMove = 0;
+  for (Entry& entry : bucket(key).entries) {
+    const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+    const std::uint64_t check = entry.check.load(std::memory_order_relaxed);
+    if ((check ^ data) == key) {
+      replace = &entry;
+      oldMove = std::uint16_t(data);
+      break;
+    }
+    const int age = std::uint8_t(m_generation - generationOf(data));
+    const int value = depthOf(data) - 8 * age;
+    if (!replace || value < worst) {
+      replace = &entry;
+      worst = value;
+    }
+  }
+
+  // Keep a known move when the new result has none.
+  const std::uint64_t data =
+      pack(move? move : oldMove, score, depth, bound, m_generation);
+  replace->data.store(data, std::memory_order_relaxed);
+  replace->check.store(key ^ data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::toTable(const int score, const int ply) noexcept {
+  if (score > Search::MATE - int(Search::MAX_PLY)) {
+    return score + ply;
+  }
+  if (score < -Search::MATE + int(Search::MAX_PLY)) {
+    return score - ply;
+  }
+  return score;
+}
+
+int TranspositionTable::fromTable(const int score, const int ply) noexcept {
+  if (score > Search::MATE - int(Search::MAX_PLY)) {
+    return score - ply;
+  }
+  if (score < -Search::MATE + int(Search::MAX_PLY)) {
+    return score + ply;
+  }
+  return score;
+}
@@ -0,0 +1,228 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TT__
+#define __TT__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*!
+ *  @class TranspositionTable
+ *  @brief Hash table of search results shared by all search threads.
+ *
+ *  Entries are two 64-bit words: the packed data and the key XOR the data.
+ *  Words are read and written without locks, so a torn entry written by
+ *  two threads at once simply fails the key check on the next probe.
+ *  Entries come in cache-line sized buckets of four.
+ *
+ *  The table is mapped on huge pages when the system allows it, which
+ *  keeps random probes from missing the TLB, and is cleared by several
+ *  threads so that on NUMA machines each node first-touches its share.
+ *
+ *  The table may also live in a named POSIX shared-memory segment that
+ *  several engine processes attach to. The lockless entry check works the
+ *  same across processes, so no further synchronisation is needed. The
+ *  segment starts with a header the attaching processes verify. Every
+ *  attached process holds a shared flock on the segment, which the kernel
+ *  releases even if the process dies. Attaching, detaching and clearing
+ *  are serialised by an exclusive flock on a lock object next to the
+ *  segment, named like it plus ".lock". The last process to detach, the
+ *  only one whose exclusive flock on the segment succeeds, removes both.
+ */
+class TranspositionTable {
+public:
+  /*!
+   *  @enum Bound
+   *  @brief How the stored score relates to the true score.
+   */
+  enum class Bound : unsigned char
+  {
+    None,
+    Upper, //!< Failed low, true score is at most the stored one.
+    Lower, //!< Failed high, true score is at least the stored one.
+    Exact
+  };
+
+  /*!
+   *  @struct Data
+   *  @brief An unpacked entry.
+   */
+  struct Data {
+    std::uint16_t move; //!< Best move packed by PackedGame::packMove, 0 if none.
+    int score;          //!< Score as stored, see toTable()/fromTable().
+    int depth;          //!< Depth of the search that produced it.
+    Bound bound;        //!< Kind of score.
+  };
+
+  /*!
+   *  @enum Pages
+   *  @brief Kind of pages backing the table.
+   */
+  enum class Pages : unsigned char
+  {
+    Normal,      //!< Regular 4 KiB pages.
+    Transparent, //!< Transparent huge pages requested with madvise.
+    Huge         //!< Explicit huge pages from MAP_HUGETLB.
+  };
+
+private:
+  struct Entry {
+    std::atomic<std::uint64_t> check; //!< Key XOR data.
+    std::atomic<std::uint64_t> data;  //!< Packed Data plus generation.
+  };
+
+  struct alignas(64) Bucket {
+    Entry entries[4];
+  };
+
+  /*!
+   *  @struct Header
+   *  @brief Start of a shared segment, the buckets follow it.
+   */
+  struct alignas(64) Header {
+    std::atomic<std::uint64_t> magic;      //!< Set once the table is ready.
+    std::uint32_t version;                 //!< Layout of the entries.
+    std::uint32_t bucketSize;              //!< sizeof(Bucket).
+    std::uint64_t count;                   //!< Number of buckets.
+    std::atomic<std::uint8_t> generation;  //!< Shared search age.
+  };
+
+  Header* m_header;          //!< Shared segment header, null if private.
+  std::string m_name;        //!< Name of the shared segment, if any.
+  int m_fd;                  //!< Shared segment, flocked while attached.
+  Bucket* m_buckets;         //!< The table.
+  std::size_t m_count;       //!< Number of buckets.
+  std::size_t m_mapped;      //!< Bytes actually mapped.
+  Pages m_pages;             //!< Pages backing the table.
+  bool m_largePages;         //!< Whether huge pages may be used.
+  std::uint8_t m_generation; //!< Age of the current search.
+
+public:
+  //! Creates a table of the given size in MiB.
+  explicit TranspositionTable(const std::size_t mb = 16,
+                              const bool largePages = true);
+
+  ~TranspositionTable();
+
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+public:
+  /*!
+   *  @brief Reallocates the table with the given size in MiB, clearing it.
+   *
+   *  Huge pages are tried first if enabled, explicit ones then transparent
+   *  ones, falling back to regular pages. A shared table is shared again
+   *  under the same name.
+   *  @return False if a shared table could not be shared again, in which
+   *  case it is private.
+   */
+  bool resize(const std::size_t mb, const unsigned int threads = 1);
+
+  /*!
+   *  @brief Allows or forbids huge pages, reallocating the table.
+   *
+   *  @return False as resize() does.
+   */
+  bool setLargePages(const bool enabled, const unsigned int threads = 1);
+
+  //! Returns the kind of pages the table got.
+  Pages getPages() const noexcept {
+    return m_pages;
+  }
+
+  //! Returns a printable name of a page kind.
+  static const char* getPagesName(const Pages pages) noexcept;
+
+  /*!
+   *  @brief Empties the table, splitting the work over 'threads' threads.
+   *
+   *  A shared table is left alone while other processes use it.
+   */
+  void clear(const unsigned int threads = 1) noexcept;
+
+  /*!
+   *  @brief Moves the table into the shared-memory segment 'name'.
+   *
+   *  The segment is created with the current size if it does not exist,
+   *  otherwise its header must match this build and size. A segment that
+   *  does not match and that no process holds, e.g. one left behind by a
+   *  crash, is replaced. On failure the table stays as it was and false
+   *  is returned. Resizing keeps the table attached to the same name.
+   */
+  bool attach(const std::string& name);
+
+  //! Leaves the shared segment for a private table of the same size.
+  void detach(const unsigned int threads = 1);
+
+  //! Returns true if the table lives in a shared segment.
+  bool isShared() const noexcept {
+    return m_header;
+  }
+
+  //! Returns the shared segment name, empty if private.
+  const std::string& getName() const noexcept {
+    return m_name;
+  }
+
+  //! Starts loading the bucket of a key, ahead of a probe or store.
+  void prefetch(const std::uint64_t key) const noexcept {
+    __builtin_prefetch(&bucket(key));
+  }
+
+  //! Starts a new search, ageing the existing entries.
+  void newSearch() noexcept {
+    m_generation = m_header? m_header->generation.fetch_add(1) + 1
+                           : m_generation + 1;
+  }
+
+  //! Looks the key up, filling 'r_data' on a hit.
+  bool probe(const std::uint64_t key, Data& r_data) const noexcept;
+
+  //! Stores a result, replacing the least valuable entry of the bucket.
+  void store(const std::uint64_t key, const std::uint16_t move,
+             const int score, const int depth, const Bound bound) noexcept;
+
+  //! Returns the size of the table in bytes.
+  std::size_t getSize() const noexcept {
+    return m_count * sizeof(Bucket);
+  }
+
+  //! Converts a search score at 'ply' into a ply independent one.
+  static int toTable(const int score, const int ply) noexcept;
+
+  //! Converts a stored score back into a score at 'ply'.
+  static int fromTable(const int score, const int ply) noexcept;
+
+private:
+  //! Allocates a private table of 'm_count' buckets.
+  void allocatePrivate();
+
+  //! Releases the table, detaching from the segment if shared.
+  void unmap() noexcept;
+
+  //! Returns the bucket of a key.
+  Bucket& bucket(const std::uint64_t key) const noexcept {
+    return m_buckets[(unsigned __int128)key * m_count >> 64];
+  }
+};
+
+#endif
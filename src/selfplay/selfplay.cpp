@@ -0,0 +1,200 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "selfplay.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <list>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../chess/packed.h"
+#include "../endgame/bitbase.h"
+#include "../search/repetition.h"
+#include "../search/search.h"
+
+//! Records buffered per shard before a single write.
+static constexpr std::size_t BATCH = 8192;
+
+/*!
+ *  @class ShardWriter
+ *  @brief Buffered writer of one thread's output file.
+ */
+class ShardWriter {
+  std::FILE* m_file;
+  std::vector<TrainingRecord> m_buffer;
+
+public:
+  explicit ShardWriter(const std::string& path)
+    : m_file(std::fopen(path.c_str(), "wb"))
+  {
+    m_buffer.reserve(BATCH);
+  }
+
+  ShardWriter(const ShardWriter&) = delete;
+
+  ~ShardWriter() {
+    flush();
+    if (m_file) {
+      std::fclose(m_file);
+    }
+  }
+
+  //! Returns true if the file could be opened.
+  bool isOpen() const noexcept {
+    return m_file;
+  }
+
+  //! Queues the records, writing out full batches.
+  void append(const std::vector<TrainingRecord>& records) noexcept {
+    for (const TrainingRecord& record : records) {
+      m_buffer.push_back(record);
+      if (m_buffer.size() == BATCH) {
+        flush();
+      }
+    }
+  }
+
+  //! Writes out all queued records.
+  void flush() noexcept {
+    if (m_file && !m_buffer.empty()) {
+      std::fwrite(m_buffer.data(), sizeof(TrainingRecord), m_buffer.size(),
+                  m_file);
+    }
+    m_buffer.clear();
+  }
+};
+
+SelfPlay::SelfPlay(const SelfPlayConfig& config)
+  : m_config(config)
+  , m_start()
+  , m_nextGame(0)
+  , m_positions(0)
+{
+  m_start.loadFen();
+}
+
+void SelfPlay::run() noexcept {
+  Bitbase::init();
+  Logger::info("Self-play: " + std::to_string(m_config.games) + " games, " +
+               std::to_string(m_config.threads) + " threads, " +
+               std::to_string(m_config.nodes) + " nodes per move");
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned int id = 0; id < m_config.threads; ++id) {
+    threads.emplace_back(&SelfPlay::worker, this, id);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const std::uint64_t positions = m_positions.load();
+  Logger::info("Self-play done: " + std::to_string(positions) +
+               " positions in " + std::to_string(elapsed.count()) + " s (" +
+               std::to_string(std::uint64_t(positions / elapsed.count() * 3600)) +
+               " positions/hour)");
+}
+
+void SelfPlay::worker(const unsigned int id) noexcept {
+  ShardWriter writer(m_config.prefix + "." + std::to_string(id) + ".bin");
+  if (!writer.isOpen()) {
+    Logger::error("Self-play: can't open shard " + std::to_string(id));
+    return;
+  }
+
+  std::mt19937_64 rng(m_config.seed + id);
+  Search search;
+  SearchLimits limits;
+  limits.nodes = m_config.nodes;
+
+  std::vector<TrainingRecord> records;
+  records.reserve(m_config.maxPlies);
+  while (m_nextGame.fetch_add(1, std::memory_order_relaxed) < m_config.games) {
+    Board board(m_start);
+    bool isOver = false;
+    // The opening plies count too: a game may repeat back into them.
+    KeyHistory history;
+    for (unsigned int ply = 0; ply < m_config.randomPlies && !isOver; ++ply) {
+      const std::list<Move>& moves = board.getLegalMoves();
+      if (moves.empty()) {
+        isOver = true;
+        break;
+      }
+      auto it = moves.begin();
+      std::advance(it, rng() % moves.size());
+      history.push(board.getKey());
+      board = board.makeMove(*it);
+    }
+    if (isOver) {
+      continue;
+    }
+
+    // Result from white's point of view.
+    int result = 0;
+    records.clear();
+    for (unsigned int ply = m_config.randomPlies; ply < m_config.maxPlies;
+         ++ply)
+    {
+      const Bitbase::Result known = Bitbase::probe(board);
+      if (known != Bitbase::Result::Unknown) {
+        result = static_cast<int>(known) * (board.isWhitesMove()? 1 : -1);
+        break;
+      }
+      if (board.getPieceCount() == 2 || board.isFiftyMoveDraw() ||
+          history.repetitions(board) >= 2)
+      {
+        break;
+      }
+
+      const SearchResult& found = search.go(board, limits, history);
+      if (found.bestMove == Move()) {
+        if (board.isInCheck()) {
+          result = board.isWhitesMove()? -1 : 1;
+        }
+        break;
+      }
+
+      TrainingRecord record{};
+      record.board = PackedBoard::fromBoard(board);
+      record.score = std::clamp(found.score, -Search::MATE, Search::MATE);
+      record.ply = ply;
+      records.push_back(record);
+      history.push(board.getKey());
+      board = board.makeMove(found.bestMove);
+    }
+
+    for (TrainingRecord& record : records) {
+      record.result = record.board.isWhitesMove()? result : -result;
+    }
+    writer.append(records);
+    m_positions.fetch_add(records.size(), std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SELFPLAY__
+#define __SELFPLAY__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "../chess/board.h"
+#include "../chess/packed.h"
+
+/*!
+ *  @struct TrainingRecord
+ *  @brief One labelled position of the training data, 40 bytes on disk.
+ *
+ *  Score and result are from the side to move's point of view.
+ */
+struct TrainingRecord {
+  PackedBoard board;        //!< The position.
+  std::int16_t score;       //!< Search score in centipawns.
+  std::uint16_t ply;        //!< Game ply of the position.
+  std::int8_t result;       //!< 1 win, 0 draw, -1 loss.
+  std::uint8_t reserved[3]; //!< Always zero.
+};
+
+static_assert(sizeof(TrainingRecord) == 40, "TrainingRecord must stay 40 bytes");
+
+/*!
+ *  @struct SelfPlayConfig
+ *  @brief Parameters of a self-play run.
+ */
+struct SelfPlayConfig {
+  unsigned int threads = 1;          //!< Worker threads, one shard each.
+  std::uint64_t games = 100;         //!< Games to play in total.
+  std::uint64_t nodes = 5000;        //!< Node budget per move.
+  unsigned int randomPlies = 8;      //!< Random opening plies.
+  unsigned int maxPlies = 400;       //!< Games longer than this are drawn.
+  std::uint64_t seed = 1;            //!< Base seed of the opening picker.
+  std::string prefix = "selfplay";   //!< Shards are "<prefix>.<thread>.bin".
+};
+
+/*!
+ *  @class SelfPlay
+ *  @brief Multi-threaded self-play producing evaluation training data.
+ *
+ *  Each worker plays whole games with its own search and writes finished
+ *  games into its own shard through a batch buffer, so workers share
+ *  nothing but the game counter.
+ */
+class SelfPlay {
+  SelfPlayConfig m_config;              //!< Run parameters.
+  Board m_start;                        //!< Starting position of all games.
+  std::atomic<std::uint64_t> m_nextGame;  //!< Next game number to play.
+  std::atomic<std::uint64_t> m_positions; //!< Positions written so far.
+
+public:
+  //! Prepares a run with the given parameters.
+  explicit SelfPlay(const SelfPlayConfig& config);
+
+public:
+  //! Plays all games, blocking until the workers are done.
+  void run() noexcept;
+
+private:
+  //! Plays games until the game counter runs out.
+  void worker(const unsigned int id) noexcept;
+};
+
+#endif
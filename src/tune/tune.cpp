@@ -0,0 +1,433 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tune.h"
+
+#include "../cpp-logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../eval/eval.h"
+
+//! Piece notations in the order of the tuned tables.
+static constexpr char NOTATIONS[] = "PNBRQK";
+
+//! Names of the tables and constants in eval.
+static const char* const TABLE_NAMES[] = {
+  "PAWN_TABLE", "KNIGHT_TABLE", "BISHOP_TABLE", "ROOK_TABLE", "QUEEN_TABLE",
+  "KING_TABLE"
+};
+static const char* const VALUE_NAMES[] = {
+  "PAWN", "KNIGHT", "BISHOP", "ROOK", "QUEEN"
+};
+
+//! Adam decay rates.
+static constexpr double BETA1 = 0.9;
+static constexpr double BETA2 = 0.999;
+
+/*!
+ *  @brief Error of a block and, if asked, its gradient per weight.
+ *
+ *  The gradient is left without the 2 * K / N factor common to all.
+ */
+static double blockKernel(const float* weights,
+                                 const std::uint16_t* features,
+                                 const unsigned int width,
+                                 const float* results, const float scale,
+                                 double* r_gradient) noexcept
+{
+  constexpr unsigned int BLOCK = Tuner::BLOCK;
+  float scores[BLOCK] = {};
+  for (unsigned int slot = 0; slot < width; ++slot) {
+    const std::uint16_t* row = features + slot * BLOCK;
+    for (unsigned int i = 0; i < BLOCK; ++i) {
+      scores[i] += weights[row[i]];
+    }
+  }
+
+  float error = 0;
+  float deltas[BLOCK];
+  for (unsigned int i = 0; i < BLOCK; ++i) {
+    const float sigmoid = 1.0f / (1.0f + std::exp(-scale * scores[i]));
+    const float difference = sigmoid - results[i];
+    error += difference * difference;
+    deltas[i] = difference * sigmoid * (1.0f - sigmoid);
+  }
+
+  if (r_gradient) {
+    for (unsigned int slot = 0; slot < width; ++slot) {
+      const std::uint16_t* row = features + slot * BLOCK;
+      for (unsigned int i = 0; i < BLOCK; ++i) {
+        r_gradient[row[i]] += deltas[i];
+      }
+    }
+  }
+  return error;
+}
+
+/*!
+ *  @brief Reads the result of a labelled line, from white's point of view.
+ *
+ *  Looks past the placement so that the FEN itself cannot match.
+ */
+static bool parseResult(const std::string& line, const std::size_t from,
+                        float& r_result) noexcept
+{
+  const std::size_t bracket = line.find('[', from);
+  if (bracket != std::string::npos) {
+    char* end = nullptr;
+    const float result = std::strtof(line.c_str() + bracket + 1, &end);
+    if (end == line.c_str() + bracket + 1 || *end != ']' ||
+        (result != 0.0f && result != 0.5f && result != 1.0f))
+    {
+      return false;
+    }
+    r_result = result;
+    return true;
+  }
+  if (line.find("1/2-1/2", from) != std::string::npos) {
+    r_result = 0.5f;
+  } else if (line.find("1-0", from) != std::string::npos) {
+    r_result = 1.0f;
+  } else if (line.find("0-1", from) != std::string::npos) {
+    r_result = 0.0f;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*!
+ *  @brief Turns a FEN placement into weight indices.
+ *
+ *  @return The number of pieces, 0 if the placement is malformed.
+ */
+static unsigned int parsePlacement(const std::string& line,
+                                   const std::size_t length,
+                                   std::uint16_t* r_features) noexcept
+{
+  unsigned int sqr = 0;
+  unsigned int count = 0;
+  for (std::size_t i = 0; i < length; ++i) {
+    const char c = line[i];
+    if (c == '/') {
+      continue;
+    }
+    if (c >= '1' && c <= '8') {
+      sqr += c - '0';
+      continue;
+    }
+    const bool white = c >= 'A' && c <= 'Z';
+    const char* piece = std::strchr(NOTATIONS, white? c : c - 'a' + 'A');
+    if (!piece || !*piece || sqr >= 64 || count == Tuner::MAX_PIECES) {
+      return 0;
+    }
+    const unsigned int value = (piece - NOTATIONS) * 64 + (white? sqr : sqr ^ 56);
+    r_features[count++] = 1 + (white? value : Tuner::VALUES + value);
+    ++sqr;
+  }
+  return sqr == 64? count : 0;
+}
+
+Tuner::Tuner(const TuneConfig& config)
+  : m_config(config)
+  , m_results()
+  , m_features()
+  , m_offsets()
+  , m_positions(0)
+  , m_skipped(0)
+  , m_values()
+  , m_scale(1.0)
+{
+  if (!m_config.threads) {
+    m_config.threads = 1;
+  }
+  for (unsigned int piece = 0; piece < PIECES; ++piece) {
+    for (unsigned int sqr = 0; sqr < 64; ++sqr) {
+      m_values[piece * 64 + sqr] = Eval::pieceSquareValue(NOTATIONS[piece], sqr);
+    }
+  }
+}
+
+bool Tuner::load(const std::string& path) noexcept {
+  std::ifstream file(path);
+  if (!file) {
+    Logger::error("Cannot open " + path);
+    return false;
+  }
+
+  // Read everything flat first, then lay it out by piece count.
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::uint16_t> features;
+  std::vector<std::uint8_t> counts;
+  std::vector<float> results;
+  std::uint64_t byCount[MAX_PIECES + 1] = {};
+  std::string line;
+  while (std::getline(file, line)) {
+    const std::size_t placement = line.find(' ');
+    std::uint16_t indices[MAX_PIECES];
+    float result = 0;
+    const unsigned int count = placement == std::string::npos? 0 :
+        parsePlacement(line, placement, indices);
+    if (!count || !parseResult(line, placement, result)) {
+      m_skipped += !line.empty();
+      continue;
+    }
+    features.insert(features.end(), indices, indices + count);
+    counts.push_back(count);
+    results.push_back(result);
+    ++byCount[count];
+  }
+  m_positions = counts.size();
+  if (!m_positions) {
+    Logger::error("No labelled positions in " + path);
+    return false;
+  }
+
+  // Counting sort: the first position of every count within the sorted set.
+  std::uint64_t first[MAX_PIECES + 1] = {};
+  for (unsigned int count = 1; count <= MAX_PIECES; ++count) {
+    first[count] = first[count - 1] + byCount[count - 1];
+  }
+  std::vector<std::uint32_t> order(m_positions);
+  std::vector<std::uint64_t> starts(m_positions);
+  std::uint64_t feature = 0;
+  for (std::uint64_t i = 0; i < m_positions; ++i) {
+    starts[i] = feature;
+    feature += counts[i];
+    order[first[counts[i]]++] = i;
+  }
+
+  // Blocks as wide as their largest position, padded with weight 0 and
+  // with draws scored 0, which add neither error nor gradient.
+  const std::uint64_t blocks = (m_positions + BLOCK - 1) / BLOCK;
+  m_results.assign(blocks * BLOCK, 0.5f);
+  m_offsets.assign(blocks + 1, 0);
+  for (std::uint64_t block = 0; block < blocks; ++block) {
+    const std::uint64_t last = std::min<std::uint64_t>(
+        (block + 1) * BLOCK, m_positions) - 1;
+    m_offsets[block + 1] = m_offsets[block] + counts[order[last]] * BLOCK;
+  }
+  m_features.assign(m_offsets[blocks], 0);
+  for (std::uint64_t i = 0; i < m_positions; ++i) {
+    const std::uint32_t position = order[i];
+    const std::uint64_t block = i / BLOCK;
+    m_results[i] = results[position];
+    for (unsigned int slot = 0; slot < counts[position]; ++slot) {
+      m_features[m_offsets[block] + slot * BLOCK + i % BLOCK] =
+          features[starts[position] + slot];
+    }
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  Logger::info("Loaded " + std::to_string(m_positions) + " positions (" +
+               std::to_string(m_skipped) + " lines skipped) in " +
+               std::to_string(elapsed.count()) + " s, " +
+               std::to_string((m_features.size() * sizeof(std::uint16_t) +
+                               m_results.size() * sizeof(float)) >> 20) +
+               " MiB of features");
+  return true;
+}
+
+double Tuner::computeError(const double scale,
+                           double* r_gradient) const noexcept
+{
+  // Signed table: white values, then black's, negated.
+  float weights[WEIGHTS];
+  weights[0] = 0;
+  for (unsigned int i = 0; i < VALUES; ++i) {
+    weights[1 + i] = m_values[i];
+    weights[1 + VALUES + i] = -m_values[i];
+  }
+
+  const std::uint64_t blocks = m_offsets.size() - 1;
+  const unsigned int threads = std::min<std::uint64_t>(m_config.threads,
+                                                       blocks);
+  std::vector<double> errors(threads, 0.0);
+  std::vector<double> gradients(r_gradient? threads * WEIGHTS : 0, 0.0);
+  auto work = [&](const unsigned int id) {
+    double* gradient = r_gradient? &gradients[id * WEIGHTS] : nullptr;
+    double error = 0;
+    for (std::uint64_t block = blocks * id / threads;
+         block < blocks * (id + 1) / threads; ++block)
+    {
+      error += blockKernel(weights, &m_features[m_offsets[block]],
+                           (m_offsets[block + 1] - m_offsets[block]) / BLOCK,
+                           &m_results[block * BLOCK], scale, gradient);
+    }
+    errors[id] = error;
+  };
+
+  std::vector<std::thread> helpers;
+  for (unsigned int id = 1; id < threads; ++id) {
+    helpers.emplace_back(work, id);
+  }
+  work(0);
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+
+  double error = 0;
+  for (unsigned int id = 0; id < threads; ++id) {
+    error += errors[id];
+  }
+  if (r_gradient) {
+    const double factor = 2.0 * scale / m_positions;
+    for (unsigned int i = 0; i < VALUES; ++i) {
+      double sum = 0;
+      for (unsigned int id = 0; id < threads; ++id) {
+        sum += gradients[id * WEIGHTS + 1 + i] -
+               gradients[id * WEIGHTS + 1 + VALUES + i];
+      }
+      r_gradient[i] = factor * sum;
+    }
+  }
+  return error / m_positions;
+}
+
+double Tuner::fitScale() const noexcept {
+  // Golden section search; the error is unimodal in K.
+  const double ratio = (std::sqrt(5.0) - 1) / 2;
+  double low = 0.0001;
+  double high = 0.05;
+  double a = high - ratio * (high - low);
+  double b = low + ratio * (high - low);
+  double errorA = computeError(a, nullptr);
+  double errorB = computeError(b, nullptr);
+  while (high - low > 1e-6) {
+    if (errorA < errorB) {
+      high = b;
+      b = a;
+      errorB = errorA;
+      a = high - ratio * (high - low);
+      errorA = computeError(a, nullptr);
+    } else {
+      low = a;
+      a = b;
+      errorA = errorB;
+      b = low + ratio * (high - low);
+      errorB = computeError(b, nullptr);
+    }
+  }
+  return (low + high) / 2;
+}
+
+void Tuner::run() noexcept {
+  Logger::info("Tuning with " + std::to_string(m_config.threads) +
+               " threads");
+  m_scale = fitScale();
+  const double initial = computeError(m_scale, nullptr);
+  Logger::info("K = " + std::to_string(m_scale * 400 / std::log(10.0)) +
+               ", error " + std::to_string(initial));
+
+  double gradient[VALUES];
+  double moment[VALUES] = {};
+  double velocity[VALUES] = {};
+  double error = initial;
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned int iteration = 1; iteration <= m_config.iterations;
+       ++iteration)
+  {
+    error = computeError(m_scale, gradient);
+    const double correction1 = 1 - std::pow(BETA1, iteration);
+    const double correction2 = 1 - std::pow(BETA2, iteration);
+    for (unsigned int i = 0; i < VALUES; ++i) {
+      moment[i] = BETA1 * moment[i] + (1 - BETA1) * gradient[i];
+      velocity[i] = BETA2 * velocity[i] +
+                    (1 - BETA2) * gradient[i] * gradient[i];
+      m_values[i] -= m_config.rate * (moment[i] / correction1) /
+                     (std::sqrt(velocity[i] / correction2) + 1e-12);
+    }
+
+    if (m_config.report && iteration % m_config.report == 0) {
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      Logger::info("Iteration " + std::to_string(iteration) + ": error " +
+                   std::to_string(error) + ", " +
+                   std::to_string(iteration / elapsed.count()) + " it/s");
+    }
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const double rate = m_config.iterations / elapsed.count();
+  error = computeError(m_scale, nullptr);
+  Logger::info("Error " + std::to_string(initial) + " -> " +
+               std::to_string(error) + " after " +
+               std::to_string(m_config.iterations) + " iterations, " +
+               std::to_string(rate) + " it/s (" +
+               std::to_string(rate * m_positions / 1e6) +
+               " M positions/s)");
+  std::cout << toSource() << std::flush;
+}
+
+std::string Tuner::toSource() const noexcept {
+  // Material is the mean value over the squares a piece can stand on, the
+  // rest goes to the tables; pawn back ranks keep zeros.
+  int material[PIECES] = {};
+  for (unsigned int piece = 0; piece + 1 < PIECES; ++piece) {
+    const unsigned int from = piece? 0 : 8;
+    const unsigned int to = piece? 64 : 56;
+    double sum = 0;
+    for (unsigned int sqr = from; sqr < to; ++sqr) {
+      sum += m_values[piece * 64 + sqr];
+    }
+    material[piece] = std::lround(sum / (to - from));
+  }
+
+  std::string source = "// Tuned on " + std::to_string(m_positions) +
+                       " positions.\n";
+  char buffer[64];
+  for (unsigned int piece = 0; piece + 1 < PIECES; ++piece) {
+    std::snprintf(buffer, sizeof(buffer), "  static constexpr int %s = %d;",
+                  VALUE_NAMES[piece], material[piece]);
+    source += buffer;
+    source += "\n";
+  }
+  for (unsigned int piece = 0; piece < PIECES; ++piece) {
+    source += std::string("\nstatic constexpr int ") + TABLE_NAMES[piece] +
+              "[64] = {\n";
+    for (unsigned int rank = 0; rank < 8; ++rank) {
+      source += " ";
+      for (unsigned int file = 0; file < 8; ++file) {
+        const unsigned int sqr = rank * 8 + file;
+        const bool isEmpty = !piece && (rank == 0 || rank == 7);
+        const int value = isEmpty? 0 :
+            std::lround(m_values[piece * 64 + sqr]) - material[piece];
+        std::snprintf(buffer, sizeof(buffer), "%4d%s", value,
+                      file < 7 || rank < 7? "," : "");
+        source += buffer;
+      }
+      source += "\n";
+    }
+    source += "};\n";
+  }
+  return source;
+}
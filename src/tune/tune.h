@@ -0,0 +1,110 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TUNE__
+#define __TUNE__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ *  @struct TuneConfig
+ *  @brief Parameters of a tuning run.
+ */
+struct TuneConfig {
+  unsigned int threads = 1;       //!< Threads computing error and gradient.
+  unsigned int iterations = 1000; //!< Gradient steps.
+  double rate = 1.0;              //!< Adam step size in centipawns.
+  unsigned int report = 100;      //!< Iterations between progress lines.
+};
+
+/*!
+ *  @class Tuner
+ *  @brief Texel tuning of the material and piece-square values.
+ *
+ *  The static evaluation is a sum of one value per piece and square, so
+ *  its 384 values (6 pieces * 64 squares, material included) are tuned
+ *  directly and split back into material and tables when printed.
+ *
+ *  Positions are loaded once into a structure of arrays: sorted by piece
+ *  count, grouped in blocks of BLOCK positions, and stored slot by slot,
+ *  so that every slot is a row of BLOCK feature indices. A feature indexes
+ *  a signed weight table, black pieces reading negated, mirrored weights,
+ *  and index 0 is a zero weight padding short positions. Evaluating a
+ *  block is then a gather per row, written so the compiler can vectorise
+ *  it over the positions.
+ *
+ *  Every iteration computes the mean squared error between the results
+ *  and the logistic of the scores, and its gradient, split across the
+ *  threads by block; Adam then updates the values.
+ */
+class Tuner {
+public:
+  static constexpr unsigned int BLOCK = 64;               //!< Per block.
+  static constexpr unsigned int PIECES = 6;               //!< Piece types.
+  static constexpr unsigned int VALUES = PIECES * 64;     //!< Tuned values.
+  static constexpr unsigned int WEIGHTS = 2 * VALUES + 1; //!< Signed table.
+  static constexpr unsigned int MAX_PIECES = 32;          //!< Per position.
+
+private:
+  TuneConfig m_config;                   //!< Run parameters.
+  std::vector<float> m_results;          //!< 1, 0.5 or 0 for white.
+  std::vector<std::uint16_t> m_features; //!< Rows of BLOCK weight indices.
+  std::vector<std::size_t> m_offsets;    //!< First feature of every block.
+  std::uint64_t m_positions;             //!< Positions loaded.
+  std::uint64_t m_skipped;               //!< Lines without a position.
+  double m_values[VALUES];               //!< White's values, a8 first.
+  double m_scale;                        //!< Fitted logistic scale.
+
+public:
+  //! Prepares a run with the given parameters.
+  explicit Tuner(const TuneConfig& config);
+
+public:
+  /*!
+   *  @brief Loads labelled positions, one per line.
+   *
+   *  A line is a FEN followed by the game result, either as "[1.0]",
+   *  "[0.5]" and "[0.0]" or as "1-0", "1/2-1/2" and "0-1", always from
+   *  white's point of view. Lines without both are skipped.
+   *  @return False if the file cannot be read or has no positions.
+   */
+  bool load(const std::string& path) noexcept;
+
+  //! Fits K, tunes the values and prints them as source.
+  void run() noexcept;
+
+  //! Returns the values as the constants and tables of eval.
+  std::string toSource() const noexcept;
+
+private:
+  /*!
+   *  @brief Computes the mean squared error of the current values.
+   *
+   *  @param scale Logistic scale K.
+   *  @param r_gradient Receives d(error)/d(value) if not null.
+   */
+  double computeError(const double scale, double* r_gradient) const noexcept;
+
+  //! Finds the K minimising the error of the current values.
+  double fitScale() const noexcept;
+};
+
+#endif
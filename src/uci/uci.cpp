@@ -0,0 +1,459 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uci.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../chess/board.h"
+#include "../chess/move.h"
+#include "../cpu/cpu.h"
+#include "../endgame/bitbase.h"
+#include "../search/cache.h"
+#include "../search/mate.h"
+#include "../search/mcts.h"
+#include "../search/pool.h"
+#include "../search/search.h"
+#include "../search/stats.h"
+#include "../search/tt.h"
+
+//! Parses "true"/"false" option values.
+static bool parseBool(const std::string& value) noexcept {
+  return value == "true";
+}
+
+Uci::Uci()
+  : m_board()
+  , m_history()
+  , m_search()
+  , m_mate()
+  , m_mcts()
+  , m_isMcts(false)
+  , m_thread()
+  , m_stop(false)
+  , m_output()
+{
+  m_board.loadFen();
+}
+
+Uci::~Uci() {
+  stopSearch();
+}
+
+void Uci::loop() noexcept {
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    std::istringstream args(line);
+    std::string command;
+    args >> command;
+
+    if (command == "uci") {
+      handleUci();
+    } else if (command == "isready") {
+      Bitbase::init();
+      send("readyok");
+    } else if (command == "setoption") {
+      handleSetOption(args);
+    } else if (command == "ucinewgame") {
+      stopSearch();
+      m_search.clear();
+      m_mate.clear();
+      m_mcts.clear();
+    } else if (command == "position") {
+      stopSearch();
+      handlePosition(args);
+    } else if (command == "go") {
+      stopSearch();
+      handleGo(args);
+    } else if (command == "stop") {
+      stopSearch();
+    } else if (command == "quit") {
+      break;
+    }
+  }
+  stopSearch();
+}
+
+void Uci::send(const std::string& line) noexcept {
+  std::lock_guard<std::mutex> lock(m_output);
+  std::cout << line << std::endl;
+}
+
+void Uci::handleUci() noexcept {
+  const SearchOptions& options = m_search.getOptions();
+  auto check = [](const char* name, const bool value) {
+    return std::string("option name ") + name + " type check default " +
+           (value? "true" : "false");
+  };
+
+  send("id name Nelly");
+  send("id author senqx");
+  send("option name Hash type spin default 16 min 1 max 65536");
+  send("option name Threads type spin default 1 min 1 max 256");
+  send("option name MateHash type spin default 16 min 1 max 65536");
+  send("option name MCTS type check default false");
+  send("option name MCTSMemory type spin default " +
+       std::to_string(Mcts::MEMORY) + " min 1 max 65536");
+  send("option name LargePages type check default true");
+  send("option name SharedHash type string default <empty>");
+  send("option name AnalysisCache type string default <empty>");
+  send("option name AnalysisCacheSize type spin default " +
+       std::to_string(AnalysisCache::SIZE) + " min 1 max 65536");
+  send("option name MultiPV type spin default 1 min 1 max " +
+       std::to_string(Search::MAX_MULTI_PV));
+  send("option name CpuTier type combo default auto var auto var generic "
+       "var avx2 var avx512");
+  send(check("NullMove", options.nullMove));
+  send(check("LMR", options.lateMoveReductions));
+  send(check("Futility", options.futility));
+  send(check("ReverseFutility", options.reverseFutility));
+  send(check("LateMovePruning", options.lateMovePruning));
+  sendCpuTier();
+  send("uciok");
+}
+
+void Uci::handleSetOption(std::istringstream& r_args) noexcept {
+  std::string token;
+  std::string name;
+  std::string value;
+  r_args >> token; // "name"
+  while (r_args >> token && token != "value") {
+    name += (name.empty()? "" : " ") + token;
+  }
+  r_args >> value;
+
+  if (name == "CpuTier") {
+    Cpu::Tier tier = Cpu::getDetected();
+    if (value != "auto" && !Cpu::parseTier(value, tier)) {
+      send("info string unknown tier " + value);
+      return;
+    }
+    stopSearch();
+    if (!Cpu::setTier(tier)) {
+      send("info string tier " + value + " is not supported");
+    }
+    sendCpuTier();
+    return;
+  }
+
+  if (name == "AnalysisCache") {
+    stopSearch();
+    if (value.empty() || value == "<empty>") {
+      m_search.openCache("");
+    } else if (m_search.openCache(value)) {
+      send("info string " + m_search.getCache().describe());
+    } else {
+      send("info string could not open cache " + value);
+    }
+    return;
+  }
+
+  if (name == "Hash" || name == "Threads" || name == "AnalysisCacheSize" ||
+      name == "MateHash" || name == "MCTSMemory")
+  {
+    const std::size_t number = std::strtoull(value.c_str(), nullptr, 10);
+    if (!number) {
+      send("info string invalid value " + value);
+      return;
+    }
+    stopSearch();
+    if (name == "Hash") {
+      const std::string shared = m_search.getTable().getName();
+      if (!m_search.setHashSize(std::min<std::size_t>(number, 65536))) {
+        send("info string could not share hash as " + shared +
+             " again, hash is private");
+      }
+    } else if (name == "AnalysisCacheSize") {
+      m_search.setCacheSize(std::min<std::size_t>(number, 65536));
+    } else if (name == "MateHash") {
+      m_mate.setHashSize(std::min<std::size_t>(number, 65536));
+    } else if (name == "MCTSMemory") {
+      m_mcts.setMemory(std::min<std::size_t>(number, 65536));
+    } else {
+      m_search.setThreads(std::min<std::size_t>(number, 256));
+    }
+    return;
+  }
+
+  if (name == "MCTS") {
+    stopSearch();
+    m_isMcts = parseBool(value);
+    return;
+  }
+
+  if (name == "LargePages") {
+    stopSearch();
+    const std::string shared = m_search.getTable().getName();
+    if (!m_search.setLargePages(parseBool(value))) {
+      send("info string could not share hash as " + shared +
+           " again, hash is private");
+    }
+    send(std::string("info string hash on ") +
+         TranspositionTable::getPagesName(m_search.getTable().getPages()) +
+         " pages");
+    return;
+  }
+
+  if (name == "SharedHash") {
+    stopSearch();
+    if (value.empty() || value == "<empty>") {
+      m_search.detachShared();
+      send("info string hash is private");
+    } else if (m_search.attachShared(value)) {
+      send("info string hash shared as " + m_search.getTable().getName());
+    } else {
+      send("info string could not share hash as " + value);
+    }
+    return;
+  }
+
+  SearchOptions options = m_search.getOptions();
+  if (name == "MultiPV") {
+    const unsigned int lines = std::strtoul(value.c_str(), nullptr, 10);
+    options.multiPv = std::clamp(lines, 1u, Search::MAX_MULTI_PV);
+  } else if (name == "NullMove") {
+    options.nullMove = parseBool(value);
+  } else if (name == "LMR") {
+    options.lateMoveReductions = parseBool(value);
+  } else if (name == "Futility") {
+    options.futility = parseBool(value);
+  } else if (name == "ReverseFutility") {
+    options.reverseFutility = parseBool(value);
+  } else if (name == "LateMovePruning") {
+    options.lateMovePruning = parseBool(value);
+  } else {
+    send("info string unknown option " + name);
+    return;
+  }
+  stopSearch();
+  m_search.setOptions(options);
+}
+
+void Uci::handlePosition(std::istringstream& r_args) noexcept {
+  std::string token;
+  r_args >> token;
+
+  std::string fen;
+  if (token == "fen") {
+    while (r_args >> token && token != "moves") {
+      fen += (fen.empty()? "" : " ") + token;
+    }
+  } else {
+    r_args >> token; // "moves", if any
+  }
+
+  // Board::loadFen() exits on errors, so the previous position is kept.
+  if (!fen.empty() && !Board::isFenValid(fen)) {
+    send("info string invalid fen");
+    return;
+  }
+
+  m_board = Board();
+  if (fen.empty()) {
+    m_board.loadFen();
+  } else {
+    m_board.loadFen(fen);
+  }
+  m_history.clear();
+
+  while (r_args >> token) {
+    bool found = false;
+    for (const Move& move : m_board.getLegalMoves()) {
+      if (move.toUci() == token) {
+        m_history.push(m_board.getKey());
+        m_board = m_board.makeMove(move);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      send("info string illegal move " + token);
+      return;
+    }
+  }
+}
+
+void Uci::handleGo(std::istringstream& r_args) noexcept {
+  SearchLimits limits;
+  std::uint64_t time[2] = {0, 0}; // Black, white.
+  std::uint64_t inc[2] = {0, 0};
+  std::uint64_t movesToGo = 0;
+  unsigned int mate = 0;
+  std::string token;
+  while (r_args >> token) {
+    if (token == "depth") {
+      r_args >> limits.depth;
+    } else if (token == "nodes") {
+      r_args >> limits.nodes;
+    } else if (token == "movetime") {
+      r_args >> limits.time;
+    } else if (token == "wtime") {
+      r_args >> time[1];
+    } else if (token == "btime") {
+      r_args >> time[0];
+    } else if (token == "winc") {
+      r_args >> inc[1];
+    } else if (token == "binc") {
+      r_args >> inc[0];
+    } else if (token == "movestogo") {
+      r_args >> movesToGo;
+    } else if (token == "mate") {
+      r_args >> mate;
+    }
+  }
+
+  // Spend an even share of the remaining time plus most of the increment.
+  const bool side = m_board.isWhitesMove();
+  if (!limits.time && time[side]) {
+    const std::uint64_t share =
+        time[side] / (movesToGo? movesToGo : 30) + inc[side] * 3 / 4;
+    const std::uint64_t reserve = time[side] > 50? time[side] - 50 : 1;
+    limits.time = std::max<std::uint64_t>(1, std::min(share, reserve));
+  }
+
+  Bitbase::init();
+  m_stop = false;
+  limits.stop = &m_stop;
+  m_search.setReporter([this](const SearchResult& result) {
+    const std::uint64_t nps = result.nodes * 1000 / (result.time + 1);
+    std::string pv;
+    for (unsigned int i = 0; i < result.pvLength; ++i) {
+      pv += " " + result.pv[i].toUci();
+    }
+    send("info depth " + std::to_string(result.depth) + " seldepth " +
+         std::to_string(result.selDepth) + " multipv " +
+         std::to_string(result.multiPv) + " score " +
+         formatScore(result.score) + " nodes " +
+         std::to_string(result.nodes) + " nps " + std::to_string(nps) +
+         " time " + std::to_string(result.time) + " pv" + pv);
+  });
+
+  if (mate) {
+    handleMate(mate, limits);
+    return;
+  }
+  if (m_isMcts) {
+    handleMcts(limits);
+    return;
+  }
+
+  m_thread = std::thread([this, limits]() {
+    const SearchResult& result = m_search.go(m_board, limits, m_history);
+    if (SearchStats::ENABLED) {
+      send("info string stats " + m_search.getStats().toJson());
+    }
+    if (m_search.getCache().isOpen()) {
+      send("info string " + m_search.getCache().describe());
+    }
+    send("bestmove " + result.bestMove.toUci());
+  });
+}
+
+void Uci::handleMate(const unsigned int moves,
+                     const SearchLimits& limits) noexcept
+{
+  m_mate.setReporter([this](const MateResult& result) {
+    const std::uint64_t nps = result.nodes * 1000 / (result.time + 1);
+    const ProofTable& table = m_mate.getTable();
+    std::string pv;
+    for (unsigned int i = 0; i < result.pvLength; ++i) {
+      pv += " " + result.pv[i].toUci();
+    }
+    send("info depth " + std::to_string(2 * result.moves - 1) +
+         " score mate " + std::to_string(result.moves) + " nodes " +
+         std::to_string(result.nodes) + " nps " + std::to_string(nps) +
+         " hashfull " +
+         std::to_string(table.getUsed() * 1000 * sizeof(ProofEntry) /
+                        table.getSize()) +
+         " time " + std::to_string(result.time) + " pv" + pv);
+  });
+
+  m_thread = std::thread([this, moves, limits]() {
+    const MateResult& found = m_mate.go(m_board, moves, limits);
+    if (found.found && found.pvLength) {
+      send("bestmove " + found.pv[0].toUci());
+      return;
+    }
+
+    // Still answer with a move: search normally to the mate's depth, or
+    // briefly if stopped.
+    send("info string no mate in " + std::to_string(moves) + " found in " +
+         std::to_string(found.nodes) + " nodes");
+    SearchLimits fallback = limits;
+    fallback.depth = std::min(fallback.depth, 2 * moves);
+    if (m_stop) {
+      fallback = SearchLimits();
+      fallback.depth = 1;
+    }
+    const SearchResult& result = m_search.go(m_board, fallback, m_history);
+    send("bestmove " + result.bestMove.toUci());
+  });
+}
+
+void Uci::handleMcts(const SearchLimits& limits) noexcept {
+  m_mcts.setReporter([this](const MctsResult& result) {
+    const std::uint64_t nps = result.playouts * 1000 / (result.time + 1);
+    std::string pv;
+    for (unsigned int i = 0; i < result.pvLength; ++i) {
+      pv += " " + result.pv[i].toUci();
+    }
+    send("info depth " + std::to_string(result.pvLength) + " score cp " +
+         std::to_string(result.score) + " nodes " +
+         std::to_string(result.playouts) + " nps " + std::to_string(nps) +
+         " time " + std::to_string(result.time) + " pv" + pv);
+    send("info string mcts tree " + std::to_string(result.nodes) +
+         " nodes " + std::to_string(result.memory >> 20) + " MiB reused " +
+         std::to_string(result.reused) + " playouts/s " +
+         std::to_string(nps));
+  });
+
+  m_mcts.setThreads(m_search.getThreads());
+  m_thread = std::thread([this, limits]() {
+    const MctsResult& result = m_mcts.go(m_board, limits, m_history);
+    send("bestmove " + result.bestMove.toUci());
+  });
+}
+
+void Uci::stopSearch() noexcept {
+  if (m_thread.joinable()) {
+    m_stop = true;
+    m_thread.join();
+  }
+}
+
+void Uci::sendCpuTier() noexcept {
+  send(std::string("info string cpu path ") + Cpu::getName(Cpu::getTier()) +
+       " (detected " + Cpu::getName(Cpu::getDetected()) + ")");
+}
+
+std::string Uci::formatScore(const int score) noexcept {
+  if (!Search::isMateScore(score)) {
+    return "cp " + std::to_string(score);
+  }
+  const int moves = score > 0? (Search::MATE - score + 1) / 2
+                             : -(Search::MATE + score) / 2;
+  return "mate " + std::to_string(moves);
+}
@@ -0,0 +1,97 @@
+/*
+ * Nelly, a UCI chess playing engine
+ * Copyright (C) 2023 senqx
+ *
+ * Nelly is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nelly is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UCI__
+#define __UCI__
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../chess/board.h"
+#include "../search/mate.h"
+#include "../search/mcts.h"
+#include "../search/repetition.h"
+#include "../search/pool.h"
+#include "../search/search.h"
+
+/*!
+ *  @class Uci
+ *  @brief Universal Chess Interface front end.
+ *
+ *  Reads commands from stdin and answers on stdout. Searches run on a
+ *  separate thread so that "stop" and "isready" are served meanwhile.
+ */
+class Uci {
+  Board m_board;              //!< Position set by the last "position".
+  KeyHistory m_history;       //!< Keys of the game before m_board.
+  SearchPool m_search;        //!< The engine's search threads.
+  MateSearch m_mate;          //!< Proof-number search of "go mate".
+  Mcts m_mcts;                //!< Tree search used instead if m_isMcts.
+  bool m_isMcts;              //!< Value of the MCTS option.
+  std::thread m_thread;       //!< Running search, if any.
+  std::atomic<bool> m_stop;   //!< Stop request of the running search.
+  std::mutex m_output;        //!< Serialises lines written to stdout.
+
+public:
+  //! Creates the interface at the starting position.
+  Uci();
+
+  //! Stops a running search.
+  ~Uci();
+
+public:
+  //! Serves commands until "quit" or the end of input.
+  void loop() noexcept;
+
+private:
+  //! Writes a whole line to stdout.
+  void send(const std::string& line) noexcept;
+
+  //! Answers "uci" with the engine identity and options.
+  void handleUci() noexcept;
+
+  //! Handles "setoption name <name> value <value>".
+  void handleSetOption(std::istringstream& r_args) noexcept;
+
+  //! Handles "position [startpos | fen <fen>] [moves <moves>]".
+  void handlePosition(std::istringstream& r_args) noexcept;
+
+  //! Handles "go" and starts the search thread.
+  void handleGo(std::istringstream& r_args) noexcept;
+
+  //! Starts the mate search of "go mate <moves>".
+  void handleMate(const unsigned int moves,
+                  const SearchLimits& limits) noexcept;
+
+  //! Starts the Monte Carlo tree search of "go" with the MCTS option.
+  void handleMcts(const SearchLimits& limits) noexcept;
+
+  //! Reports the active kernel tier as an "info string".
+  void sendCpuTier() noexcept;
+
+  //! Stops and joins the running search, if any.
+  void stopSearch() noexcept;
+
+  //! Formats a score as "cp <x>" or "mate <n>".
+  static std::string formatScore(const int score) noexcept;
+};
+
+#endif